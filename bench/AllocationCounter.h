@@ -0,0 +1,9 @@
+#pragma once
+#include <cstddef>
+
+// Linking AllocationCounter.cpp into an executable replaces every form of operator
+// new and delete in it (plain, array, nothrow and aligned) with ones that count, so
+// imports and the like can be charged with the heap allocations they make. Totals
+// since the start of the process:
+size_t AllocationCount();
+size_t AllocatedBytes();
@@ -0,0 +1,309 @@
+// Headless render benchmark. Builds the editor's scene graph for synthetic or
+// imported models, renders a scripted orbit into an offscreen pbuffer and reports
+// frame, cull and draw times, along with the heap allocations of the imports and
+// how long freeing the scenes takes.
+//
+//   RenderBenchmark [--points N] [--cameras N] [--models N] [--frames N]
+//                   [--size WxH] [--model DIR]...
+//
+// Without a display server run it under Xvfb or with Mesa's software rasterizer
+// (LIBGL_ALWAYS_SOFTWARE=1).
+#include <osg/GL>
+#include <osg/Group>
+#include <osg/Switch>
+#include <osg/Timer>
+#include <osgViewer/Viewer>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "AllocationCounter.h"
+#include "Scene.h"
+#include "SceneGraph.h"
+
+static const double kPi = 3.14159265358979323846;
+
+struct Options {
+    size_t points = 1000000;
+    size_t cameras = 500;
+    size_t models = 1;
+    size_t frames = 360;
+    int width = 1280, height = 720;
+    std::vector<std::string> modelDirs;
+};
+
+static bool ParseOptions(int argc, char** argv, Options& opt)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) return false;
+        const char* value = argv[++i];
+        if (arg == "--points") opt.points = std::strtoull(value, nullptr, 10);
+        else if (arg == "--cameras") opt.cameras = std::strtoull(value, nullptr, 10);
+        else if (arg == "--models") opt.models = std::strtoull(value, nullptr, 10);
+        else if (arg == "--frames") opt.frames = std::strtoull(value, nullptr, 10);
+        else if (arg == "--size") {
+            if (std::sscanf(value, "%dx%d", &opt.width, &opt.height) != 2) return false;
+        }
+        else if (arg == "--model") opt.modelDirs.push_back(value);
+        else return false;
+    }
+    return opt.frames > 0 && opt.width > 0 && opt.height > 0;
+}
+
+// COLMAP quaternion (w, x, y, z) of a camera-from-world rotation, row-major
+static void RotationToQuaternion(const double R[9], double q[4])
+{
+    double trace = R[0] + R[4] + R[8];
+    if (trace > 0) {
+        double s = 0.5 / std::sqrt(trace + 1.0);
+        q[0] = 0.25 / s;
+        q[1] = (R[7] - R[5]) * s;
+        q[2] = (R[2] - R[6]) * s;
+        q[3] = (R[3] - R[1]) * s;
+    }
+    else if (R[0] > R[4] && R[0] > R[8]) {
+        double s = 2.0 * std::sqrt(1.0 + R[0] - R[4] - R[8]);
+        q[0] = (R[7] - R[5]) / s;
+        q[1] = 0.25 * s;
+        q[2] = (R[1] + R[3]) / s;
+        q[3] = (R[2] + R[6]) / s;
+    }
+    else if (R[4] > R[8]) {
+        double s = 2.0 * std::sqrt(1.0 + R[4] - R[0] - R[8]);
+        q[0] = (R[2] - R[6]) / s;
+        q[1] = (R[1] + R[3]) / s;
+        q[2] = 0.25 * s;
+        q[3] = (R[5] + R[7]) / s;
+    }
+    else {
+        double s = 2.0 * std::sqrt(1.0 + R[8] - R[0] - R[4]);
+        q[0] = (R[3] - R[1]) / s;
+        q[1] = (R[2] + R[6]) / s;
+        q[2] = (R[5] + R[7]) / s;
+        q[3] = 0.25 * s;
+    }
+}
+
+// Write a synthetic sparse model: a Gaussian point cloud seen by a ring of cameras
+// looking at its center. Every point is observed by two cameras.
+static bool WriteSyntheticModel(const std::string& dir, size_t numPoints, size_t numCameras, unsigned seed)
+{
+    std::mt19937 rng(seed);
+    std::normal_distribution<double> gauss(0.0, 1.0);
+    std::uniform_int_distribution<int> color(0, 255);
+    numCameras = std::max<size_t>(numCameras, 2);
+
+    std::ofstream cameras(dir + "/cameras.txt");
+    cameras << "1 PINHOLE 1920 1080 1500 1500 960 540\n";
+
+    std::ofstream images(dir + "/images.txt");
+    std::vector<std::vector<int>> observers(numCameras);
+    for (size_t p = 0; p < numPoints; ++p) {
+        observers[p % numCameras].push_back(static_cast<int>(p));
+        observers[(p * 7 + 1) % numCameras].push_back(static_cast<int>(p));
+    }
+    for (size_t c = 0; c < numCameras; ++c) {
+        double angle = 2 * kPi * c / numCameras;
+        double C[3] = { 6 * std::cos(angle), 6 * std::sin(angle), 1.5 };
+        // Rows of the camera-from-world rotation: x right, y down, z towards the origin
+        double z[3] = { -C[0], -C[1], -C[2] };
+        double zn = std::sqrt(z[0] * z[0] + z[1] * z[1] + z[2] * z[2]);
+        for (double& v : z) v /= zn;
+        double x[3] = { z[1], -z[0], 0 }; // z x up(0, 0, 1)
+        double xn = std::sqrt(x[0] * x[0] + x[1] * x[1]);
+        for (double& v : x) v /= xn;
+        double y[3] = { z[1] * x[2] - z[2] * x[1], z[2] * x[0] - z[0] * x[2], z[0] * x[1] - z[1] * x[0] };
+        double R[9] = { x[0], x[1], x[2], y[0], y[1], y[2], z[0], z[1], z[2] };
+        double q[4];
+        RotationToQuaternion(R, q);
+        double t[3];
+        for (int r = 0; r < 3; ++r) t[r] = -(R[3 * r] * C[0] + R[3 * r + 1] * C[1] + R[3 * r + 2] * C[2]);
+        images << c + 1 << " " << q[0] << " " << q[1] << " " << q[2] << " " << q[3] << " "
+               << t[0] << " " << t[1] << " " << t[2] << " 1 image" << c + 1 << ".jpg\n";
+        for (int p : observers[c]) images << "960 540 " << p + 1 << " ";
+        images << "\n";
+    }
+
+    std::vector<std::vector<int>> tracks(numPoints);
+    for (size_t c = 0; c < numCameras; ++c)
+        for (size_t k = 0; k < observers[c].size(); ++k) {
+            tracks[observers[c][k]].push_back(static_cast<int>(c) + 1);
+            tracks[observers[c][k]].push_back(static_cast<int>(k));
+        }
+    std::ofstream points(dir + "/points3D.txt");
+    for (size_t p = 0; p < numPoints; ++p) {
+        points << p + 1 << " " << gauss(rng) << " " << gauss(rng) << " " << 0.3 * gauss(rng) << " "
+               << color(rng) << " " << color(rng) << " " << color(rng) << " 0.5";
+        for (int v : tracks[p]) points << " " << v;
+        points << "\n";
+    }
+    return cameras.good() && images.good() && points.good();
+}
+
+// Blocks until the GPU is done so draw times include the actual rendering
+struct FinishCallback : public osg::Camera::DrawCallback {
+    void operator()(osg::RenderInfo&) const override { glFinish(); }
+};
+
+struct Summary {
+    double mean, p50, p95, max;
+};
+
+static Summary Summarize(std::vector<double> ms)
+{
+    Summary s = { 0, 0, 0, 0 };
+    if (ms.empty()) return s;
+    std::sort(ms.begin(), ms.end());
+    for (double v : ms) s.mean += v;
+    s.mean /= ms.size();
+    s.p50 = ms[ms.size() / 2];
+    s.p95 = ms[std::min(ms.size() - 1, ms.size() * 95 / 100)];
+    s.max = ms.back();
+    return s;
+}
+
+int main(int argc, char** argv)
+{
+    Options opt;
+    if (!ParseOptions(argc, argv, opt)) {
+        std::fprintf(stderr, "usage: %s [--points N] [--cameras N] [--models N] [--frames N] [--size WxH] [--model DIR]...\n", argv[0]);
+        return 2;
+    }
+
+    // Models to load: the given directories, otherwise synthetic ones in a temp directory
+    std::vector<std::string> dirs = opt.modelDirs;
+    std::filesystem::path tempDir;
+    if (dirs.empty()) {
+        tempDir = std::filesystem::temp_directory_path() / "colmap_editor_render_benchmark";
+        for (size_t m = 0; m < opt.models; ++m) {
+            std::filesystem::path dir = tempDir / std::to_string(m);
+            std::filesystem::create_directories(dir);
+            if (!WriteSyntheticModel(dir.string(), opt.points, opt.cameras, static_cast<unsigned>(m + 1))) {
+                std::fprintf(stderr, "failed to write synthetic model to %s\n", dir.string().c_str());
+                return 1;
+            }
+            dirs.push_back(dir.string());
+        }
+    }
+
+    // Same structure as the canvas: a switch per model holding points and cameras
+    std::vector<std::unique_ptr<Scene>> scenes;
+    osg::ref_ptr<osg::Group> root = new osg::Group;
+    size_t totalPoints = 0, totalCameras = 0;
+    size_t importAllocations = 0, importBytes = 0;
+    PointShading shading = CreatePointShading();
+    osg::Timer_t buildStart = osg::Timer::instance()->tick();
+    for (size_t m = 0; m < dirs.size(); ++m) {
+        size_t allocationsBefore = AllocationCount();
+        size_t bytesBefore = AllocatedBytes();
+        std::unique_ptr<Scene> scene(new Scene);
+        const std::string& dir = dirs[m];
+        if (!scene->Import(dir + "/points3D.txt", dir + "/cameras.txt", dir + "/images.txt")) {
+            std::fprintf(stderr, "failed to import %s\n", dir.c_str());
+            return 1;
+        }
+        importAllocations += AllocationCount() - allocationsBefore;
+        importBytes += AllocatedBytes() - bytesBefore;
+        osg::ref_ptr<osg::Switch> node = new osg::Switch;
+        osg::Vec4 tint = ModelTint(m);
+        node->addChild(BuildPointsGeode(*scene, tint, 2.0f, &shading).get());
+        osg::ref_ptr<osg::Geode> cameras = BuildCamerasGeode(*scene, std::vector<int>(), tint, 0.05f);
+        if (cameras.valid()) node->addChild(cameras.get());
+        root->addChild(node.get());
+        totalPoints += scene->GetPoints().size();
+        totalCameras += scene->GetImages().size();
+        scenes.push_back(std::move(scene));
+    }
+    double buildMs = osg::Timer::instance()->delta_m(buildStart, osg::Timer::instance()->tick());
+    if (!tempDir.empty()) {
+        std::error_code ec;
+        std::filesystem::remove_all(tempDir, ec);
+    }
+
+    osg::ref_ptr<osg::GraphicsContext::Traits> traits = new osg::GraphicsContext::Traits;
+    traits->x = 0;
+    traits->y = 0;
+    traits->width = opt.width;
+    traits->height = opt.height;
+    traits->red = traits->green = traits->blue = traits->alpha = 8;
+    traits->depth = 24;
+    traits->pbuffer = true;
+    traits->doubleBuffer = false;
+    traits->windowDecoration = false;
+    osg::ref_ptr<osg::GraphicsContext> gc = osg::GraphicsContext::createGraphicsContext(traits.get());
+    if (!gc.valid()) {
+        std::fprintf(stderr, "failed to create an offscreen pbuffer context\n");
+        return 1;
+    }
+
+    osgViewer::Viewer viewer;
+    viewer.setThreadingModel(osgViewer::Viewer::SingleThreaded);
+    viewer.setSceneData(root.get());
+    osg::Camera* camera = viewer.getCamera();
+    camera->setGraphicsContext(gc.get());
+    camera->setViewport(new osg::Viewport(0, 0, opt.width, opt.height));
+    camera->setProjectionMatrixAsPerspective(45.0f, static_cast<double>(opt.width) / opt.height, 0.1, 1000.0);
+    camera->setClearColor(osg::Vec4(1.0f, 1.0f, 1.0f, 1.0f));
+    camera->setDrawBuffer(GL_FRONT);
+    camera->setReadBuffer(GL_FRONT);
+    camera->setFinalDrawCallback(new FinishCallback);
+    camera->getStats()->collectStats("rendering", true);
+    viewer.realize();
+    if (!viewer.isRealized()) {
+        std::fprintf(stderr, "failed to realize the offscreen viewer\n");
+        return 1;
+    }
+
+    // Orbit once around the models, starting from the canvas's home position
+    osg::BoundingSphere bound = root->getBound();
+    osg::Vec3d center = bound.center();
+    double radius = bound.radius();
+    std::vector<double> frameMs, cullMs, drawMs;
+    double firstFrameMs = 0;
+    osg::Timer* timer = osg::Timer::instance();
+    for (size_t i = 0; i <= opt.frames; ++i) {
+        double angle = 2 * kPi * i / opt.frames;
+        osg::Vec3d eye = center + osg::Vec3d(radius * 3 * std::sin(angle), -radius * 3 * std::cos(angle), radius);
+        camera->setViewMatrixAsLookAt(eye, center, osg::Vec3d(0, 0, 1));
+        osg::Timer_t start = timer->tick();
+        viewer.frame();
+        double ms = timer->delta_m(start, timer->tick());
+        // The first frame also compiles the GL objects, report it on its own
+        if (i == 0) {
+            firstFrameMs = ms;
+            continue;
+        }
+        frameMs.push_back(ms);
+        unsigned int frameNumber = viewer.getFrameStamp()->getFrameNumber();
+        double cull = 0, draw = 0;
+        if (camera->getStats()->getAttribute(frameNumber, "Cull traversal time taken", cull)) cullMs.push_back(cull * 1000);
+        if (camera->getStats()->getAttribute(frameNumber, "Draw traversal time taken", draw)) drawMs.push_back(draw * 1000);
+    }
+
+    // The scene graph holds its own copies of the data, the scenes can go
+    osg::Timer_t teardownStart = timer->tick();
+    scenes.clear();
+    double teardownMs = timer->delta_m(teardownStart, timer->tick());
+
+    std::printf("models %zu, points %zu, cameras %zu, frames %zu, %dx%d\n",
+                dirs.size(), totalPoints, totalCameras, opt.frames, opt.width, opt.height);
+    std::printf("import+build %.2f ms, first frame %.2f ms\n", buildMs, firstFrameMs);
+    std::printf("import allocations %zu (%.1f MB), scene teardown %.2f ms\n",
+                importAllocations, importBytes / 1048576.0, teardownMs);
+    std::printf("%-6s %10s %10s %10s %10s\n", "ms", "mean", "p50", "p95", "max");
+    const char* names[] = { "frame", "cull", "draw" };
+    const std::vector<double>* series[] = { &frameMs, &cullMs, &drawMs };
+    for (int k = 0; k < 3; ++k) {
+        Summary s = Summarize(*series[k]);
+        std::printf("%-6s %10.3f %10.3f %10.3f %10.3f\n", names[k], s.mean, s.p50, s.p95, s.max);
+    }
+    return 0;
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <wx/app.h>
+#include "Parallel.h"
+
+// Run work() on the shared pool and hand its result to done(result) on the wx main
+// thread. The token is checked on the main thread right before done runs, so once a
+// window cancels it (e.g. in its destructor) done never runs again; discard(result)
+// receives results that arrive after that.
+template <typename Work, typename Done, typename Discard>
+void RunAsync(const CancellationToken& token, Work work, Done done, Discard discard)
+{
+    ThreadPool::Instance().Submit([token, work, done, discard]() {
+        auto result = work();
+        if (token.IsCancelled() || !wxTheApp) {
+            discard(result);
+            return;
+        }
+        wxTheApp->CallAfter([token, result, done, discard]() {
+            if (token.IsCancelled()) discard(result);
+            else done(result);
+        });
+    });
+}
@@ -0,0 +1,254 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <string>
+
+// COLMAP camera models as compile-time projection kernels. ImgFromCam maps
+// normalized camera coordinates (u, v) = (X/Z, Y/Z) to pixel coordinates with the
+// same parameter layout and distortion formulas as COLMAP.
+enum class CameraModelId {
+    Invalid = -1,
+    SimplePinhole = 0,
+    Pinhole,
+    SimpleRadial,
+    Radial,
+    OpenCV,
+    OpenCVFisheye,
+    FullOpenCV,
+    FOV,
+    SimpleRadialFisheye,
+    RadialFisheye,
+    ThinPrismFisheye
+};
+
+inline CameraModelId CameraModelFromName(const std::string& name)
+{
+    if (name == "SIMPLE_PINHOLE") return CameraModelId::SimplePinhole;
+    if (name == "PINHOLE") return CameraModelId::Pinhole;
+    if (name == "SIMPLE_RADIAL") return CameraModelId::SimpleRadial;
+    if (name == "RADIAL") return CameraModelId::Radial;
+    if (name == "OPENCV") return CameraModelId::OpenCV;
+    if (name == "OPENCV_FISHEYE") return CameraModelId::OpenCVFisheye;
+    if (name == "FULL_OPENCV") return CameraModelId::FullOpenCV;
+    if (name == "FOV") return CameraModelId::FOV;
+    if (name == "SIMPLE_RADIAL_FISHEYE") return CameraModelId::SimpleRadialFisheye;
+    if (name == "RADIAL_FISHEYE") return CameraModelId::RadialFisheye;
+    if (name == "THIN_PRISM_FISHEYE") return CameraModelId::ThinPrismFisheye;
+    return CameraModelId::Invalid;
+}
+
+namespace camera_models {
+
+constexpr double kEpsilon = 1e-12;
+
+// Equidistant fisheye mapping shared by the fisheye models: (u, v) scaled to theta / r
+inline void FisheyeTheta(double& u, double& v)
+{
+    double r = std::sqrt(u * u + v * v);
+    double scale = r > kEpsilon ? std::atan(r) / r : 1.0;
+    u *= scale;
+    v *= scale;
+}
+
+}
+
+struct SimplePinholeModel {
+    static constexpr int kNumParams = 3; // f, cx, cy
+    static void ImgFromCam(const double* p, double u, double v, double* x, double* y)
+    {
+        *x = p[0] * u + p[1];
+        *y = p[0] * v + p[2];
+    }
+};
+
+struct PinholeModel {
+    static constexpr int kNumParams = 4; // fx, fy, cx, cy
+    static void ImgFromCam(const double* p, double u, double v, double* x, double* y)
+    {
+        *x = p[0] * u + p[2];
+        *y = p[1] * v + p[3];
+    }
+};
+
+struct SimpleRadialModel {
+    static constexpr int kNumParams = 4; // f, cx, cy, k
+    static void ImgFromCam(const double* p, double u, double v, double* x, double* y)
+    {
+        double radial = 1 + p[3] * (u * u + v * v);
+        *x = p[0] * u * radial + p[1];
+        *y = p[0] * v * radial + p[2];
+    }
+};
+
+struct RadialModel {
+    static constexpr int kNumParams = 5; // f, cx, cy, k1, k2
+    static void ImgFromCam(const double* p, double u, double v, double* x, double* y)
+    {
+        double r2 = u * u + v * v;
+        double radial = 1 + p[3] * r2 + p[4] * r2 * r2;
+        *x = p[0] * u * radial + p[1];
+        *y = p[0] * v * radial + p[2];
+    }
+};
+
+struct OpenCVModel {
+    static constexpr int kNumParams = 8; // fx, fy, cx, cy, k1, k2, p1, p2
+    static void ImgFromCam(const double* p, double u, double v, double* x, double* y)
+    {
+        double u2 = u * u, v2 = v * v, uv = u * v, r2 = u2 + v2;
+        double radial = p[4] * r2 + p[5] * r2 * r2;
+        double du = u * radial + 2 * p[6] * uv + p[7] * (r2 + 2 * u2);
+        double dv = v * radial + 2 * p[7] * uv + p[6] * (r2 + 2 * v2);
+        *x = p[0] * (u + du) + p[2];
+        *y = p[1] * (v + dv) + p[3];
+    }
+};
+
+struct OpenCVFisheyeModel {
+    static constexpr int kNumParams = 8; // fx, fy, cx, cy, k1, k2, k3, k4
+    static void ImgFromCam(const double* p, double u, double v, double* x, double* y)
+    {
+        camera_models::FisheyeTheta(u, v);
+        double t2 = u * u + v * v, t4 = t2 * t2;
+        double radial = 1 + p[4] * t2 + p[5] * t4 + p[6] * t4 * t2 + p[7] * t4 * t4;
+        *x = p[0] * u * radial + p[2];
+        *y = p[1] * v * radial + p[3];
+    }
+};
+
+struct FullOpenCVModel {
+    static constexpr int kNumParams = 12; // fx, fy, cx, cy, k1, k2, p1, p2, k3, k4, k5, k6
+    static void ImgFromCam(const double* p, double u, double v, double* x, double* y)
+    {
+        double u2 = u * u, v2 = v * v, uv = u * v, r2 = u2 + v2, r4 = r2 * r2, r6 = r4 * r2;
+        double radial = (1 + p[4] * r2 + p[5] * r4 + p[8] * r6) / (1 + p[9] * r2 + p[10] * r4 + p[11] * r6);
+        double du = u * radial + 2 * p[6] * uv + p[7] * (r2 + 2 * u2);
+        double dv = v * radial + 2 * p[7] * uv + p[6] * (r2 + 2 * v2);
+        *x = p[0] * du + p[2];
+        *y = p[1] * dv + p[3];
+    }
+};
+
+struct FOVModel {
+    static constexpr int kNumParams = 5; // fx, fy, cx, cy, omega
+    static void ImgFromCam(const double* p, double u, double v, double* x, double* y)
+    {
+        const double omega = p[4], eps = 1e-4;
+        double r2 = u * u + v * v, omega2 = omega * omega, factor;
+        if (omega2 < eps) {
+            factor = (omega2 * r2) / 3 - omega2 / 12 + 1;
+        }
+        else if (r2 < eps) {
+            double tanHalf = std::tan(omega / 2);
+            factor = (-2 * tanHalf * (4 * r2 * tanHalf * tanHalf - 3)) / (3 * omega);
+        }
+        else {
+            double r = std::sqrt(r2);
+            factor = std::atan(r * 2 * std::tan(omega / 2)) / (r * omega);
+        }
+        *x = p[0] * u * factor + p[2];
+        *y = p[1] * v * factor + p[3];
+    }
+};
+
+struct SimpleRadialFisheyeModel {
+    static constexpr int kNumParams = 4; // f, cx, cy, k
+    static void ImgFromCam(const double* p, double u, double v, double* x, double* y)
+    {
+        camera_models::FisheyeTheta(u, v);
+        double radial = 1 + p[3] * (u * u + v * v);
+        *x = p[0] * u * radial + p[1];
+        *y = p[0] * v * radial + p[2];
+    }
+};
+
+struct RadialFisheyeModel {
+    static constexpr int kNumParams = 5; // f, cx, cy, k1, k2
+    static void ImgFromCam(const double* p, double u, double v, double* x, double* y)
+    {
+        camera_models::FisheyeTheta(u, v);
+        double t2 = u * u + v * v;
+        double radial = 1 + p[3] * t2 + p[4] * t2 * t2;
+        *x = p[0] * u * radial + p[1];
+        *y = p[0] * v * radial + p[2];
+    }
+};
+
+struct ThinPrismFisheyeModel {
+    static constexpr int kNumParams = 12; // fx, fy, cx, cy, k1, k2, p1, p2, k3, k4, sx1, sy1
+    static void ImgFromCam(const double* p, double u, double v, double* x, double* y)
+    {
+        camera_models::FisheyeTheta(u, v);
+        double u2 = u * u, v2 = v * v, uv = u * v, r2 = u2 + v2, r4 = r2 * r2;
+        double radial = p[4] * r2 + p[5] * r4 + p[8] * r4 * r2 + p[9] * r4 * r4;
+        double du = u * radial + 2 * p[6] * uv + p[7] * (r2 + 2 * u2) + p[10] * r2;
+        double dv = v * radial + 2 * p[7] * uv + p[6] * (r2 + 2 * v2) + p[11] * r2;
+        *x = p[0] * (u + du) + p[2];
+        *y = p[1] * (v + dv) + p[3];
+    }
+};
+
+// Call fn(Model()) with the kernel type of a model, resolved once for a whole batch.
+// Returns false for unknown models.
+template <typename Fn>
+bool DispatchCameraModel(CameraModelId id, Fn&& fn)
+{
+    switch (id) {
+    case CameraModelId::SimplePinhole: fn(SimplePinholeModel()); return true;
+    case CameraModelId::Pinhole: fn(PinholeModel()); return true;
+    case CameraModelId::SimpleRadial: fn(SimpleRadialModel()); return true;
+    case CameraModelId::Radial: fn(RadialModel()); return true;
+    case CameraModelId::OpenCV: fn(OpenCVModel()); return true;
+    case CameraModelId::OpenCVFisheye: fn(OpenCVFisheyeModel()); return true;
+    case CameraModelId::FullOpenCV: fn(FullOpenCVModel()); return true;
+    case CameraModelId::FOV: fn(FOVModel()); return true;
+    case CameraModelId::SimpleRadialFisheye: fn(SimpleRadialFisheyeModel()); return true;
+    case CameraModelId::RadialFisheye: fn(RadialFisheyeModel()); return true;
+    case CameraModelId::ThinPrismFisheye: fn(ThinPrismFisheyeModel()); return true;
+    default: return false;
+    }
+}
+
+// Parameters the kernel of a model reads, 0 for unknown models
+inline int CameraModelNumParams(CameraModelId id)
+{
+    int count = 0;
+    DispatchCameraModel(id, [&](auto kernel) { count = decltype(kernel)::kNumParams; });
+    return count;
+}
+
+// Models with a single focal length store it once, the others as fx, fy
+inline bool PinholeIntrinsics(CameraModelId id, const double* p, double& fx, double& fy, double& cx, double& cy)
+{
+    switch (id) {
+    case CameraModelId::SimplePinhole:
+    case CameraModelId::SimpleRadial:
+    case CameraModelId::Radial:
+    case CameraModelId::SimpleRadialFisheye:
+    case CameraModelId::RadialFisheye:
+        fx = fy = p[0];
+        cx = p[1];
+        cy = p[2];
+        return true;
+    case CameraModelId::Invalid:
+        return false;
+    default:
+        fx = p[0];
+        fy = p[1];
+        cx = p[2];
+        cy = p[3];
+        return true;
+    }
+}
+
+// Project n camera-frame points given as separate X, Y, Z arrays. The per-point
+// path is a straight loop over contiguous arrays so it can be vectorized.
+template <typename Model>
+void ProjectBatch(const double* params, const double* X, const double* Y, const double* Z, size_t n,
+                  double* x, double* y)
+{
+    for (size_t i = 0; i < n; ++i) {
+        double invZ = 1.0 / Z[i];
+        Model::ImgFromCam(params, X[i] * invZ, Y[i] * invZ, x + i, y + i);
+    }
+}
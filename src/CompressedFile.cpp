@@ -0,0 +1,599 @@
+#include "CompressedFile.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <vector>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+static bool EndsWith(const std::string& s, const char* suffix)
+{
+	size_t n = std::strlen(suffix);
+	return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+Compression CompressionFromPath(const std::string& path)
+{
+	if (EndsWith(path, ".gz")) return Compression::Gzip;
+	if (EndsWith(path, ".zst")) return Compression::Zstd;
+	return Compression::None;
+}
+
+bool CompressionSupported(Compression compression)
+{
+	switch (compression) {
+	case Compression::None: return true;
+#ifdef HAVE_ZLIB
+	case Compression::Gzip: return true;
+#endif
+#ifdef HAVE_ZSTD
+	case Compression::Zstd: return true;
+#endif
+	default: return false;
+	}
+}
+
+const char* CompressionExtension(Compression compression)
+{
+	switch (compression) {
+	case Compression::Gzip: return ".gz";
+	case Compression::Zstd: return ".zst";
+	default: return "";
+	}
+}
+
+static bool FileExists(const std::string& path)
+{
+	FILE* f = std::fopen(path.c_str(), "rb");
+	if (!f) return false;
+	std::fclose(f);
+	return true;
+}
+
+std::string FindModelFile(const std::string& path)
+{
+	for (const char* ext : { "", ".gz", ".zst" }) {
+		if (FileExists(path + ext)) return path + ext;
+	}
+	return std::string();
+}
+
+// Output is grown in steps of at least this much while decompressing
+static const size_t kReadChunk = 4 << 20;
+
+// Output is sized from the size the file header or trailer states, plus a byte so
+// reaching the end needs no growth. Growing by doubling, which briefly holds three
+// times the text, is left for files that state none or a wrong one.
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+static void ReserveOutput(std::string& out, unsigned long long statedSize)
+{
+	if (statedSize > 0 && statedSize < std::numeric_limits<size_t>::max() - kReadChunk)
+		out.resize(static_cast<size_t>(statedSize) + 1);
+}
+#endif
+
+#ifdef HAVE_ZLIB
+// Uncompressed size modulo 2^32 from the trailer of the last gzip member
+static unsigned long long GzipStatedSize(const std::string& path)
+{
+	FILE* f = std::fopen(path.c_str(), "rb");
+	if (!f) return 0;
+	unsigned char trailer[4] = {};
+	bool ok = std::fseek(f, -4, SEEK_END) == 0 && std::fread(trailer, 1, 4, f) == 4;
+	std::fclose(f);
+	if (!ok) return 0;
+	return trailer[0] | trailer[1] << 8 | trailer[2] << 16 | static_cast<unsigned long long>(trailer[3]) << 24;
+}
+#endif
+
+static bool ReadGzip(const std::string& path, std::string& out)
+{
+#ifdef HAVE_ZLIB
+	ReserveOutput(out, GzipStatedSize(path));
+	gzFile gz = gzopen(path.c_str(), "rb");
+	if (!gz) return false;
+	gzbuffer(gz, 1 << 20);
+	size_t size = 0;
+	int n;
+	do {
+		if (out.size() < size + 1) out.resize(std::max(out.size() * 2, size + kReadChunk));
+		n = gzread(gz, &out[size], static_cast<unsigned>(std::min<size_t>(out.size() - size, 1u << 30)));
+		if (n > 0) size += n;
+	} while (n > 0);
+	out.resize(size);
+	bool ok = gzclose(gz) == Z_OK && n == 0;
+	return ok;
+#else
+	(void)path;
+	(void)out;
+	return false;
+#endif
+}
+
+static bool ReadZstd(const std::string& path, std::string& out)
+{
+#ifdef HAVE_ZSTD
+	FILE* f = std::fopen(path.c_str(), "rb");
+	if (!f) return false;
+	std::vector<char> in(ZSTD_DStreamInSize());
+	{
+		// Content size of the first frame, stated when the compressor knew it up front
+		size_t got = std::fread(in.data(), 1, in.size(), f);
+		unsigned long long stated = ZSTD_getFrameContentSize(in.data(), got);
+		if (stated != ZSTD_CONTENTSIZE_UNKNOWN && stated != ZSTD_CONTENTSIZE_ERROR) ReserveOutput(out, stated);
+		std::rewind(f);
+	}
+	ZSTD_DCtx* dctx = ZSTD_createDCtx();
+	const size_t outStep = std::max(kReadChunk, ZSTD_DStreamOutSize());
+	size_t size = 0, ret = 0, got;
+	bool ok = true;
+	while (ok && (got = std::fread(in.data(), 1, in.size(), f)) > 0) {
+		ZSTD_inBuffer input = { in.data(), got, 0 };
+		ZSTD_outBuffer output;
+		// Keep going while input is left or the decoder filled the output and may hold more
+		do {
+			if (out.size() == size) out.resize(std::max(out.size() * 2, size + outStep));
+			output = { &out[size], out.size() - size, 0 };
+			ret = ZSTD_decompressStream(dctx, &output, &input);
+			if (ZSTD_isError(ret)) {
+				ok = false;
+				break;
+			}
+			size += output.pos;
+		} while (input.pos < input.size || output.pos == output.size);
+	}
+	// A non-zero hint at the end means the last frame was cut short
+	ok = ok && ret == 0 && !std::ferror(f);
+	ZSTD_freeDCtx(dctx);
+	std::fclose(f);
+	out.resize(size);
+	return ok;
+#else
+	(void)path;
+	(void)out;
+	return false;
+#endif
+}
+
+bool TextFileReader::Open(const std::string& path)
+{
+	Close();
+	unsigned char magic[4] = {};
+	size_t got;
+	{
+		FILE* f = std::fopen(path.c_str(), "rb");
+		if (!f) return false;
+		got = std::fread(magic, 1, sizeof(magic), f);
+		std::fclose(f);
+	}
+	if (got >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+		if (ReadGzip(path, buffer_)) return true;
+	}
+	else if (got >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+		if (ReadZstd(path, buffer_)) return true;
+	}
+	else {
+		// Empty files cannot be mapped but still open fine
+		return mapped_.Open(path) || got == 0;
+	}
+	std::string().swap(buffer_);
+	return false;
+}
+
+void TextFileReader::Close()
+{
+	mapped_.Close();
+	std::string().swap(buffer_);
+}
+
+// Origin of the pipeline thread's text, one per compression
+class TextStreamReader::Source {
+public:
+	virtual ~Source() = default;
+	// Up to size bytes, 0 at the end of the file, -1 on failure
+	virtual long long Read(char* data, size_t size) = 0;
+};
+
+namespace {
+
+class PlainSource : public TextStreamReader::Source {
+public:
+	explicit PlainSource(const std::string& path) : file_(std::fopen(path.c_str(), "rb")) {}
+	~PlainSource() override
+	{
+		if (file_) std::fclose(file_);
+	}
+	bool IsOpen() const { return file_ != nullptr; }
+	long long Read(char* data, size_t size) override
+	{
+		size_t got = std::fread(data, 1, size, file_);
+		return got == 0 && std::ferror(file_) ? -1 : static_cast<long long>(got);
+	}
+
+private:
+	FILE* file_;
+};
+
+#ifdef HAVE_ZLIB
+class GzipSource : public TextStreamReader::Source {
+public:
+	explicit GzipSource(const std::string& path) : gz_(gzopen(path.c_str(), "rb"))
+	{
+		if (gz_) gzbuffer(gz_, 1 << 20);
+	}
+	~GzipSource() override
+	{
+		if (gz_) gzclose(gz_);
+	}
+	bool IsOpen() const { return gz_ != nullptr; }
+	long long Read(char* data, size_t size) override
+	{
+		return gzread(gz_, data, static_cast<unsigned>(std::min<size_t>(size, 1u << 30)));
+	}
+
+private:
+	gzFile gz_;
+};
+#endif
+
+#ifdef HAVE_ZSTD
+class ZstdSource : public TextStreamReader::Source {
+public:
+	explicit ZstdSource(const std::string& path) : file_(std::fopen(path.c_str(), "rb")), dctx_(ZSTD_createDCtx()),
+		in_(ZSTD_DStreamInSize())
+	{
+	}
+	~ZstdSource() override
+	{
+		ZSTD_freeDCtx(dctx_);
+		if (file_) std::fclose(file_);
+	}
+	bool IsOpen() const { return file_ != nullptr; }
+	long long Read(char* data, size_t size) override
+	{
+		ZSTD_outBuffer output = { data, size, 0 };
+		while (output.pos == 0) {
+			if (input_.pos == input_.size) {
+				size_t got = std::fread(in_.data(), 1, in_.size(), file_);
+				// A non-zero hint at the end means the last frame was cut short
+				if (got == 0) return std::ferror(file_) || ret_ != 0 ? -1 : 0;
+				input_ = { in_.data(), got, 0 };
+			}
+			ret_ = ZSTD_decompressStream(dctx_, &output, &input_);
+			if (ZSTD_isError(ret_)) return -1;
+		}
+		return static_cast<long long>(output.pos);
+	}
+
+private:
+	FILE* file_;
+	ZSTD_DCtx* dctx_;
+	std::vector<char> in_;
+	ZSTD_inBuffer input_ = { nullptr, 0, 0 };
+	size_t ret_ = 0;
+};
+#endif
+
+}
+
+TextStreamReader::TextStreamReader() = default;
+
+TextStreamReader::~TextStreamReader()
+{
+	Close();
+}
+
+bool TextStreamReader::Open(const std::string& path)
+{
+	Close();
+	unsigned char magic[4] = {};
+	size_t got;
+	{
+		FILE* f = std::fopen(path.c_str(), "rb");
+		if (!f) return false;
+		got = std::fread(magic, 1, sizeof(magic), f);
+		std::fclose(f);
+	}
+	if (got >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+#ifdef HAVE_ZLIB
+		std::unique_ptr<GzipSource> source(new GzipSource(path));
+		if (source->IsOpen()) source_ = std::move(source);
+#endif
+	}
+	else if (got >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+#ifdef HAVE_ZSTD
+		std::unique_ptr<ZstdSource> source(new ZstdSource(path));
+		if (source->IsOpen()) source_ = std::move(source);
+#endif
+	}
+	else {
+		std::unique_ptr<PlainSource> source(new PlainSource(path));
+		if (source->IsOpen()) source_ = std::move(source);
+	}
+	if (!source_) return false;
+	queue_.clear();
+	done_ = false;
+	stopping_ = false;
+	failed_ = false;
+	thread_ = std::thread(&TextStreamReader::Run, this);
+	return true;
+}
+
+bool TextStreamReader::Next(std::string& chunk)
+{
+	if (!source_) return false;
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		cv_.wait(lock, [&] { return !queue_.empty() || done_; });
+		if (queue_.empty()) return false;
+		chunk = std::move(queue_.front());
+		queue_.pop_front();
+	}
+	cv_.notify_all();
+	return true;
+}
+
+bool TextStreamReader::Close()
+{
+	if (!source_) return false;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	cv_.notify_all();
+	thread_.join();
+	source_.reset();
+	queue_.clear();
+	return !failed_;
+}
+
+void TextStreamReader::Run()
+{
+	std::string carry; // start of a line the previous chunk ended in
+	bool end = false, failed = false;
+	while (!end) {
+		std::string chunk;
+		chunk.swap(carry);
+		size_t size = chunk.size();
+		chunk.resize(size + kChunkSize);
+		while (size < chunk.size()) {
+			long long got = source_->Read(&chunk[size], chunk.size() - size);
+			if (got <= 0) {
+				end = true;
+				failed = got < 0;
+				break;
+			}
+			size += static_cast<size_t>(got);
+		}
+		chunk.resize(size);
+		if (!end) {
+			// The partial last line goes with the next chunk; a chunk without any
+			// line end is one long line that keeps growing
+			size_t nl = chunk.rfind('\n');
+			if (nl == std::string::npos) {
+				carry.swap(chunk);
+				continue;
+			}
+			carry.assign(chunk, nl + 1, std::string::npos);
+			chunk.resize(nl + 1);
+		}
+		std::unique_lock<std::mutex> lock(mutex_);
+		cv_.wait(lock, [&] { return queue_.size() < kMaxQueued || stopping_; });
+		if (stopping_) break;
+		if (!chunk.empty()) queue_.push_back(std::move(chunk));
+		lock.unlock();
+		cv_.notify_all();
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		done_ = true;
+		failed_ = failed;
+	}
+	cv_.notify_all();
+}
+
+// Destination of the pipeline thread, one per compression
+class TextFileWriter::Sink {
+public:
+	virtual ~Sink() = default;
+	virtual bool Write(const char* data, size_t size) = 0;
+	virtual bool Finish() = 0;
+};
+
+namespace {
+
+class PlainSink : public TextFileWriter::Sink {
+public:
+	explicit PlainSink(const std::string& path) : out_(path) {}
+	bool IsOpen() const { return out_.is_open(); }
+	bool Write(const char* data, size_t size) override { return static_cast<bool>(out_.write(data, size)); }
+	bool Finish() override
+	{
+		out_.close();
+		return !out_.fail();
+	}
+
+private:
+	std::ofstream out_;
+};
+
+#ifdef HAVE_ZLIB
+class GzipSink : public TextFileWriter::Sink {
+public:
+	explicit GzipSink(const std::string& path) : gz_(gzopen(path.c_str(), "wb6"))
+	{
+		if (gz_) gzbuffer(gz_, 1 << 20);
+	}
+	~GzipSink() override
+	{
+		if (gz_) gzclose(gz_);
+	}
+	bool IsOpen() const { return gz_ != nullptr; }
+	bool Write(const char* data, size_t size) override
+	{
+		while (size > 0) {
+			unsigned n = static_cast<unsigned>(std::min<size_t>(size, 1u << 30));
+			if (gzwrite(gz_, data, n) != static_cast<int>(n)) return false;
+			data += n;
+			size -= n;
+		}
+		return true;
+	}
+	bool Finish() override
+	{
+		int result = gzclose(gz_);
+		gz_ = nullptr;
+		return result == Z_OK;
+	}
+
+private:
+	gzFile gz_;
+};
+#endif
+
+#ifdef HAVE_ZSTD
+class ZstdSink : public TextFileWriter::Sink {
+public:
+	explicit ZstdSink(const std::string& path) : file_(std::fopen(path.c_str(), "wb")), cctx_(ZSTD_createCCtx()),
+		out_(ZSTD_CStreamOutSize())
+	{
+		ZSTD_CCtx_setParameter(cctx_, ZSTD_c_compressionLevel, 3);
+	}
+	~ZstdSink() override
+	{
+		ZSTD_freeCCtx(cctx_);
+		if (file_) std::fclose(file_);
+	}
+	bool IsOpen() const { return file_ != nullptr; }
+	bool Write(const char* data, size_t size) override
+	{
+		ZSTD_inBuffer input = { data, size, 0 };
+		while (input.pos < input.size) {
+			if (!Compress(input, ZSTD_e_continue)) return false;
+		}
+		return true;
+	}
+	bool Finish() override
+	{
+		ZSTD_inBuffer input = { nullptr, 0, 0 };
+		size_t remaining;
+		do {
+			remaining = Compress(input, ZSTD_e_end);
+		} while (remaining > 0 && remaining != kError);
+		bool ok = remaining == 0 && std::fclose(file_) == 0;
+		file_ = nullptr;
+		return ok;
+	}
+
+private:
+	static constexpr size_t kError = static_cast<size_t>(-1);
+
+	// One compression step, writing what it produced. Returns what ZSTD still has
+	// to flush, kError on failure.
+	size_t Compress(ZSTD_inBuffer& input, ZSTD_EndDirective mode)
+	{
+		ZSTD_outBuffer output = { out_.data(), out_.size(), 0 };
+		size_t remaining = ZSTD_compressStream2(cctx_, &output, &input, mode);
+		if (ZSTD_isError(remaining)) return kError;
+		if (std::fwrite(out_.data(), 1, output.pos, file_) != output.pos) return kError;
+		return remaining;
+	}
+
+	FILE* file_;
+	ZSTD_CCtx* cctx_;
+	std::vector<char> out_;
+};
+#endif
+
+}
+
+TextFileWriter::TextFileWriter() = default;
+
+TextFileWriter::~TextFileWriter()
+{
+	Close();
+}
+
+bool TextFileWriter::Open(const std::string& path)
+{
+	Close();
+	switch (CompressionFromPath(path)) {
+	case Compression::None: {
+		std::unique_ptr<PlainSink> sink(new PlainSink(path));
+		if (sink->IsOpen()) sink_ = std::move(sink);
+		break;
+	}
+#ifdef HAVE_ZLIB
+	case Compression::Gzip: {
+		std::unique_ptr<GzipSink> sink(new GzipSink(path));
+		if (sink->IsOpen()) sink_ = std::move(sink);
+		break;
+	}
+#endif
+#ifdef HAVE_ZSTD
+	case Compression::Zstd: {
+		std::unique_ptr<ZstdSink> sink(new ZstdSink(path));
+		if (sink->IsOpen()) sink_ = std::move(sink);
+		break;
+	}
+#endif
+	default:
+		break;
+	}
+	if (!sink_) return false;
+	closing_ = false;
+	failed_ = false;
+	thread_ = std::thread(&TextFileWriter::Run, this);
+	return true;
+}
+
+void TextFileWriter::Write(std::string block)
+{
+	if (!sink_) return;
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		cv_.wait(lock, [&] { return queue_.size() < kMaxQueued; });
+		queue_.push_back(std::move(block));
+	}
+	cv_.notify_all();
+}
+
+bool TextFileWriter::Close()
+{
+	if (!sink_) return false;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		closing_ = true;
+	}
+	cv_.notify_all();
+	thread_.join();
+	sink_.reset();
+	return !failed_;
+}
+
+void TextFileWriter::Run()
+{
+	bool ok = true;
+	for (;;) {
+		std::string block;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			cv_.wait(lock, [&] { return !queue_.empty() || closing_; });
+			if (queue_.empty()) break;
+			block = std::move(queue_.front());
+			queue_.pop_front();
+		}
+		cv_.notify_all(); // room for the next block
+		// Keep draining after a failure so Write never blocks for good
+		if (ok) ok = sink_->Write(block.data(), block.size());
+	}
+	ok = sink_->Finish() && ok;
+	std::lock_guard<std::mutex> lock(mutex_);
+	failed_ = !ok;
+}
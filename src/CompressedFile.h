@@ -0,0 +1,111 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "MappedFile.h"
+
+enum class Compression { None, Gzip, Zstd };
+
+// Compression implied by a file name ending in .gz or .zst
+Compression CompressionFromPath(const std::string& path);
+// Whether this build was linked against the library for the compression
+bool CompressionSupported(Compression compression);
+// Extension appended for a compression, empty for None
+const char* CompressionExtension(Compression compression);
+// path itself if it exists, else path + ".gz" or path + ".zst" if one of those
+// does, else an empty string
+std::string FindModelFile(const std::string& path);
+
+// Whole contents of a text file. Plain files are mapped; gzip and zstd files,
+// told apart by their magic bytes, are decompressed into memory chunk by chunk.
+class TextFileReader {
+public:
+    TextFileReader() = default;
+    TextFileReader(const TextFileReader&) = delete;
+    TextFileReader& operator=(const TextFileReader&) = delete;
+
+    // An empty plain file opens fine with Size() 0
+    bool Open(const std::string& path);
+    void Close();
+
+    const char* Data() const { return mapped_.IsOpen() ? mapped_.Data() : buffer_.data(); }
+    size_t Size() const { return mapped_.IsOpen() ? mapped_.Size() : buffer_.size(); }
+
+private:
+    MappedFile mapped_;
+    std::string buffer_;
+};
+
+// Text file read front to back in chunks that end at line ends, for files too large
+// to hold. A pipeline thread reads, and for gzip and zstd files decompresses, up to
+// kMaxQueued chunks ahead while the caller works on the current one.
+class TextStreamReader {
+public:
+    static constexpr size_t kChunkSize = 1 << 20;
+
+    TextStreamReader();
+    ~TextStreamReader();
+    TextStreamReader(const TextStreamReader&) = delete;
+    TextStreamReader& operator=(const TextStreamReader&) = delete;
+
+    bool Open(const std::string& path);
+    // Next chunk of about kChunkSize bytes of whole lines; the last one may lack its
+    // final newline. False once the file is used up or a read failed.
+    bool Next(std::string& chunk);
+    // Stop the pipeline thread, false if any read failed
+    bool Close();
+
+    // Where the pipeline thread gets the text, one kind per compression
+    class Source;
+
+private:
+    static constexpr size_t kMaxQueued = 8;
+
+    void Run();
+
+    std::unique_ptr<Source> source_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::string> queue_;
+    bool done_ = false; // the last chunk is queued
+    bool stopping_ = false;
+    bool failed_ = false;
+};
+
+// Text output handed to a pipeline thread, which compresses it for .gz and .zst
+// paths and writes it while the caller formats the next blocks. Plain paths are
+// written in text mode like std::ofstream.
+class TextFileWriter {
+public:
+    TextFileWriter();
+    ~TextFileWriter();
+    TextFileWriter(const TextFileWriter&) = delete;
+    TextFileWriter& operator=(const TextFileWriter&) = delete;
+
+    bool Open(const std::string& path);
+    // Queue a block, waiting while the pipeline is kMaxQueued blocks behind
+    void Write(std::string block);
+    // Flush and finish the file, false if any write failed
+    bool Close();
+
+    // Where the pipeline thread puts the text, one kind per compression
+    class Sink;
+
+private:
+    static constexpr size_t kMaxQueued = 16;
+
+    void Run();
+
+    std::unique_ptr<Sink> sink_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::string> queue_;
+    bool closing_ = false;
+    bool failed_ = false;
+};
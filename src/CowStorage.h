@@ -0,0 +1,247 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <vector>
+#include "Parallel.h"
+
+// Whether p is the only owner of its object, so it may be written in place. A count
+// of one cannot grow behind the caller's back, only the owner could copy it. The
+// fence orders the reads of former owners, released as they let go, before the
+// caller's writes.
+template <typename T>
+bool SoleOwner(const std::shared_ptr<T>& p)
+{
+    if (p.use_count() != 1) return false;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return true;
+}
+
+// Value shared between copies until one of them writes to it. Copying is O(1); the
+// first write through a shared copy clones the value, so the other holders, possibly
+// reading it on other threads, keep what they had.
+template <typename T>
+class Cow {
+public:
+    Cow() : value_(std::make_shared<T>()) {}
+
+    const T& operator*() const { return *value_; }
+    const T* operator->() const { return value_.get(); }
+    T& Mutable()
+    {
+        if (!SoleOwner(value_)) value_ = std::make_shared<T>(*value_);
+        return *value_;
+    }
+    // For a value about to be rebuilt from scratch: written in place when unshared,
+    // else a fresh default value instead of a clone
+    T& Overwrite()
+    {
+        if (!SoleOwner(value_)) value_ = std::make_shared<T>();
+        return *value_;
+    }
+
+private:
+    std::shared_ptr<T> value_;
+};
+
+// Elements ordered by their int id member in chunks of at most kChunkSize, which
+// copies of the map share. Edits clone only the shared chunks they change, plus the
+// chunk table while it is shared. Element addresses are stable until their chunk
+// is changed or cloned. Chunks are never empty.
+template <typename T>
+class ChunkedIdMap {
+    using Table = std::vector<std::shared_ptr<std::vector<T>>>;
+
+public:
+    static constexpr size_t kChunkSize = 4096;
+    using Chunk = std::vector<T>;
+
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const T*;
+        using reference = const T&;
+
+        const_iterator(const Table* table, size_t chunk) : table_(table), chunk_(chunk) {}
+        reference operator*() const { return (*(*table_)[chunk_])[pos_]; }
+        pointer operator->() const { return &**this; }
+        const_iterator& operator++()
+        {
+            if (++pos_ == (*table_)[chunk_]->size()) {
+                ++chunk_;
+                pos_ = 0;
+            }
+            return *this;
+        }
+        bool operator==(const const_iterator& other) const { return chunk_ == other.chunk_ && pos_ == other.pos_; }
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+    private:
+        const Table* table_;
+        size_t chunk_;
+        size_t pos_ = 0;
+    };
+
+    const_iterator begin() const { return const_iterator(chunks_.get(), 0); }
+    const_iterator end() const { return const_iterator(chunks_.get(), chunks_->size()); }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const T& back() const { return chunks_->back()->back(); }
+
+    size_t NumChunks() const { return chunks_->size(); }
+    const Chunk& GetChunk(size_t c) const { return *(*chunks_)[c]; }
+    // Chunk c for writing. Ids must keep their order.
+    Chunk& MutableChunk(size_t c)
+    {
+        std::shared_ptr<Chunk>& chunk = MutableTable()[c];
+        if (!SoleOwner(chunk)) chunk = std::make_shared<Chunk>(*chunk);
+        return *chunk;
+    }
+    // Clone every shared chunk, in parallel, before writing to all elements
+    void MakeUnique()
+    {
+        Table& table = MutableTable();
+        ParallelFor(table.size(), [&](size_t begin, size_t end) {
+            for (size_t c = begin; c < end; ++c)
+                if (!SoleOwner(table[c])) table[c] = std::make_shared<Chunk>(*table[c]);
+        }, 1);
+    }
+
+    // Add elements, an element replacing the one with its id. Elements past the
+    // highest id are appended after the last chunk; anything else is merged in,
+    // rebuilding every chunk.
+    void Insert(std::vector<T> values)
+    {
+        if (values.empty()) return;
+        auto byId = [](const T& a, const T& b) { return a.id < b.id; };
+        if (!std::is_sorted(values.begin(), values.end(), byId)) std::stable_sort(values.begin(), values.end(), byId);
+        // Of elements with the same id the last one counts
+        size_t out = 0;
+        for (size_t i = 0; i < values.size(); ++i) {
+            if (i + 1 < values.size() && values[i + 1].id == values[i].id) continue;
+            if (out != i) values[out] = std::move(values[i]);
+            ++out;
+        }
+        values.erase(values.begin() + out, values.end());
+
+        Table& table = MutableTable();
+        if (!empty() && values.front().id <= back().id) {
+            std::vector<T> merged;
+            merged.reserve(size_ + values.size());
+            auto next = values.begin();
+            for (std::shared_ptr<Chunk>& chunk : table) {
+                bool sole = SoleOwner(chunk);
+                for (T& element : *chunk) {
+                    while (next != values.end() && next->id < element.id) merged.push_back(std::move(*next++));
+                    if (next != values.end() && next->id == element.id) continue;
+                    if (sole) merged.push_back(std::move(element));
+                    else merged.push_back(element);
+                }
+            }
+            merged.insert(merged.end(), std::make_move_iterator(next), std::make_move_iterator(values.end()));
+            table.clear();
+            size_ = 0;
+            values.swap(merged);
+        }
+        size_t i = 0;
+        if (!table.empty() && table.back()->size() < kChunkSize) {
+            Chunk& last = MutableChunk(table.size() - 1);
+            size_t n = std::min(kChunkSize - last.size(), values.size());
+            last.insert(last.end(), std::make_move_iterator(values.begin()), std::make_move_iterator(values.begin() + n));
+            i = n;
+        }
+        for (; i < values.size(); i += kChunkSize) {
+            size_t n = std::min(kChunkSize, values.size() - i);
+            auto chunk = std::make_shared<Chunk>();
+            chunk->reserve(n);
+            chunk->insert(chunk->end(), std::make_move_iterator(values.begin() + i),
+                std::make_move_iterator(values.begin() + i + n));
+            table.push_back(std::move(chunk));
+        }
+        size_ += values.size();
+    }
+
+    // Remove the elements with the given ids, ascending; absent ids are skipped
+    void Erase(const std::vector<int>& ids)
+    {
+        EraseWhere([&](const T& element) { return std::binary_search(ids.begin(), ids.end(), element.id); },
+            &ids);
+    }
+
+    // Remove the elements pred holds for, which may be asked more than once about
+    // an element. Chunks keeping all of theirs stay shared.
+    template <typename Pred>
+    size_t EraseIf(Pred pred)
+    {
+        return EraseWhere(pred, nullptr);
+    }
+
+    // Call edit on the elements match holds for, cloning just their shared chunks
+    template <typename Match, typename Edit>
+    void EditIf(Match match, Edit edit)
+    {
+        for (size_t c = 0; c < chunks_->size(); ++c) {
+            const Chunk& chunk = *(*chunks_)[c];
+            if (std::none_of(chunk.begin(), chunk.end(), match)) continue;
+            for (T& element : MutableChunk(c))
+                if (match(element)) edit(element);
+        }
+    }
+
+    void Clear()
+    {
+        chunks_ = std::make_shared<Table>();
+        size_ = 0;
+    }
+
+private:
+    Table& MutableTable()
+    {
+        if (!SoleOwner(chunks_)) chunks_ = std::make_shared<Table>(*chunks_);
+        return *chunks_;
+    }
+
+    // With ids given, only the chunks whose range holds one of them are searched
+    template <typename Pred>
+    size_t EraseWhere(Pred pred, const std::vector<int>* ids)
+    {
+        size_t erased = 0;
+        bool emptied = false;
+        for (size_t c = 0; c < chunks_->size(); ++c) {
+            const Chunk& chunk = *(*chunks_)[c];
+            if (ids) {
+                auto first = std::lower_bound(ids->begin(), ids->end(), chunk.front().id);
+                if (first == ids->end() || *first > chunk.back().id) continue;
+            }
+            auto found = std::find_if(chunk.begin(), chunk.end(), pred);
+            if (found == chunk.end()) continue;
+            std::shared_ptr<Chunk>& slot = MutableTable()[c];
+            size_t before = slot->size();
+            if (SoleOwner(slot)) slot->erase(std::remove_if(slot->begin(), slot->end(), pred), slot->end());
+            else {
+                // Copy just the survivors instead of cloning and erasing
+                auto kept = std::make_shared<Chunk>();
+                kept->reserve(before);
+                for (const T& element : *slot)
+                    if (!pred(element)) kept->push_back(element);
+                slot = std::move(kept);
+            }
+            erased += before - slot->size();
+            emptied |= slot->empty();
+        }
+        if (emptied) {
+            Table& table = MutableTable();
+            table.erase(std::remove_if(table.begin(), table.end(),
+                [](const std::shared_ptr<Chunk>& chunk) { return chunk->empty(); }), table.end());
+        }
+        size_ -= erased;
+        return erased;
+    }
+
+    std::shared_ptr<Table> chunks_ = std::make_shared<Table>();
+    size_t size_ = 0;
+};
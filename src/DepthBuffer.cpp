@@ -0,0 +1,56 @@
+#include "DepthBuffer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include "Parallel.h"
+
+static uint32_t DepthBits(float depth)
+{
+	uint32_t bits;
+	std::memcpy(&bits, &depth, sizeof(bits));
+	return bits;
+}
+
+void DepthBuffer::Build(const std::vector<float>& xs, const std::vector<float>& ys, const std::vector<float>& depths,
+	int width, int height, int splatSize)
+{
+	width_ = std::max(0, width);
+	height_ = std::max(0, height);
+	size_t numPixels = static_cast<size_t>(width_) * height_;
+	depth_.reset(new std::atomic<uint32_t>[numPixels]);
+	const uint32_t far = DepthBits(std::numeric_limits<float>::infinity());
+	ParallelFor(numPixels, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) depth_[i].store(far, std::memory_order_relaxed);
+	}, 65536);
+
+	const int size = std::max(1, splatSize);
+	const float offset = (size - 1) * 0.5f;
+	ParallelFor(xs.size(), [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			float d = depths[i];
+			if (!(d > 0) || !std::isfinite(xs[i]) || !std::isfinite(ys[i])) continue;
+			float fx = std::floor(xs[i] - offset), fy = std::floor(ys[i] - offset);
+			if (fx >= width_ || fy >= height_ || fx + size <= 0 || fy + size <= 0) continue;
+			int x0 = std::max(0, static_cast<int>(fx)), x1 = std::min(width_, static_cast<int>(fx) + size);
+			int y0 = std::max(0, static_cast<int>(fy)), y1 = std::min(height_, static_cast<int>(fy) + size);
+			uint32_t bits = DepthBits(d);
+			for (int y = y0; y < y1; ++y) {
+				std::atomic<uint32_t>* row = &depth_[static_cast<size_t>(y) * width_];
+				for (int x = x0; x < x1; ++x) {
+					uint32_t current = row[x].load(std::memory_order_relaxed);
+					while (bits < current && !row[x].compare_exchange_weak(current, bits, std::memory_order_relaxed)) {}
+				}
+			}
+		}
+	}, 16384);
+}
+
+bool DepthBuffer::Visible(float x, float y, float depth, float tolerance) const
+{
+	if (!(depth > 0) || !(x >= 0 && x < width_) || !(y >= 0 && y < height_)) return false;
+	uint32_t bits = depth_[static_cast<size_t>(y) * width_ + static_cast<size_t>(x)].load(std::memory_order_relaxed);
+	float front;
+	std::memcpy(&front, &bits, sizeof(front));
+	return depth <= front * (1 + tolerance);
+}
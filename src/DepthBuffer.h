@@ -0,0 +1,25 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// CPU depth buffer of point splats at window resolution, used to tell points on the
+// visible surface from points hidden behind it. Window coordinates have y pointing
+// down; depths are positive view-space distances.
+class DepthBuffer {
+public:
+    // Splat every point with a positive depth as a splatSize x splatSize square
+    // centered at (xs[i], ys[i]), keeping the nearest depth per pixel
+    void Build(const std::vector<float>& xs, const std::vector<float>& ys, const std::vector<float>& depths,
+        int width, int height, int splatSize);
+    // Whether a point at (x, y) with the given depth lies within tolerance (a
+    // fraction of the front-most depth) of the front-most splat at its pixel
+    bool Visible(float x, float y, float depth, float tolerance) const;
+
+private:
+    int width_ = 0, height_ = 0;
+    // Depths are non-negative floats, so their bit patterns order like the values
+    // and atomic min works on the integers
+    std::unique_ptr<std::atomic<uint32_t>[]> depth_;
+};
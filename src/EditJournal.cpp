@@ -0,0 +1,231 @@
+#include "EditJournal.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// File layout, all integers little-endian as on the supported platforms:
+//   header: char magic[8], uint32 flags, uint32 baseLength, char base[baseLength]
+//   record: uint32 edit, uint32 count, int32 values[count], uint32 checksum
+static const char kMagic[8] = { 'C', 'E', 'J', 'R', 'N', 'L', '0', '1' };
+static const uint32_t kFlagFloatObservations = 1;
+static const uint32_t kFlagLazyObservations = 2;
+static const uint32_t kFlagSessionBase = 4; // base is a session file, not a model directory
+
+// FNV-1a over the edit, count and values of a record
+static uint32_t Checksum(const char* data, size_t size)
+{
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= static_cast<unsigned char>(data[i]);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+static void PutU32(std::string& out, uint32_t value)
+{
+	out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static bool SyncFile(FILE* file)
+{
+	if (std::fflush(file) != 0) return false;
+#ifdef _WIN32
+	return _commit(_fileno(file)) == 0;
+#else
+	return fsync(fileno(file)) == 0;
+#endif
+}
+
+static void PutRecord(std::string& out, JournalEdit edit, const std::vector<int>& values)
+{
+	size_t begin = out.size();
+	PutU32(out, static_cast<uint32_t>(edit));
+	PutU32(out, static_cast<uint32_t>(values.size()));
+	out.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(int));
+	PutU32(out, Checksum(out.data() + begin, out.size() - begin));
+}
+
+EditJournal::~EditJournal()
+{
+	Close();
+}
+
+void EditJournal::Create(const std::string& path, const std::string& base, bool sessionBase,
+	const ImportOptions& options, const std::vector<Record>& records, const std::string& replaces)
+{
+	Close();
+	path_ = path;
+	options_ = options;
+	sessionBase_ = sessionBase;
+	replaces_ = replaces;
+	// The header and records go out with the first write, so a journal on disk
+	// always names its model
+	pending_.assign(kMagic, sizeof(kMagic));
+	PutU32(pending_, (options.float_observations ? kFlagFloatObservations : 0) |
+		(options.lazy_observations ? kFlagLazyObservations : 0) | (sessionBase ? kFlagSessionBase : 0));
+	PutU32(pending_, static_cast<uint32_t>(base.size()));
+	pending_ += base;
+	for (const Record& record : records) PutRecord(pending_, record.edit, record.values);
+	stop_ = false;
+	thread_ = std::thread(&EditJournal::Run, this);
+}
+
+void EditJournal::Append(JournalEdit edit, std::vector<int> values)
+{
+	if (!thread_.joinable()) return;
+	std::string record;
+	record.reserve(12 + sizeof(int) * values.size());
+	PutRecord(record, edit, values);
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		pending_ += record;
+	}
+	cv_.notify_one();
+}
+
+void EditJournal::Close()
+{
+	if (!thread_.joinable()) return;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+	}
+	cv_.notify_one();
+	thread_.join();
+}
+
+void EditJournal::Discard()
+{
+	Close();
+	if (!path_.empty()) std::remove(path_.c_str());
+	path_.clear();
+}
+
+void EditJournal::Run()
+{
+	FILE* file = std::fopen(path_.c_str(), "wb");
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (true) {
+		cv_.wait(lock, [this]() { return !pending_.empty() || stop_; });
+		// Queued records are still written on shutdown
+		if (pending_.empty()) break;
+		std::string batch;
+		batch.swap(pending_);
+		lock.unlock();
+		// A failed write leaves a torn tail that replay stops at. Records after it
+		// are lost either way, so the writer just keeps going.
+		if (file && std::fwrite(batch.data(), 1, batch.size(), file) == batch.size() && SyncFile(file) &&
+			!replaces_.empty()) {
+			std::remove(replaces_.c_str());
+			replaces_.clear();
+		}
+		lock.lock();
+		// Let the next records gather for one sync, unless shutting down
+		cv_.wait_for(lock, kSyncInterval, [this]() { return stop_; });
+	}
+	lock.unlock();
+	if (file) std::fclose(file);
+}
+
+bool EditJournal::Read(const std::string& path, std::string& base, bool& sessionBase, ImportOptions& options,
+	std::vector<Record>& records)
+{
+	FILE* file = std::fopen(path.c_str(), "rb");
+	if (!file) return false;
+	std::string data;
+	char chunk[65536];
+	size_t got;
+	while ((got = std::fread(chunk, 1, sizeof(chunk), file)) > 0) data.append(chunk, got);
+	std::fclose(file);
+
+	auto getU32 = [&](size_t pos) {
+		uint32_t value;
+		std::memcpy(&value, data.data() + pos, sizeof(value));
+		return value;
+	};
+	if (data.size() < sizeof(kMagic) + 8 || std::memcmp(data.data(), kMagic, sizeof(kMagic)) != 0) return false;
+	uint32_t flags = getU32(sizeof(kMagic));
+	uint32_t baseLength = getU32(sizeof(kMagic) + 4);
+	size_t pos = sizeof(kMagic) + 8;
+	if (data.size() - pos < baseLength) return false;
+	base.assign(data.data() + pos, baseLength);
+	pos += baseLength;
+	options.float_observations = (flags & kFlagFloatObservations) != 0;
+	options.lazy_observations = (flags & kFlagLazyObservations) != 0;
+	sessionBase = (flags & kFlagSessionBase) != 0;
+
+	records.clear();
+	while (data.size() - pos >= 12) {
+		uint32_t edit = getU32(pos);
+		uint32_t count = getU32(pos + 4);
+		if ((data.size() - pos - 12) / 4 < count) break;
+		size_t size = 8 + 4 * size_t(count);
+		if (getU32(pos + size) != Checksum(data.data() + pos, size)) break;
+		Record record;
+		record.edit = static_cast<JournalEdit>(edit);
+		record.values.resize(count);
+		if (count > 0) std::memcpy(record.values.data(), data.data() + pos + 8, 4 * size_t(count));
+		records.push_back(std::move(record));
+		pos += size + 4;
+	}
+	return true;
+}
+
+void EditJournal::Apply(Scene& scene, const Record& record)
+{
+	switch (record.edit) {
+	case JournalEdit::DeletePoints:
+	case JournalEdit::DeleteImages: {
+		// Ids back to current positions; ids already gone are skipped
+		bool images = record.edit == JournalEdit::DeleteImages;
+		std::vector<int> indices;
+		indices.reserve(record.values.size());
+		for (int id : record.values) {
+			int index = images ? scene.ImageIndex(id) : scene.PointIndex(id);
+			if (index >= 0) indices.push_back(index);
+		}
+		std::sort(indices.begin(), indices.end());
+		indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+		if (images) scene.DeleteImages(indices);
+		else scene.DeletePoints(indices);
+		break;
+	}
+	case JournalEdit::Consolidate: {
+		ConsolidateOptions options;
+		options.remove_dangling = record.values.size() > 0 && record.values[0] != 0;
+		options.renumber_points = record.values.size() > 1 && record.values[1] != 0;
+		options.renumber_images = record.values.size() > 2 && record.values[2] != 0;
+		scene.Consolidate(options);
+		break;
+	}
+	case JournalEdit::ReprojectionErrors:
+		scene.UpdateReprojectionErrors();
+		break;
+	case JournalEdit::Transform: {
+		double v[8];
+		if (record.values.size() != 16) break;
+		std::memcpy(v, record.values.data(), sizeof(v));
+		SimilarityTransform transform;
+		transform.scale = v[0];
+		std::copy(v + 1, v + 5, transform.qvec.begin());
+		std::copy(v + 5, v + 8, transform.translation.begin());
+		scene.Transform(transform);
+		break;
+	}
+	}
+}
+
+std::vector<int> EditJournal::TransformValues(const SimilarityTransform& transform)
+{
+	double v[8] = { transform.scale, transform.qvec[0], transform.qvec[1], transform.qvec[2], transform.qvec[3],
+		transform.translation[0], transform.translation[1], transform.translation[2] };
+	std::vector<int> values(16);
+	std::memcpy(values.data(), v, sizeof(v));
+	return values;
+}
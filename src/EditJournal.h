@@ -0,0 +1,73 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Scene.h"
+
+// Edits that change a model, in the order they are journaled
+enum class JournalEdit : uint32_t {
+    DeletePoints = 1, // values are point ids
+    DeleteImages = 2, // values are image ids, errors are recomputed after the deletion
+    Consolidate = 3, // values are remove_dangling, renumber_points, renumber_images
+    ReprojectionErrors = 4, // no values
+    Transform = 5 // values are TransformValues of the SimilarityTransform
+};
+
+// Append-only log of the edits made to a model imported from a COLMAP directory or
+// opened from a session file, its base, so a crash loses none of them. Replaying the
+// log on the base freshly imported or loaded restores the edited state. The calling thread never touches the disk: a writer
+// thread creates the file, then writes what Append queued and fsyncs at most once
+// per kSyncInterval, so a burst of edits shares one sync. Every record carries a
+// checksum and a record torn by a crash ends the replay.
+class EditJournal {
+public:
+    struct Record {
+        JournalEdit edit;
+        std::vector<int> values;
+    };
+
+    static constexpr std::chrono::milliseconds kSyncInterval{ 250 };
+
+    EditJournal() = default;
+    ~EditJournal();
+    EditJournal(const EditJournal&) = delete;
+    EditJournal& operator=(const EditJournal&) = delete;
+
+    // Start a journal at path holding records, replacing any file there. base is the
+    // model directory or, with sessionBase, the session file. The file at replaces,
+    // if any, is deleted once the new journal is on disk.
+    void Create(const std::string& path, const std::string& base, bool sessionBase, const ImportOptions& options,
+                const std::vector<Record>& records = std::vector<Record>(), const std::string& replaces = std::string());
+    void Append(JournalEdit edit, std::vector<int> values);
+    // Write what is queued and stop the writer, keeping the file
+    void Close();
+    // Close and delete the file, once its edits are no longer wanted
+    void Discard();
+    const std::string& Path() const { return path_; }
+    const ImportOptions& Options() const { return options_; }
+    bool SessionBase() const { return sessionBase_; }
+
+    // Header and complete records of a journal file, false if it is not one
+    static bool Read(const std::string& path, std::string& base, bool& sessionBase, ImportOptions& options,
+                     std::vector<Record>& records);
+    static void Apply(Scene& scene, const Record& record);
+    // Bit patterns of scale, qvec and translation, two values per double
+    static std::vector<int> TransformValues(const SimilarityTransform& transform);
+
+private:
+    void Run();
+
+    std::string path_;
+    ImportOptions options_;
+    bool sessionBase_ = false;
+    std::string replaces_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::string pending_; // encoded records waiting for the writer
+    bool stop_ = false;
+};
@@ -0,0 +1,175 @@
+#include "ImageTextures.h"
+#include <osgDB/ReadFile>
+#include <algorithm>
+#include <filesystem>
+#include "Parallel.h"
+
+osg::ref_ptr<osg::Image> DownscaleImage(const osg::Image& image, int maxSize)
+{
+    if (image.getDataType() != GL_UNSIGNED_BYTE || image.isCompressed() || !image.data()) return nullptr;
+    int channels = static_cast<int>(osg::Image::computeNumComponents(image.getPixelFormat()));
+    int width = image.s(), height = image.t();
+    if (width <= 0 || height <= 0 || channels < 1 || channels > 4 || maxSize <= 0) return nullptr;
+    // A whole factor makes every texel the mean of a square of pixels; the few
+    // columns and rows it leaves over at the edges are dropped. A side shorter than
+    // the factor becomes one texel averaging all of it.
+    int factor = std::max(1, (std::max(width, height) + maxSize - 1) / maxSize);
+    int outWidth = std::max(1, width / factor), outHeight = std::max(1, height / factor);
+    int spanX = std::min(factor, width), spanY = std::min(factor, height);
+    osg::ref_ptr<osg::Image> out = new osg::Image;
+    out->allocateImage(outWidth, outHeight, 1, image.getPixelFormat(), GL_UNSIGNED_BYTE, 1);
+    out->setInternalTextureFormat(image.getInternalTextureFormat());
+    bool topDown = image.getOrigin() == osg::Image::TOP_LEFT;
+    unsigned area = static_cast<unsigned>(spanX * spanY);
+    std::vector<unsigned> sum(static_cast<size_t>(outWidth) * channels);
+    for (int y = 0; y < outHeight; ++y) {
+        std::fill(sum.begin(), sum.end(), 0u);
+        for (int dy = 0; dy < spanY; ++dy) {
+            int row = y * factor + dy;
+            const unsigned char* src = image.data(0, topDown ? height - 1 - row : row);
+            for (int x = 0; x < outWidth; ++x) {
+                unsigned* texel = &sum[static_cast<size_t>(x) * channels];
+                const unsigned char* pixel = src + static_cast<size_t>(x) * factor * channels;
+                for (int dx = 0; dx < spanX; ++dx, pixel += channels)
+                    for (int c = 0; c < channels; ++c) texel[c] += pixel[c];
+            }
+        }
+        unsigned char* dst = out->data(0, y);
+        for (size_t i = 0; i < sum.size(); ++i) dst[i] = static_cast<unsigned char>((sum[i] + area / 2) / area);
+    }
+    return out;
+}
+
+ImageTextureCache::ImageTextureCache()
+    : maxLoads_(std::max<size_t>(1, ThreadPool::Instance().Concurrency() / 2)),
+      shared_(std::make_shared<Shared>())
+{
+}
+
+ImageTextureCache::~ImageTextureCache()
+{
+    // Loads still running finish into the shared state and are dropped with it
+    std::lock_guard<std::mutex> lock(shared_->mutex);
+    shared_->ready = nullptr;
+}
+
+void ImageTextureCache::SetImageRoot(const std::string& root)
+{
+    if (root == root_) return;
+    root_ = root;
+    ++generation_;
+    entries_.clear();
+    used_.clear();
+    bytes_ = 0;
+    wanted_.clear();
+    failed_.clear();
+    loading_.clear();
+    waiting_.clear();
+}
+
+void ImageTextureCache::SetBudget(size_t bytes)
+{
+    budget_ = bytes;
+    Evict();
+}
+
+void ImageTextureCache::SetReadyCallback(std::function<void()> ready)
+{
+    std::lock_guard<std::mutex> lock(shared_->mutex);
+    shared_->ready = std::move(ready);
+}
+
+void ImageTextureCache::Want(const std::vector<std::string>& names)
+{
+    wanted_.clear();
+    waiting_.clear();
+    if (root_.empty()) return;
+    // Moved to the front least important first, so the most important ends up first
+    for (auto name = names.rbegin(); name != names.rend(); ++name) {
+        wanted_.insert(*name);
+        auto entry = entries_.find(*name);
+        if (entry != entries_.end()) used_.splice(used_.begin(), used_, entry->second.used);
+    }
+    for (const std::string& name : names)
+        if (!entries_.count(name) && !loading_.count(name) && !failed_.count(name)) waiting_.push_back(name);
+    StartLoads();
+}
+
+osg::Texture2D* ImageTextureCache::Find(const std::string& name) const
+{
+    auto entry = entries_.find(name);
+    return entry != entries_.end() ? entry->second.texture.get() : nullptr;
+}
+
+bool ImageTextureCache::Collect()
+{
+    std::vector<Loaded> loaded;
+    {
+        std::lock_guard<std::mutex> lock(shared_->mutex);
+        loaded.swap(shared_->loaded);
+    }
+    if (loaded.empty()) return false;
+    bool arrived = false;
+    for (Loaded& load : loaded) {
+        --inFlight_;
+        if (load.generation != generation_) continue;
+        loading_.erase(load.name);
+        if (!load.image.valid()) {
+            failed_.insert(load.name);
+            continue;
+        }
+        osg::ref_ptr<osg::Texture2D> texture = new osg::Texture2D(load.image.get());
+        texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR);
+        texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
+        texture->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+        texture->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+        texture->setResizeNonPowerOfTwoHint(false);
+        // Once uploaded the texels only live on the GPU
+        texture->setUnRefImageDataAfterApply(true);
+        size_t bytes = load.image->getTotalSizeInBytes();
+        used_.push_front(load.name);
+        entries_[load.name] = { texture, bytes, used_.begin() };
+        bytes_ += bytes;
+        arrived = true;
+    }
+    Evict();
+    StartLoads();
+    return arrived;
+}
+
+void ImageTextureCache::StartLoads()
+{
+    size_t next = 0;
+    for (; next < waiting_.size() && inFlight_ < maxLoads_; ++next) {
+        const std::string& name = waiting_[next];
+        if (loading_.count(name) || entries_.count(name)) continue;
+        loading_.insert(name);
+        ++inFlight_;
+        std::string path = (std::filesystem::path(root_) / name).string();
+        std::shared_ptr<Shared> shared = shared_;
+        unsigned generation = generation_;
+        int maxSize = maxSize_;
+        ThreadPool::Instance().Submit([shared, generation, name, path, maxSize]() {
+            osg::ref_ptr<osg::Image> image = osgDB::readImageFile(path);
+            if (image.valid()) image = DownscaleImage(*image, maxSize);
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            shared->loaded.push_back({ generation, name, image });
+            if (shared->ready) shared->ready();
+        });
+    }
+    waiting_.erase(waiting_.begin(), waiting_.begin() + next);
+}
+
+void ImageTextureCache::Evict()
+{
+    // Least recently wanted first; wanted textures stay even over budget
+    auto name = used_.end();
+    while (bytes_ > budget_ && name != used_.begin()) {
+        --name;
+        if (wanted_.count(*name)) continue;
+        auto entry = entries_.find(*name);
+        bytes_ -= entry->second.bytes;
+        entries_.erase(entry);
+        name = used_.erase(name);
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <osg/Image>
+#include <osg/Texture2D>
+#include <cstddef>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Copy of an 8-bit image, box filtered so its longer side is at most maxSize, with
+// rows bottom-up and tightly packed. Null for other pixel types.
+osg::ref_ptr<osg::Image> DownscaleImage(const osg::Image& image, int maxSize);
+
+// Photos of the images as textures for their image planes. Files are read and
+// downscaled on the thread pool, at most a few at a time; Collect turns the finished
+// ones into textures, kept in a least-recently-used cache within a byte budget.
+// Everything but the ready callback runs on the thread that owns the cache.
+class ImageTextureCache {
+public:
+    static constexpr size_t kDefaultBudget = 256u << 20;
+    static constexpr int kDefaultMaxSize = 512;
+
+    ImageTextureCache();
+    ~ImageTextureCache();
+    ImageTextureCache(const ImageTextureCache&) = delete;
+    ImageTextureCache& operator=(const ImageTextureCache&) = delete;
+
+    // Photos are read from the image name, which may hold subdirectories, under root.
+    // A new root drops every texture and an empty one turns loading off.
+    void SetImageRoot(const std::string& root);
+    const std::string& ImageRoot() const { return root_; }
+    // Bytes of texture memory kept, evicting the least recently wanted textures first
+    void SetBudget(size_t bytes);
+    size_t Budget() const { return budget_; }
+    size_t Bytes() const { return bytes_; }
+    // Texels on the longer side of a texture
+    int MaxSize() const { return maxSize_; }
+    // Called on a pool thread whenever a photo finished loading, e.g. to schedule a redraw
+    void SetReadyCallback(std::function<void()> ready);
+
+    // The photos wanted now, most important first. Cached ones count as just used and
+    // are not evicted while wanted; missing ones replace the requests still waiting.
+    void Want(const std::vector<std::string>& names);
+    // Texture of a cached photo, null while it loads or if it failed to
+    osg::Texture2D* Find(const std::string& name) const;
+    // Move finished photos into the cache, true if any arrived
+    bool Collect();
+
+private:
+    struct Entry {
+        osg::ref_ptr<osg::Texture2D> texture;
+        size_t bytes;
+        std::list<std::string>::iterator used; // position in used_
+    };
+    struct Loaded {
+        unsigned generation;
+        std::string name;
+        osg::ref_ptr<osg::Image> image; // null if the file could not be read
+    };
+    // What pool tasks share with the cache, outliving it while they run
+    struct Shared {
+        std::mutex mutex;
+        std::vector<Loaded> loaded;
+        std::function<void()> ready;
+    };
+
+    void StartLoads();
+    void Evict();
+
+    std::string root_;
+    size_t budget_ = kDefaultBudget;
+    int maxSize_ = kDefaultMaxSize;
+    size_t maxLoads_; // decodes in flight at once, bounding the memory of full-size images
+    size_t inFlight_ = 0; // including loads for an earlier root
+    unsigned generation_ = 0; // bumped by a new root, older loads are dropped
+    std::unordered_map<std::string, Entry> entries_;
+    std::list<std::string> used_; // cached names, most recently wanted first
+    size_t bytes_ = 0;
+    std::unordered_set<std::string> wanted_;
+    std::unordered_set<std::string> failed_;
+    std::unordered_set<std::string> loading_;
+    std::vector<std::string> waiting_; // requests not started yet, most important first
+    std::shared_ptr<Shared> shared_;
+};
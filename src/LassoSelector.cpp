@@ -0,0 +1,164 @@
+#include "LassoSelector.h"
+#include <algorithm>
+#include <limits>
+#include "Parallel.h"
+
+// Crossing of the edge between polygon vertices i (a) and i - 1 (b) by the ray from
+// (x, y) towards +x, with the integer arithmetic of PointInPolygon
+static bool Crosses(const LassoSelector::Vertex& a, const LassoSelector::Vertex& b, int x, int y)
+{
+	return ((a.y > y) != (b.y > y)) && (x < (b.x - a.x) * (y - a.y) / (b.y - a.y) + a.x);
+}
+
+// x extent of a triangle within the band y0 <= y <= y1, false if they do not meet
+static bool BandSpan(const double* px, const double* py, double y0, double y1, double& xmin, double& xmax)
+{
+	xmin = std::numeric_limits<double>::infinity();
+	xmax = -xmin;
+	for (int i = 0; i < 3; ++i) {
+		int j = (i + 1) % 3;
+		if (py[i] >= y0 && py[i] <= y1) {
+			xmin = std::min(xmin, px[i]);
+			xmax = std::max(xmax, px[i]);
+		}
+		for (double yl : { y0, y1 }) {
+			if ((py[i] < yl) == (py[j] < yl)) continue;
+			double x = px[i] + (yl - py[i]) / (py[j] - py[i]) * (px[j] - px[i]);
+			xmin = std::min(xmin, x);
+			xmax = std::max(xmax, x);
+		}
+	}
+	return xmin <= xmax;
+}
+
+int LassoSelector::CellX(int x) const
+{
+	int c = x < 0 ? 0 : x / kCellSize;
+	return std::min(c, cellsX_ - 1);
+}
+
+int LassoSelector::CellY(int y) const
+{
+	int c = y < 0 ? 0 : y / kCellSize;
+	return std::min(c, cellsY_ - 1);
+}
+
+void LassoSelector::Begin(std::vector<int> xs, std::vector<int> ys, int width, int height,
+	const std::vector<char>* eligible)
+{
+	Clear();
+	xs_ = std::move(xs);
+	ys_ = std::move(ys);
+	cellsX_ = std::max(1, (width + kCellSize - 1) / kCellSize);
+	cellsY_ = std::max(1, (height + kCellSize - 1) / kCellSize);
+	size_t numCells = static_cast<size_t>(cellsX_) * cellsY_;
+	size_t n = xs_.size();
+	inside_.assign(n, 0);
+
+	// Counting sort of the points by cell: per-block histograms, then every block
+	// scatters into its own slice of each cell
+	std::vector<uint32_t> cells(n);
+	size_t numBlocks = std::min<size_t>(ThreadPool::Instance().Concurrency() * 4, n / 65536 + 1);
+	size_t block = (n + numBlocks - 1) / numBlocks;
+	std::vector<std::vector<uint32_t>> counts(numBlocks);
+	ParallelFor(numBlocks, [&](size_t first, size_t last) {
+		for (size_t b = first; b < last; ++b) {
+			counts[b].assign(numCells, 0);
+			for (size_t i = b * block; i < std::min(n, (b + 1) * block); ++i) {
+				if (eligible && !(*eligible)[i]) {
+					cells[i] = static_cast<uint32_t>(numCells);
+					continue;
+				}
+				cells[i] = static_cast<uint32_t>(CellY(ys_[i])) * cellsX_ + CellX(xs_[i]);
+				++counts[b][cells[i]];
+			}
+		}
+	}, 1);
+	cellStart_.assign(numCells + 1, 0);
+	uint32_t total = 0;
+	for (size_t c = 0; c < numCells; ++c) {
+		cellStart_[c] = total;
+		for (size_t b = 0; b < numBlocks; ++b) {
+			uint32_t count = counts[b][c];
+			counts[b][c] = total; // becomes the block's write position
+			total += count;
+		}
+	}
+	cellStart_[numCells] = total;
+	cellPoints_.resize(total);
+	ParallelFor(numBlocks, [&](size_t first, size_t last) {
+		for (size_t b = first; b < last; ++b)
+			for (size_t i = b * block; i < std::min(n, (b + 1) * block); ++i)
+				if (cells[i] < numCells) cellPoints_[counts[b][cells[i]]++] = static_cast<uint32_t>(i);
+	}, 1);
+}
+
+const std::vector<int>& LassoSelector::AddVertex(int x, int y)
+{
+	toggled_.clear();
+	Vertex v = { x, y };
+	if (vertices_.empty() || xs_.empty()) {
+		vertices_.push_back(v);
+		return toggled_;
+	}
+	const Vertex first = vertices_.front();
+	const Vertex last = vertices_.back();
+	vertices_.push_back(v);
+
+	// Visit the cells the triangle (first, last, v) touches, one row of cells at a
+	// time, with a cell of slack for the rounding of the crossing test
+	double px[3] = { double(first.x), double(last.x), double(v.x) };
+	double py[3] = { double(first.y), double(last.y), double(v.y) };
+	int rowBegin = CellY(static_cast<int>(*std::min_element(py, py + 3)) - 1);
+	int rowEnd = CellY(static_cast<int>(*std::max_element(py, py + 3)) + 1);
+	const double kFar = std::numeric_limits<double>::max();
+	for (int row = rowBegin; row <= rowEnd; ++row) {
+		// Border rows also hold every point beyond the window edge
+		double y0 = row == 0 ? -kFar : row * kCellSize - 1.0;
+		double y1 = row == cellsY_ - 1 ? kFar : (row + 1) * kCellSize + 1.0;
+		double xmin, xmax;
+		if (!BandSpan(px, py, y0, y1, xmin, xmax)) continue;
+		int colBegin = CellX(static_cast<int>(std::max(xmin, -1e9)) - kCellSize);
+		int colEnd = CellX(static_cast<int>(std::min(xmax, 1e9)) + kCellSize);
+		for (uint32_t k = cellStart_[row * cellsX_ + colBegin]; k < cellStart_[row * cellsX_ + colEnd + 1]; ++k) {
+			uint32_t i = cellPoints_[k];
+			int qx = xs_[i], qy = ys_[i];
+			if ((Crosses(first, last, qx, qy) != Crosses(v, last, qx, qy)) != Crosses(first, v, qx, qy)) {
+				inside_[i] = !inside_[i];
+				if (inside_[i]) ++count_;
+				else --count_;
+				toggled_.push_back(static_cast<int>(i));
+			}
+		}
+	}
+	return toggled_;
+}
+
+void LassoSelector::Clear()
+{
+	xs_.clear();
+	ys_.clear();
+	cellStart_.clear();
+	cellPoints_.clear();
+	cellsX_ = cellsY_ = 0;
+	vertices_.clear();
+	inside_.clear();
+	toggled_.clear();
+	count_ = 0;
+}
+
+std::vector<int> LassoSelector::Selected() const
+{
+	return ParallelReduce(inside_.size(), std::vector<int>(),
+		[&](size_t begin, size_t end) {
+			std::vector<int> hits;
+			for (size_t i = begin; i < end; ++i)
+				if (inside_[i]) hits.push_back(static_cast<int>(i));
+			return hits;
+		},
+		[](std::vector<int> a, std::vector<int> b) {
+			if (a.empty()) return b;
+			a.insert(a.end(), b.begin(), b.end());
+			return a;
+		}, 65536);
+}
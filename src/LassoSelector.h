@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Incremental even-odd lasso over points projected to window coordinates.
+// Appending vertex v[n+1] to v[0..n] replaces the closing edge (v[n], v[0]) by
+// (v[n], v[n+1]) and (v[n+1], v[0]), so only points in the triangle
+// (v[0], v[n], v[n+1]) change state. Those are found through a grid of the
+// projected points. The crossing rule matches PointInPolygon in OSGCanvas, so the
+// result equals a full polygon test of the same vertices.
+class LassoSelector {
+public:
+    struct Vertex { int x, y; };
+
+    // Take ownership of the projected points and bin them. Points outside the
+    // width x height window fall into the border cells. Points with a zero entry
+    // in eligible are left out and never selected.
+    void Begin(std::vector<int> xs, std::vector<int> ys, int width, int height,
+        const std::vector<char>* eligible = nullptr);
+    // Append a vertex and return the points whose inside state flipped
+    const std::vector<int>& AddVertex(int x, int y);
+    void Clear();
+
+    bool Active() const { return !vertices_.empty() || !xs_.empty(); }
+    const std::vector<Vertex>& Vertices() const { return vertices_; }
+    const std::vector<char>& Inside() const { return inside_; }
+    size_t Count() const { return count_; }
+    // Indices of the points inside, sorted
+    std::vector<int> Selected() const;
+
+private:
+    static constexpr int kCellSize = 8;
+
+    int CellX(int x) const;
+    int CellY(int y) const;
+
+    std::vector<int> xs_, ys_;
+    std::vector<uint32_t> cellStart_; // CSR over cells, row-major
+    std::vector<uint32_t> cellPoints_;
+    int cellsX_ = 0, cellsY_ = 0;
+    std::vector<Vertex> vertices_;
+    std::vector<char> inside_;
+    std::vector<int> toggled_;
+    size_t count_ = 0;
+};
@@ -4,41 +4,122 @@
 #include <wx/filedlg.h>
 #include <wx/msgdlg.h>
 #include <wx/aboutdlg.h>
+#include <wx/choicdlg.h>
+#include <wx/dir.h>
+#include <wx/filename.h>
+#include <wx/utils.h>
+#include <wx/stdpaths.h>
+#include <wx/time.h>
+#include <wx/textdlg.h>
+#include <algorithm>
+#include <cstdio>
+#include "AsyncTask.h"
+#include "CompressedFile.h"
+#include "SceneDiff.h"
 
 enum {
     ID_OpenColmap = wxID_HIGHEST + 1,
     ID_ExportColmap,
+    ID_Consolidate,
+    ID_ReprojectionErrors,
+    ID_TransformModel,
+    ID_FloatObservations,
+    ID_LazyObservations,
+    ID_ImportPly,
+    ID_ExportPly,
+    ID_ExportSelectedPly,
+    ID_ExportPlain,
+    ID_ExportGzip,
+    ID_ExportZstd,
+    ID_OpenSession,
+    ID_SaveSession,
+    ID_OpenModels,
+    ID_CloseModel,
+    ID_ToggleModel,
+    ID_CompareModels,
     ID_DeleteSelected,
     ID_ModeNormal,
     ID_ModeRectangle,
     ID_ModePolygon,
     ID_ModeRectangleCam,
     ID_ModePolygonCam,
+    ID_ModeLasso,
+    ID_VisibleOnly,
     ID_InvertSelected,
+    ID_SelectObservedPoints,
+    ID_SelectObservingCameras,
+    ID_SelectInFrustum,
+    ID_FrustumDepthRange,
+    ID_SelectWeakCameras,
+    ID_SelectCameraComponent,
     ID_ResetView,
     ID_IncreasePointSize,
     ID_DecreasePointSize,
     ID_IncreaseCamSize,
     ID_DecreaseCamSize,
-	ID_About
+    ID_ColorRgb,
+    ID_ColorHeight,
+    ID_ColorError,
+    ID_ColorTrackLength,
+    ID_ColorMembership,
+    ID_ColorChanges,
+    ID_ColormapViridis,
+    ID_ColormapTurbo,
+    ID_ColormapGray,
+    ID_ColorRange,
+    ID_ShowPhotos,
+    ID_LayoutSingle,
+    ID_LayoutSplit,
+    ID_LayoutThree,
+    ID_HidePhotos,
+	ID_About,
+    ID_ModelFirst,
+    ID_ModelLast = ID_ModelFirst + 63
 };
 
 wxBEGIN_EVENT_TABLE(MainFrame, wxFrame)
     EVT_MENU(ID_OpenColmap, MainFrame::OnOpenColmapFiles)
     EVT_MENU(ID_ExportColmap, MainFrame::OnExportColmapFiles)
+    EVT_MENU(ID_ImportPly, MainFrame::OnImportPly)
+    EVT_MENU(ID_ExportPly, MainFrame::OnExportPly)
+    EVT_MENU(ID_ExportSelectedPly, MainFrame::OnExportPly)
+    EVT_MENU(ID_Consolidate, MainFrame::OnConsolidate)
+    EVT_MENU(ID_ReprojectionErrors, MainFrame::OnReprojectionErrors)
+    EVT_MENU(ID_TransformModel, MainFrame::OnTransformModel)
+    EVT_MENU(ID_OpenSession, MainFrame::OnOpenSession)
+    EVT_MENU(ID_SaveSession, MainFrame::OnSaveSession)
+    EVT_MENU(ID_OpenModels, MainFrame::OnOpenModels)
+    EVT_MENU(ID_CloseModel, MainFrame::OnCloseModel)
+    EVT_MENU(ID_ToggleModel, MainFrame::OnToggleModel)
+    EVT_MENU(ID_CompareModels, MainFrame::OnCompareModels)
+    EVT_MENU_RANGE(ID_ModelFirst, ID_ModelLast, MainFrame::OnSelectModel)
     EVT_MENU(ID_DeleteSelected, MainFrame::OnDeleteSelected)
     EVT_MENU(ID_InvertSelected, MainFrame::OnInvertSelected)
+    EVT_MENU(ID_SelectObservedPoints, MainFrame::OnSelectObservedPoints)
+    EVT_MENU(ID_SelectObservingCameras, MainFrame::OnSelectObservingCameras)
+    EVT_MENU(ID_SelectInFrustum, MainFrame::OnSelectInFrustum)
+    EVT_MENU(ID_FrustumDepthRange, MainFrame::OnFrustumDepthRange)
+    EVT_MENU(ID_SelectWeakCameras, MainFrame::OnSelectWeakCameras)
+    EVT_MENU(ID_SelectCameraComponent, MainFrame::OnSelectCameraComponent)
     EVT_MENU(ID_ModeNormal, MainFrame::OnModeNormal)
     EVT_MENU(ID_ModeRectangle, MainFrame::OnModeRectangle)
     EVT_MENU(ID_ModePolygon, MainFrame::OnModePolygon)
     EVT_MENU(ID_ModeRectangleCam, MainFrame::OnModeRectangleCam)
     EVT_MENU(ID_ModePolygonCam, MainFrame::OnModePolygonCam)
+    EVT_MENU(ID_ModeLasso, MainFrame::OnModeLasso)
+    EVT_MENU(ID_VisibleOnly, MainFrame::OnVisibleOnly)
     EVT_MENU(wxID_EXIT, MainFrame::OnExit)
     EVT_MENU(ID_ResetView, MainFrame::OnResetView)
     EVT_MENU(ID_IncreasePointSize, MainFrame::OnIncreasePointSize)
     EVT_MENU(ID_DecreasePointSize, MainFrame::OnDecreasePointSize)
     EVT_MENU(ID_IncreaseCamSize, MainFrame::OnIncreaseCamSize)
     EVT_MENU(ID_DecreaseCamSize, MainFrame::OnDecreaseCamSize)
+    EVT_MENU_RANGE(ID_ColorRgb, ID_ColorChanges, MainFrame::OnColorMode)
+    EVT_MENU_RANGE(ID_ColormapViridis, ID_ColormapGray, MainFrame::OnColormap)
+    EVT_MENU(ID_ColorRange, MainFrame::OnColorRange)
+    EVT_MENU(ID_ShowPhotos, MainFrame::OnShowPhotos)
+    EVT_MENU_RANGE(ID_LayoutSingle, ID_LayoutThree, MainFrame::OnViewLayout)
+    EVT_MENU(ID_HidePhotos, MainFrame::OnHidePhotos)
 	EVT_MENU(ID_About, MainFrame::OnAbout)
 wxEND_EVENT_TABLE()
 
@@ -48,8 +129,28 @@ MainFrame::MainFrame(const wxString& title)
     m_menuBar = new wxMenuBar();
     wxMenu* fileMenu = new wxMenu;
     fileMenu->Append(ID_OpenColmap, "Import COLMAP Files");
+    fileMenu->Append(ID_Consolidate, "Consolidate Model");
+    fileMenu->Append(ID_ReprojectionErrors, "Recompute Reprojection Errors");
+    fileMenu->Append(ID_TransformModel, "Transform Model");
     fileMenu->Append(ID_ExportColmap, "Export COLMAP Files");
     fileMenu->AppendSeparator();
+    fileMenu->Append(ID_ImportPly, "Import PLY Point Cloud");
+    fileMenu->Append(ID_ExportPly, "Export PLY Point Cloud");
+    fileMenu->Append(ID_ExportSelectedPly, "Export Selected Points as PLY");
+    fileMenu->AppendSeparator();
+    fileMenu->Append(ID_OpenSession, "Open Session");
+    fileMenu->Append(ID_SaveSession, "Save Session");
+    fileMenu->AppendSeparator();
+    fileMenu->AppendCheckItem(ID_FloatObservations, "Load Observations as Float32");
+    fileMenu->AppendCheckItem(ID_LazyObservations, "Load Observations on Demand");
+    wxMenu* compressionMenu = new wxMenu;
+    compressionMenu->AppendRadioItem(ID_ExportPlain, "Uncompressed (.txt)");
+    compressionMenu->AppendRadioItem(ID_ExportGzip, "gzip (.txt.gz)");
+    compressionMenu->AppendRadioItem(ID_ExportZstd, "Zstandard (.txt.zst)");
+    compressionMenu->Enable(ID_ExportGzip, CompressionSupported(Compression::Gzip));
+    compressionMenu->Enable(ID_ExportZstd, CompressionSupported(Compression::Zstd));
+    fileMenu->AppendSubMenu(compressionMenu, "Export Compression");
+    fileMenu->AppendSeparator();
     fileMenu->Append(wxID_EXIT, "Exit");
     m_menuBar->Append(fileMenu, "File");
 
@@ -57,8 +158,11 @@ MainFrame::MainFrame(const wxString& title)
     cursorMenu->Append(ID_ModeNormal, "Normal Mode(N)");
     cursorMenu->Append(ID_ModeRectangle, "Rectangle Select Point Mode(R)");
     cursorMenu->Append(ID_ModePolygon, "Polygon Select Point Mode(P)");
+    cursorMenu->Append(ID_ModeLasso, "Lasso Select Point Mode(L)");
     cursorMenu->Append(ID_ModeRectangleCam, "Rectangle Select Camera Mode(Ctrl+R)");
     cursorMenu->Append(ID_ModePolygonCam, "Polygon Select Camera Mode(Ctrl+P)");
+    cursorMenu->AppendSeparator();
+    cursorMenu->AppendCheckItem(ID_VisibleOnly, "Select Visible Points Only");
     m_menuBar->Append(cursorMenu, "Select");
 
     wxMenu* viewMenu = new wxMenu;
@@ -67,24 +171,78 @@ MainFrame::MainFrame(const wxString& title)
     viewMenu->Append(ID_DecreasePointSize, "Decrease point size(-)");
     viewMenu->Append(ID_IncreaseCamSize, "Increase camera size(\u2191)");
     viewMenu->Append(ID_DecreaseCamSize, "Decrease camera size(\u2193)");
+    wxMenu* layoutMenu = new wxMenu;
+    layoutMenu->AppendRadioItem(ID_LayoutSingle, "Single View");
+    layoutMenu->AppendRadioItem(ID_LayoutSplit, "Free and Top View");
+    layoutMenu->AppendRadioItem(ID_LayoutThree, "Free, Top and Front View");
+    viewMenu->AppendSubMenu(layoutMenu, "Layout");
+    viewMenu->AppendSeparator();
+    wxMenu* colorMenu = new wxMenu;
+    colorMenu->AppendRadioItem(ID_ColorRgb, "Point Color");
+    colorMenu->AppendRadioItem(ID_ColorHeight, "Height");
+    colorMenu->AppendRadioItem(ID_ColorError, "Reprojection Error");
+    colorMenu->AppendRadioItem(ID_ColorTrackLength, "Track Length");
+    colorMenu->AppendRadioItem(ID_ColorMembership, "Observed by Selected Cameras");
+    colorMenu->AppendRadioItem(ID_ColorChanges, "Changes Between Compared Models");
+    viewMenu->AppendSubMenu(colorMenu, "Color Points By");
+    wxMenu* colormapMenu = new wxMenu;
+    colormapMenu->AppendRadioItem(ID_ColormapViridis, "Viridis");
+    colormapMenu->AppendRadioItem(ID_ColormapTurbo, "Turbo");
+    colormapMenu->AppendRadioItem(ID_ColormapGray, "Grayscale");
+    viewMenu->AppendSubMenu(colormapMenu, "Colormap");
+    viewMenu->Append(ID_ColorRange, "Set Color Range");
+    viewMenu->AppendSeparator();
+    viewMenu->Append(ID_ShowPhotos, "Show Photos on Image Planes");
+    viewMenu->Append(ID_HidePhotos, "Hide Photos");
     m_menuBar->Append(viewMenu, "View");
 
     wxMenu* editMenue = new wxMenu;
     editMenue->Append(ID_InvertSelected, "Invert Selected(V)");
+    editMenue->Append(ID_SelectObservedPoints, "Select Points Observed by Selected Cameras(O)");
+    editMenue->Append(ID_SelectObservingCameras, "Select Cameras Observing Selected Points(Ctrl+O)");
+    editMenue->Append(ID_SelectInFrustum, "Select Points in Selected Camera Frustums(F)");
+    editMenue->Append(ID_FrustumDepthRange, "Set Frustum Depth Range");
+    editMenue->Append(ID_SelectWeakCameras, "Select Weakly Connected Cameras");
+    editMenue->Append(ID_SelectCameraComponent, "Select Connected Camera Group");
     editMenue->Append(ID_DeleteSelected, "Delete Selected(Del)");
     m_menuBar->Append(editMenue, "Edit");
+
+    m_modelMenu = new wxMenu;
+    m_menuBar->Append(m_modelMenu, "Model");
+    RebuildModelMenu();
 	
 	wxMenu* helpMenu = new wxMenu;
     helpMenu->Append(ID_About, "About");
     m_menuBar->Append(helpMenu, "Help");
 
     SetMenuBar(m_menuBar);
+    CreateStatusBar();
 
     m_panel = new wxPanel(this);
     m_sizer = new wxBoxSizer(wxVERTICAL);
     m_canvas = new OSGCanvas(m_panel);
     m_sizer->Add(m_canvas, 1, wxEXPAND | wxALL, 5);
     m_panel->SetSizer(m_sizer);
+
+    // Edits are journaled so a crash loses none of them, journals left behind by
+    // one are offered for replay once the frame is up
+    m_journalDir = wxStandardPaths::Get().GetUserDataDir() + "\\journal";
+    wxFileName::Mkdir(m_journalDir, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL);
+    m_canvas->SetEditCallback([this](Scene* scene, JournalEdit edit, std::vector<int> ids) {
+        RecordEdit(scene, edit, std::move(ids));
+    });
+    CallAfter(&MainFrame::RecoverJournals);
+}
+
+MainFrame::~MainFrame()
+{
+    // Imports still running on the pool are abandoned and their results discarded
+    m_cancel.Cancel();
+    // Unsaved edits are dropped on a clean exit, only a crash leaves journals behind
+    for (auto& model : m_models) {
+        if (model.journal) model.journal->Discard();
+        for (auto& journal : model.exportJournals) journal->Discard();
+    }
 }
 
 void MainFrame::OnAbout(wxCommandEvent& event)
@@ -102,29 +260,472 @@ void MainFrame::OnAbout(wxCommandEvent& event)
     wxAboutBox(info,this);
 }
 
+// Import a sparse model directory, nullptr on failure. Safe to call from worker threads.
+static Scene* ImportModel(const std::string& dirPath, const ImportOptions& options, const CancellationToken& cancel)
+{
+    std::string pointsPath = dirPath + "\\points3D.txt";
+    std::string camerasPath = dirPath + "\\cameras.txt";
+    std::string imagesPath = dirPath + "\\images.txt";
+
+    Scene* scene = new Scene();
+    if (!scene->Import(pointsPath, camerasPath, imagesPath, options, &cancel)) {
+        delete scene;
+        return nullptr;
+    }
+    return scene;
+}
+
+// Load a session file into a new scene, nullptr on failure. Safe to call from worker threads.
+static Scene* LoadSession(const std::string& path, SessionState& state)
+{
+    Scene* scene = new Scene();
+    if (!SessionFile::Load(path, *scene, state)) {
+        delete scene;
+        return nullptr;
+    }
+    return scene;
+}
+
 void MainFrame::OnOpenColmapFiles(wxCommandEvent& event) {
     wxDirDialog dirDialog(this, "Select COLMAP sparse directory", "", wxDD_DEFAULT_STYLE | wxDD_DIR_MUST_EXIST);
     if (dirDialog.ShowModal() == wxID_CANCEL) return;
     wxString dirPath = dirDialog.GetPath();
 
-    wxString pointsPath = dirPath + "\\points3D.txt";
-    wxString camerasPath = dirPath + "\\cameras.txt";
-    wxString imagesPath = dirPath + "\\images.txt";
-
-    if (m_scene) delete m_scene;
-    m_scene = new Scene();
-    bool ok = m_scene->Import(pointsPath.ToStdString(), camerasPath.ToStdString(), imagesPath.ToStdString());
-    if (!ok) {
-        wxMessageBox("Failed to import COLMAP files.", "Error", wxICON_ERROR);
-        delete m_scene;
-        m_scene = nullptr;
+    // Parse on the pool, the UI stays responsive until the model is handed back
+    SetStatusText("Importing " + dirPath + "...");
+    std::string path = dirPath.ToStdString();
+    ImportOptions options;
+    options.float_observations = m_menuBar->IsChecked(ID_FloatObservations);
+    options.lazy_observations = m_menuBar->IsChecked(ID_LazyObservations);
+    CancellationToken cancel = m_cancel;
+    RunAsync(m_cancel,
+        [path, options, cancel]() { return ImportModel(path, options, cancel); },
+        [this, dirPath, options](Scene* scene) {
+            SetStatusText("");
+            if (!scene) {
+                wxMessageBox("Failed to import COLMAP files.", "Error", wxICON_ERROR);
+                return;
+            }
+            LoadedModel model = { scene, dirPath };
+            model.journal = StartJournal(dirPath, false, options);
+            AddModel(model);
+        },
+        [](Scene* scene) { delete scene; });
+}
+
+void MainFrame::OnOpenModels(wxCommandEvent& event)
+{
+    wxDirDialog dirDialog(this, "Select directory containing sparse models (e.g. sparse)", "",
+        wxDD_DEFAULT_STYLE | wxDD_DIR_MUST_EXIST);
+    if (dirDialog.ShowModal() == wxID_CANCEL) return;
+    wxString dirPath = dirDialog.GetPath();
+
+    // Every sub directory holding a model, in name order (0, 1, ...)
+    std::vector<wxString> modelDirs;
+    wxDir dir(dirPath);
+    wxString name;
+    bool more = dir.IsOpened() && dir.GetFirst(&name, wxEmptyString, wxDIR_DIRS);
+    while (more) {
+        wxString sub = dirPath + "\\" + name;
+        if (!FindModelFile((sub + "\\points3D.txt").ToStdString()).empty()) modelDirs.push_back(sub);
+        more = dir.GetNext(&name);
+    }
+    std::sort(modelDirs.begin(), modelDirs.end(), [](const wxString& a, const wxString& b) {
+        return a.length() != b.length() ? a.length() < b.length() : a < b;
+    });
+    if (modelDirs.empty()) {
+        wxMessageBox("No sparse models found in " + dirPath, "Error", wxICON_ERROR);
         return;
     }
-    if (m_canvas && m_scene) {
-        m_canvas->SetScene(m_scene);
+
+    // Models are independent, parse them all at once on the pool and add them in
+    // name order once every one has finished
+    SetStatusText(wxString::Format("Importing %zu models...", modelDirs.size()));
+    std::vector<std::string> paths;
+    for (const wxString& sub : modelDirs) paths.push_back(sub.ToStdString());
+    ImportOptions options;
+    options.float_observations = m_menuBar->IsChecked(ID_FloatObservations);
+    options.lazy_observations = m_menuBar->IsChecked(ID_LazyObservations);
+    CancellationToken cancel = m_cancel;
+    RunAsync(m_cancel,
+        [paths, options, cancel]() {
+            std::vector<Scene*> scenes(paths.size(), nullptr);
+            ParallelFor(paths.size(), [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) scenes[i] = ImportModel(paths[i], options, cancel);
+            }, 1);
+            return scenes;
+        },
+        [this, modelDirs, options](const std::vector<Scene*>& scenes) {
+            SetStatusText("");
+            wxString failed;
+            for (size_t i = 0; i < scenes.size(); i++) {
+                if (!scenes[i]) {
+                    failed += "\n" + modelDirs[i];
+                    continue;
+                }
+                LoadedModel model = { scenes[i], modelDirs[i] };
+                model.journal = StartJournal(modelDirs[i], false, options);
+                AddModel(model);
+            }
+            if (!failed.empty())
+                wxMessageBox("Failed to import:" + failed, "Error", wxICON_ERROR);
+        },
+        [](const std::vector<Scene*>& scenes) {
+            for (Scene* scene : scenes) delete scene;
+        });
+}
+
+void MainFrame::AddModel(const LoadedModel& model)
+{
+    m_models.push_back(model);
+    m_scene = model.scene;
+    if (m_canvas) m_canvas->AddScene(m_scene);
+    RebuildModelMenu();
+}
+
+// Journal for a model just imported from the directory or loaded from the session
+// file base, written on its own thread
+std::shared_ptr<EditJournal> MainFrame::StartJournal(const wxString& base, bool sessionBase, const ImportOptions& options,
+    const std::vector<EditJournal::Record>& records, const std::string& replaces)
+{
+    wxString path = m_journalDir + "\\" + wxString::Format("%lld-%d.journal",
+        static_cast<long long>(wxGetUTCTimeMillis().GetValue()), m_journalsStarted++);
+    auto journal = std::make_shared<EditJournal>();
+    journal->Create(path.ToStdString(), base.ToStdString(), sessionBase, options, records, replaces);
+    return journal;
+}
+
+void MainFrame::RecordEdit(Scene* scene, JournalEdit edit, std::vector<int> values)
+{
+    for (auto& model : m_models) {
+        if (model.scene != scene) continue;
+        for (auto& journal : model.exportJournals) journal->Append(edit, values);
+        if (model.journal) model.journal->Append(edit, std::move(values));
     }
 }
 
+// Journals left behind by a crash, replayed on top of a fresh import of their model
+// or a fresh load of their session
+struct RecoveredJournal {
+    std::string path;
+    std::string base;
+    bool sessionBase = false;
+    std::string modelDir; // base, or the directory named by the session
+    ImportOptions options;
+    std::vector<EditJournal::Record> records;
+    Scene* scene = nullptr;
+};
+
+void MainFrame::RecoverJournals()
+{
+    // Reading the journals touches the disk, so it happens on the pool
+    std::string journalDir = m_journalDir.ToStdString();
+    RunAsync(m_cancel,
+        [journalDir]() {
+            std::vector<RecoveredJournal> journals;
+            wxArrayString files;
+            if (wxDir::Exists(journalDir)) wxDir::GetAllFiles(journalDir, &files, "*.journal", wxDIR_FILES);
+            for (const wxString& file : files) {
+                RecoveredJournal journal;
+                journal.path = file.ToStdString();
+                // Nothing to recover from a journal without edits
+                if (EditJournal::Read(journal.path, journal.base, journal.sessionBase, journal.options,
+                        journal.records) && !journal.records.empty())
+                    journals.push_back(std::move(journal));
+                else wxRemoveFile(file);
+            }
+            return journals;
+        },
+        [this](const std::vector<RecoveredJournal>& journals) {
+            if (journals.empty()) return;
+            wxString message = "Unsaved edits were found from a previous session that did not exit cleanly:\n";
+            for (const RecoveredJournal& journal : journals)
+                message += wxString::Format("\n%s (%zu edits)", wxString(journal.base), journal.records.size());
+            message += "\n\nReopen these models with the edits applied?";
+            if (wxMessageBox(message, "Recover Edits", wxYES_NO | wxICON_QUESTION, this) != wxYES) {
+                std::vector<std::string> paths;
+                for (const RecoveredJournal& journal : journals) paths.push_back(journal.path);
+                ThreadPool::Instance().Submit([paths]() {
+                    for (const std::string& path : paths) std::remove(path.c_str());
+                });
+                return;
+            }
+
+            SetStatusText(wxString::Format("Recovering %zu models...", journals.size()));
+            CancellationToken cancel = m_cancel;
+            RunAsync(m_cancel,
+                [journals, cancel]() {
+                    std::vector<RecoveredJournal> recovered = journals;
+                    ParallelFor(recovered.size(), [&](size_t begin, size_t end) {
+                        for (size_t i = begin; i < end; i++) {
+                            RecoveredJournal& journal = recovered[i];
+                            if (journal.sessionBase) {
+                                SessionState state;
+                                journal.scene = LoadSession(journal.base, state);
+                                journal.modelDir = state.modelDir;
+                            }
+                            else {
+                                journal.scene = ImportModel(journal.base, journal.options, cancel);
+                                journal.modelDir = journal.base;
+                            }
+                            if (!journal.scene) continue;
+                            for (const EditJournal::Record& record : journal.records)
+                                EditJournal::Apply(*journal.scene, record);
+                        }
+                    }, 1);
+                    return recovered;
+                },
+                [this](const std::vector<RecoveredJournal>& journals) {
+                    SetStatusText("");
+                    wxString failed;
+                    for (const RecoveredJournal& journal : journals) {
+                        // A model that no longer imports keeps its journal for a later try
+                        if (!journal.scene) {
+                            failed += "\n" + journal.base;
+                            continue;
+                        }
+                        // The edits move to a new journal, which deletes the old one
+                        // once it is on disk
+                        LoadedModel model = { journal.scene, journal.modelDir };
+                        if (journal.sessionBase) model.sessionPath = journal.base;
+                        model.journal = StartJournal(journal.base, journal.sessionBase, journal.options, journal.records,
+                            journal.path);
+                        AddModel(model);
+                    }
+                    if (!failed.empty())
+                        wxMessageBox("Failed to import for recovery:" + failed, "Error", wxICON_ERROR);
+                },
+                [](const std::vector<RecoveredJournal>& journals) {
+                    for (const RecoveredJournal& journal : journals) delete journal.scene;
+                });
+        },
+        [](const std::vector<RecoveredJournal>&) {});
+}
+
+MainFrame::LoadedModel* MainFrame::ActiveModel()
+{
+    for (auto& model : m_models)
+        if (model.scene == m_scene) return &model;
+    return nullptr;
+}
+
+void MainFrame::RebuildModelMenu()
+{
+    while (m_modelMenu->GetMenuItemCount() > 0)
+        m_modelMenu->Destroy(m_modelMenu->FindItemByPosition(0));
+    m_modelMenu->Append(ID_OpenModels, "Open Models (all sub directories)");
+    m_modelMenu->Append(ID_CloseModel, "Close Active Model");
+    m_modelMenu->Append(ID_ToggleModel, "Show/Hide Active Model");
+    m_modelMenu->Append(ID_CompareModels, "Compare Active Model With...");
+    m_modelMenu->AppendSeparator();
+    for (size_t i = 0; i < m_models.size() && ID_ModelFirst + (int)i <= ID_ModelLast; i++) {
+        wxString label = wxFileName(m_models[i].dir).GetFullName();
+        if (label.empty()) label = m_models[i].dir;
+        if (!m_models[i].visible) label += " (hidden)";
+        m_modelMenu->AppendRadioItem(ID_ModelFirst + i, label);
+        if (m_models[i].scene == m_scene) m_modelMenu->Check(ID_ModelFirst + i, true);
+    }
+}
+
+void MainFrame::OnCloseModel(wxCommandEvent& event)
+{
+    LoadedModel* model = ActiveModel();
+    if (!model) return;
+    Scene* scene = model->scene;
+    m_canvas->RemoveScene(scene);
+    // Closing drops unsaved edits; the writer is stopped off the UI thread
+    if (model->journal) {
+        std::shared_ptr<EditJournal> journal = model->journal;
+        ThreadPool::Instance().Submit([journal]() { journal->Discard(); });
+    }
+    for (const std::shared_ptr<EditJournal>& journal : model->exportJournals)
+        ThreadPool::Instance().Submit([journal]() { journal->Discard(); });
+    m_models.erase(m_models.begin() + (model - m_models.data()));
+    // Freeing the scene releases whatever no running export's snapshot still shares
+    delete scene;
+    m_scene = m_models.empty() ? nullptr : m_models.back().scene;
+    m_canvas->SetActiveScene(m_scene);
+    RebuildModelMenu();
+}
+
+void MainFrame::OnToggleModel(wxCommandEvent& event)
+{
+    LoadedModel* model = ActiveModel();
+    if (!model) return;
+    model->visible = !model->visible;
+    m_canvas->SetSceneVisible(model->scene, model->visible);
+    RebuildModelMenu();
+}
+
+void MainFrame::OnCompareModels(wxCommandEvent& event)
+{
+    LoadedModel* active = ActiveModel();
+    if (!active || m_models.size() < 2) {
+        wxMessageBox("Open the model to compare with as a second model first.", "Compare Models", wxICON_ERROR);
+        return;
+    }
+    std::vector<Scene*> others;
+    wxArrayString choices;
+    for (const LoadedModel& model : m_models) {
+        if (model.scene == m_scene) continue;
+        wxString label = wxFileName(model.dir).GetFullName();
+        choices.Add(label.empty() ? model.dir : label);
+        others.push_back(model.scene);
+    }
+    wxSingleChoiceDialog dialog(this, "Model the active one is compared against, e.g. the previous reconstruction",
+        "Compare Models", choices);
+    if (dialog.ShowModal() == wxID_CANCEL) return;
+
+    // Compared on snapshots off the UI thread; statuses are only shown if neither
+    // model was edited meanwhile
+    struct Comparison {
+        SceneDiff diff;
+        std::string report;
+    };
+    Scene* before = others[dialog.GetSelection()];
+    Scene* after = m_scene;
+    std::shared_ptr<const Scene> beforeSnapshot = before->Snapshot(), afterSnapshot = after->Snapshot();
+    SetStatusText("Comparing models...");
+    RunAsync(m_cancel,
+        [beforeSnapshot, afterSnapshot]() {
+            auto comparison = std::make_shared<Comparison>();
+            comparison->diff = DiffScenes(*beforeSnapshot, *afterSnapshot);
+            comparison->report = DiffReport(comparison->diff, *beforeSnapshot, *afterSnapshot);
+            return comparison;
+        },
+        [this, before, after, beforeSnapshot, afterSnapshot](std::shared_ptr<Comparison> comparison) {
+            SetStatusText("");
+            auto unchanged = [this](Scene* scene, const Scene& snapshot) {
+                for (const LoadedModel& model : m_models)
+                    if (model.scene == scene) return scene->Version() == snapshot.Version();
+                return false;
+            };
+            if (unchanged(before, *beforeSnapshot) && unchanged(after, *afterSnapshot)) {
+                SceneDiff& diff = comparison->diff;
+                m_canvas->SetChanges(before, std::move(diff.before_points), std::move(diff.before_images));
+                m_canvas->SetChanges(after, std::move(diff.after_points), std::move(diff.after_images));
+                m_canvas->SetColorMode(PointColorMode::Changes);
+                m_menuBar->Check(ID_ColorChanges, true);
+            }
+            wxMessageBox(comparison->report, "Model Comparison");
+        },
+        [](std::shared_ptr<Comparison>) {});
+}
+
+void MainFrame::OnSelectModel(wxCommandEvent& event)
+{
+    size_t index = event.GetId() - ID_ModelFirst;
+    if (index >= m_models.size()) return;
+    m_scene = m_models[index].scene;
+    m_canvas->SetActiveScene(m_scene);
+}
+
+void MainFrame::OnOpenSession(wxCommandEvent& event)
+{
+    wxFileDialog fileDialog(this, "Open session", "", "", "Session files (*.cesession)|*.cesession",
+        wxFD_OPEN | wxFD_FILE_MUST_EXIST);
+    if (fileDialog.ShowModal() == wxID_CANCEL) return;
+    wxString sessionPath = fileDialog.GetPath();
+
+    // Loaded on the pool like imports; the model journals against the session file,
+    // which a recovery loads again
+    SetStatusText("Opening " + sessionPath + "...");
+    struct OpenedSession {
+        Scene* scene = nullptr;
+        SessionState state;
+    };
+    std::string path = sessionPath.ToStdString();
+    RunAsync(m_cancel,
+        [path]() {
+            OpenedSession opened;
+            opened.scene = LoadSession(path, opened.state);
+            return opened;
+        },
+        [this, sessionPath](const OpenedSession& opened) {
+            SetStatusText("");
+            if (!opened.scene) {
+                wxMessageBox("Failed to open session file.", "Error", wxICON_ERROR);
+                return;
+            }
+            LoadedModel model = { opened.scene, opened.state.modelDir, sessionPath };
+            ImportOptions options;
+            options.float_observations = opened.scene->HasFloatObservations();
+            model.journal = StartJournal(sessionPath, true, options);
+            AddModel(model);
+            m_canvas->RestoreSessionState(opened.state);
+        },
+        [](const OpenedSession& opened) { delete opened.scene; });
+}
+
+void MainFrame::OnSaveSession(wxCommandEvent& event)
+{
+    if (!m_scene) {
+        wxMessageBox("No scene loaded.", "Error", wxICON_ERROR);
+        return;
+    }
+    LoadedModel* model = ActiveModel();
+    if (model->sessionPath.empty()) {
+        wxFileDialog fileDialog(this, "Save session", "", "", "Session files (*.cesession)|*.cesession",
+            wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+        if (fileDialog.ShowModal() == wxID_CANCEL) return;
+        model->sessionPath = fileDialog.GetPath();
+    }
+
+    SessionState state;
+    m_canvas->GetSessionState(state);
+    state.modelDir = model->dir.ToStdString();
+    // A model opened from this session journals against it. Editing goes on while the
+    // file is written, so the edits made meanwhile go to a journal of their own that
+    // replaces the model's once the session is saved.
+    std::shared_ptr<EditJournal> followUp;
+    if (model->journal && model->journal->SessionBase()) {
+        followUp = StartJournal(model->sessionPath, true, model->journal->Options());
+        model->exportJournals.push_back(followUp);
+    }
+
+    // Taking the snapshot is O(1); the file image is built and written on the saver thread
+    SetStatusText("Saving session...");
+    Scene* scene = m_scene;
+    m_sessionSaver.Save(model->sessionPath.ToStdString(), m_scene->Snapshot(), std::move(state),
+        [this, scene, followUp](bool ok, const std::string& path) {
+            CallAfter([this, scene, followUp, ok, path]() {
+                SetStatusText(ok ? "Session saved to " + path : "Failed to save session to " + path);
+                if (!followUp) return;
+                // The saver writes only the newest of the saves queued while it was busy,
+                // so the journals of earlier ones are done with as well. A closed model
+                // has discarded its journals already.
+                std::vector<std::shared_ptr<EditJournal>> unused = { followUp };
+                for (auto& model : m_models) {
+                    auto& pending = model.exportJournals;
+                    auto found = std::find(pending.begin(), pending.end(), followUp);
+                    if (model.scene != scene || found == pending.end()) continue;
+                    unused.assign(pending.begin(), found + 1);
+                    pending.erase(pending.begin(), found + 1);
+                    // The file holds the snapshot now, the edits since are all a reload lacks
+                    if (ok) std::swap(model.journal, unused.back());
+                }
+                ThreadPool::Instance().Submit([unused]() {
+                    for (const std::shared_ptr<EditJournal>& journal : unused) journal->Discard();
+                });
+            });
+        });
+}
+
+// Whether an export to dir with the given compression writes the files a re-import
+// of dir reads: FindModelFile prefers plain files, then .gz, then .zst, so none of
+// those ahead of the written ones may exist
+static bool ExportReplacesModel(const wxString& dir, Compression compression)
+{
+    const Compression order[] = { Compression::None, Compression::Gzip, Compression::Zstd };
+    for (const char* name : { "\\points3D.txt", "\\cameras.txt", "\\images.txt" }) {
+        for (Compression ahead : order) {
+            if (ahead == compression) break;
+            if (wxFileExists(dir + name + CompressionExtension(ahead))) return false;
+        }
+    }
+    return true;
+}
+
 void MainFrame::OnExportColmapFiles(wxCommandEvent& event) {
     if (!m_scene) {
         wxMessageBox("No scene loaded.", "Error", wxICON_ERROR);
@@ -134,15 +735,200 @@ void MainFrame::OnExportColmapFiles(wxCommandEvent& event) {
     wxDirDialog dirDialog(this, "Select COLMAP sparse directory", "", wxDD_DEFAULT_STYLE | wxDD_DIR_MUST_EXIST);
     if (dirDialog.ShowModal() == wxID_CANCEL) return;
     wxString dirPath = dirDialog.GetPath();
-    wxString pointsPath = dirPath + "\\points3D.txt";
-    wxString camerasPath = dirPath + "\\cameras.txt";
-    wxString imagesPath = dirPath + "\\images.txt";
+    Compression compression = Compression::None;
+    if (m_menuBar->IsChecked(ID_ExportGzip)) compression = Compression::Gzip;
+    else if (m_menuBar->IsChecked(ID_ExportZstd)) compression = Compression::Zstd;
+    wxString ext = CompressionExtension(compression);
+    wxString pointsPath = dirPath + "\\points3D.txt" + ext;
+    wxString camerasPath = dirPath + "\\cameras.txt" + ext;
+    wxString imagesPath = dirPath + "\\images.txt" + ext;
+
+    // Saved over the model it was imported from, which a re-import then finds with
+    // the edits in it, unless files FindModelFile prefers are left in the directory.
+    // Editing goes on while the export runs, so the edits made meanwhile go to a
+    // journal of their own that replaces the model's once the files are written.
+    LoadedModel* model = ActiveModel();
+    std::shared_ptr<EditJournal> followUp;
+    if (model->journal && !model->journal->SessionBase() &&
+        wxFileName::DirName(dirPath).SameAs(wxFileName::DirName(model->dir)) && ExportReplacesModel(dirPath, compression)) {
+        followUp = StartJournal(model->dir, false, model->journal->Options());
+        model->exportJournals.push_back(followUp);
+    }
 
-    bool ok = m_scene->Export(pointsPath.ToStdString(), camerasPath.ToStdString(), imagesPath.ToStdString());
-    if (!ok) {
-        wxMessageBox("Failed to export COLMAP files.", "Error", wxICON_ERROR);
+    // Written from a snapshot on the pool, later edits leave it as it was
+    SetStatusText("Exporting to " + dirPath + "...");
+    std::shared_ptr<const Scene> snapshot = m_scene->Snapshot();
+    Scene* scene = m_scene;
+    std::string points = pointsPath.ToStdString(), cameras = camerasPath.ToStdString(),
+        images = imagesPath.ToStdString();
+    RunAsync(m_cancel,
+        [snapshot, points, cameras, images]() { return snapshot->Export(points, cameras, images); },
+        [this, scene, followUp, dirPath](bool ok) {
+            SetStatusText(ok ? "Exported to " + dirPath : "");
+            if (!ok) wxMessageBox("Failed to export COLMAP files.", "Error", wxICON_ERROR);
+            if (!followUp) return;
+            // A closed model has discarded its journals already
+            std::shared_ptr<EditJournal> unused = followUp;
+            for (auto& model : m_models) {
+                auto& pending = model.exportJournals;
+                auto found = std::find(pending.begin(), pending.end(), followUp);
+                if (model.scene != scene || found == pending.end()) continue;
+                pending.erase(found);
+                // The files hold the snapshot now, the edits since are all a re-import lacks
+                if (ok) std::swap(model.journal, unused);
+            }
+            ThreadPool::Instance().Submit([unused]() { unused->Discard(); });
+        },
+        [](bool) {});
+}
+
+void MainFrame::OnImportPly(wxCommandEvent& event)
+{
+    wxFileDialog fileDialog(this, "Import PLY point cloud", "", "", "PLY files (*.ply)|*.ply",
+        wxFD_OPEN | wxFD_FILE_MUST_EXIST);
+    if (fileDialog.ShowModal() == wxID_CANCEL) return;
+    wxString path = fileDialog.GetPath();
+
+    SetStatusText("Importing " + path + "...");
+    std::string plyPath = path.ToStdString();
+    CancellationToken cancel = m_cancel;
+    RunAsync(m_cancel,
+        [plyPath, cancel]() {
+            Scene* scene = new Scene();
+            if (!scene->ImportPLY(plyPath, &cancel)) {
+                delete scene;
+                return static_cast<Scene*>(nullptr);
+            }
+            return scene;
+        },
+        [this, path](Scene* scene) {
+            SetStatusText("");
+            if (!scene) {
+                wxMessageBox("Failed to import " + path + ". Only binary little-endian PLY files are supported.",
+                    "Error", wxICON_ERROR);
+                return;
+            }
+            AddModel({ scene, path });
+        },
+        [](Scene* scene) { delete scene; });
+}
+
+void MainFrame::OnExportPly(wxCommandEvent& event)
+{
+    if (!m_scene) {
+        wxMessageBox("No scene loaded.", "Error", wxICON_ERROR);
         return;
     }
+    bool selectedOnly = event.GetId() == ID_ExportSelectedPly;
+    SessionState state;
+    if (selectedOnly) {
+        m_canvas->GetSessionState(state);
+        if (state.selectedPoints.empty()) {
+            wxMessageBox("No points selected.", "Error", wxICON_ERROR);
+            return;
+        }
+    }
+
+    wxFileDialog fileDialog(this, "Export PLY point cloud", "", "points.ply", "PLY files (*.ply)|*.ply",
+        wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+    if (fileDialog.ShowModal() == wxID_CANCEL) return;
+    // Selection positions match the snapshot, which is taken before any further edit
+    SetStatusText("Exporting " + fileDialog.GetPath() + "...");
+    std::shared_ptr<const Scene> snapshot = m_scene->Snapshot();
+    std::string path = fileDialog.GetPath().ToStdString();
+    std::vector<int> selection = std::move(state.selectedPoints);
+    RunAsync(m_cancel,
+        [snapshot, path, selection, selectedOnly]() {
+            return snapshot->ExportPLY(path, selectedOnly ? &selection : nullptr);
+        },
+        [this](bool ok) {
+            SetStatusText("");
+            if (!ok) wxMessageBox("Failed to export PLY file.", "Error", wxICON_ERROR);
+        },
+        [](bool) {});
+}
+
+void MainFrame::OnConsolidate(wxCommandEvent& event)
+{
+    if (!m_scene) {
+        wxMessageBox("No scene loaded.", "Error", wxICON_ERROR);
+        return;
+    }
+
+    wxArrayString choices;
+    choices.Add("Remove dangling observations (otherwise set to -1)");
+    choices.Add("Renumber point IDs densely");
+    choices.Add("Renumber image IDs densely");
+    wxMultiChoiceDialog dialog(this, "Repair references left by deletions", "Consolidate Model", choices);
+    if (dialog.ShowModal() == wxID_CANCEL) return;
+    wxArrayInt picked = dialog.GetSelections();
+
+    ConsolidateOptions options;
+    for (size_t i = 0; i < picked.size(); i++)
+    {
+        if (picked[i] == 0) options.remove_dangling = true;
+        else if (picked[i] == 1) options.renumber_points = true;
+        else if (picked[i] == 2) options.renumber_images = true;
+    }
+    ConsolidateStats stats = m_scene->Consolidate(options);
+    RecordEdit(m_scene, JournalEdit::Consolidate,
+        { options.remove_dangling, options.renumber_points, options.renumber_images });
+    m_canvas->ReloadScene();
+
+    wxMessageBox(wxString::Format("Dangling observations: %zu\nDangling track elements: %zu\nRemoved points: %zu",
+        stats.dangling_observations, stats.dangling_track_elements, stats.removed_points), "Consolidate Model");
+}
+
+void MainFrame::OnReprojectionErrors(wxCommandEvent& event)
+{
+    if (!m_scene) {
+        wxMessageBox("No scene loaded.", "Error", wxICON_ERROR);
+        return;
+    }
+
+    ReprojectionStats stats = m_scene->UpdateReprojectionErrors();
+    RecordEdit(m_scene, JournalEdit::ReprojectionErrors, {});
+    m_canvas->PointValuesChanged();
+    wxString message = wxString::Format("Points updated: %zu\nPoints without usable observations: %zu\n"
+        "Observations: %zu\nMean reprojection error: %.4f px",
+        stats.points, stats.unmeasured_points, stats.observations, stats.mean_error);
+    if (stats.unknown_cameras > 0)
+        message += wxString::Format("\nCameras with unsupported models: %zu", stats.unknown_cameras);
+    wxMessageBox(message, "Reprojection Errors");
+}
+
+void MainFrame::OnTransformModel(wxCommandEvent& event)
+{
+    if (!m_scene) {
+        wxMessageBox("No scene loaded.", "Error", wxICON_ERROR);
+        return;
+    }
+    wxString value = wxGetTextFromUser("Similarity transform X' = s * R * X + t as \"s qw qx qy qz tx ty tz\", "
+        "R given as a quaternion like the image rotations.", "Transform Model", "1 1 0 0 0 0 0 0", this);
+    if (value.empty()) return;
+    std::vector<double> v;
+    for (const wxString& part : wxSplit(value.Trim().Trim(false), ' ')) {
+        double number;
+        if (part.empty()) continue;
+        if (!part.ToDouble(&number)) {
+            v.clear();
+            break;
+        }
+        v.push_back(number);
+    }
+    bool parsed = v.size() == 8;
+    SimilarityTransform transform;
+    if (parsed) {
+        transform.scale = v[0];
+        std::copy(v.begin() + 1, v.begin() + 5, transform.qvec.begin());
+        std::copy(v.begin() + 5, v.end(), transform.translation.begin());
+    }
+    if (!parsed || !m_scene->Transform(transform)) {
+        wxMessageBox("Expected eight numbers with a positive scale and a nonzero quaternion.", "Error", wxICON_ERROR);
+        return;
+    }
+    RecordEdit(m_scene, JournalEdit::Transform, EditJournal::TransformValues(transform));
+    m_canvas->SceneTransformed(transform);
 }
 
 void MainFrame::OnIncreasePointSize(wxCommandEvent& event)
@@ -167,7 +953,6 @@ void MainFrame::OnDecreaseCamSize(wxCommandEvent& event)
 
 
 void MainFrame::OnDeleteSelected(wxCommandEvent& event) {
-    // TODO: Delete selected points in OSGCanvas
     m_canvas->DeleteSelected();
 }
 
@@ -176,16 +961,137 @@ void MainFrame::OnInvertSelected(wxCommandEvent& event)
     m_canvas->InvertSelected();
 }
 
+void MainFrame::OnSelectObservedPoints(wxCommandEvent& event)
+{
+    m_canvas->SelectObservedPoints();
+}
+
+void MainFrame::OnSelectObservingCameras(wxCommandEvent& event)
+{
+    m_canvas->SelectObservingCameras();
+}
+
+void MainFrame::OnSelectInFrustum(wxCommandEvent& event)
+{
+    m_canvas->SelectPointsInFrustum();
+}
+
+void MainFrame::OnFrustumDepthRange(wxCommandEvent& event)
+{
+    wxString value = wxGetTextFromUser("Minimum and maximum depth, e.g. \"0.5 20\". Leave empty for no limit.",
+        "Frustum Depth Range", "", this);
+    double minDepth = 0, maxDepth = std::numeric_limits<double>::infinity();
+    wxArrayString parts = wxSplit(value.Trim().Trim(false), ' ');
+    if (parts.size() >= 1 && !parts[0].empty() && !parts[0].ToDouble(&minDepth)) minDepth = 0;
+    if (parts.size() >= 2 && !parts[1].ToDouble(&maxDepth)) maxDepth = std::numeric_limits<double>::infinity();
+    m_canvas->SetFrustumDepthRange(minDepth, maxDepth);
+}
+
+void MainFrame::OnSelectWeakCameras(wxCommandEvent& event)
+{
+    if (!m_scene) {
+        wxMessageBox("No scene loaded.", "Error", wxICON_ERROR);
+        return;
+    }
+    wxString value = wxGetTextFromUser("Fewest covisible cameras and fewest shared points for a camera to count "
+        "as covisible, e.g. \"5 15\".", "Weakly Connected Cameras", "5 15", this);
+    if (value.empty()) return;
+    unsigned long minPartners = 5, minShared = 15;
+    wxArrayString parts = wxSplit(value.Trim().Trim(false), ' ');
+    if (parts.size() >= 1 && !parts[0].ToULong(&minPartners)) minPartners = 5;
+    if (parts.size() >= 2 && !parts[1].ToULong(&minShared)) minShared = 15;
+
+    wxBusyCursor busy;
+    CovisibilityGraph graph = m_scene->BuildCovisibilityGraph(static_cast<uint32_t>(std::max(minShared, 1ul)));
+    std::vector<int> weak = graph.WeakImages(minPartners);
+    m_canvas->SelectCameras(weak);
+    SetStatusText(wxString::Format("%zu of %zu cameras have fewer than %lu covisible cameras",
+        weak.size(), graph.NumImages(), minPartners));
+}
+
+void MainFrame::OnSelectCameraComponent(wxCommandEvent& event)
+{
+    if (!m_scene) {
+        wxMessageBox("No scene loaded.", "Error", wxICON_ERROR);
+        return;
+    }
+    wxString value = wxGetTextFromUser("Fewest shared points that connect two cameras.",
+        "Connected Camera Groups", "15", this);
+    if (value.empty()) return;
+    unsigned long minShared = 15;
+    if (!value.Trim().Trim(false).ToULong(&minShared)) minShared = 15;
+
+    std::vector<std::vector<int>> components;
+    {
+        wxBusyCursor busy;
+        components = m_scene->BuildCovisibilityGraph(static_cast<uint32_t>(std::max(minShared, 1ul))).Components();
+    }
+    if (components.empty()) return;
+    wxArrayString choices;
+    for (size_t i = 0; i < components.size(); i++)
+        choices.Add(wxString::Format("Group %zu: %zu cameras", i + 1, components[i].size()));
+    wxSingleChoiceDialog dialog(this, wxString::Format("%zu groups of cameras linked by at least %lu shared points",
+        components.size(), minShared), "Connected Camera Groups", choices);
+    if (dialog.ShowModal() == wxID_CANCEL) return;
+    m_canvas->SelectCameras(components[dialog.GetSelection()]);
+}
+
+void MainFrame::OnColorMode(wxCommandEvent& event)
+{
+    m_canvas->SetColorMode(static_cast<PointColorMode>(event.GetId() - ID_ColorRgb));
+}
+
+void MainFrame::OnColormap(wxCommandEvent& event)
+{
+    m_canvas->SetColormap(static_cast<Colormap>(event.GetId() - ID_ColormapViridis));
+}
+
+void MainFrame::OnColorRange(wxCommandEvent& event)
+{
+    PointColorMode mode = m_canvas->GetColorMode();
+    if (mode == PointColorMode::Rgb || mode == PointColorMode::ImageMembership || mode == PointColorMode::Changes) {
+        wxMessageBox("Pick height, reprojection error or track length coloring first.", "Color Range");
+        return;
+    }
+    wxString value = wxGetTextFromUser("Values at the two ends of the colormap, e.g. \"0 2.5\". "
+        "Leave empty for the model's full range.", "Color Range", "", this);
+    double minValue, maxValue;
+    wxArrayString parts = wxSplit(value.Trim().Trim(false), ' ');
+    if (parts.size() >= 2 && parts[0].ToDouble(&minValue) && parts[1].ToDouble(&maxValue))
+        m_canvas->SetColorRange(static_cast<float>(minValue), static_cast<float>(maxValue));
+    else m_canvas->SetColorMode(mode);
+}
+
+void MainFrame::OnViewLayout(wxCommandEvent& event)
+{
+    m_canvas->SetViewLayout(static_cast<OSGCanvas::ViewLayout>(event.GetId() - ID_LayoutSingle));
+}
+
+void MainFrame::OnShowPhotos(wxCommandEvent& event)
+{
+    // Images are looked up by their names in images.txt, relative to this folder
+    wxDirDialog dirDialog(this, "Select the folder holding the images", "", wxDD_DEFAULT_STYLE | wxDD_DIR_MUST_EXIST);
+    if (dirDialog.ShowModal() == wxID_CANCEL) return;
+    m_canvas->SetImageRoot(dirDialog.GetPath());
+}
+
+void MainFrame::OnHidePhotos(wxCommandEvent& event)
+{
+    m_canvas->SetImageRoot("");
+}
+
 void MainFrame::OnResetView(wxCommandEvent& event)
 {
     m_canvas->ResetView();
 }
 
 void MainFrame::OnExit(wxCommandEvent& event) {
-    if (m_scene) {
-        delete m_scene;
-        m_scene = nullptr;
+    for (auto& model : m_models) {
+        m_canvas->RemoveScene(model.scene);
+        delete model.scene;
     }
+    m_models.clear();
+    m_scene = nullptr;
     Close(true);
 }
 
@@ -210,3 +1116,11 @@ void MainFrame::OnModeRectangleCam(wxCommandEvent& event) {
 void MainFrame::OnModePolygonCam(wxCommandEvent& event) {
     if (m_canvas) m_canvas->SetCursorMode(OSGCanvas::MODE_POLYGON_CAMERA);
 }
+
+void MainFrame::OnModeLasso(wxCommandEvent& event) {
+    if (m_canvas) m_canvas->SetCursorMode(OSGCanvas::MODE_LASSO);
+}
+
+void MainFrame::OnVisibleOnly(wxCommandEvent& event) {
+    if (m_canvas) m_canvas->SetVisibleOnly(event.IsChecked());
+}
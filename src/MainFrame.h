@@ -4,7 +4,11 @@
 #include <wx/menu.h>
 #include <wx/panel.h>
 #include <wx/sizer.h>
+#include <memory>
+#include "EditJournal.h"
+#include "Parallel.h"
 #include "Scene.h"
+#include "Session.h"
 
 class OSGCanvas;
 
@@ -12,29 +16,81 @@ class OSGCanvas;
 class MainFrame : public wxFrame {
 public:
     MainFrame(const wxString& title);
+    ~MainFrame();
 private:
     void OnModeNormal(wxCommandEvent& event);
     void OnModeRectangle(wxCommandEvent& event);
     void OnModePolygon(wxCommandEvent& event);
     void OnModeRectangleCam(wxCommandEvent& event);
     void OnModePolygonCam(wxCommandEvent& event);
+    void OnModeLasso(wxCommandEvent& event);
+    void OnVisibleOnly(wxCommandEvent& event);
     void OnOpenColmapFiles(wxCommandEvent& event);
     void OnExportColmapFiles(wxCommandEvent& event);
+    void OnImportPly(wxCommandEvent& event);
+    void OnExportPly(wxCommandEvent& event);
+    void OnConsolidate(wxCommandEvent& event);
+    void OnReprojectionErrors(wxCommandEvent& event);
+    void OnTransformModel(wxCommandEvent& event);
+    void OnOpenSession(wxCommandEvent& event);
+    void OnSaveSession(wxCommandEvent& event);
+    void OnOpenModels(wxCommandEvent& event);
+    void OnCloseModel(wxCommandEvent& event);
+    void OnToggleModel(wxCommandEvent& event);
+    void OnCompareModels(wxCommandEvent& event);
+    void OnSelectModel(wxCommandEvent& event);
     void OnExit(wxCommandEvent& event);
     void OnDeleteSelected(wxCommandEvent& event);
     void OnInvertSelected(wxCommandEvent& event);
+    void OnSelectObservedPoints(wxCommandEvent& event);
+    void OnSelectObservingCameras(wxCommandEvent& event);
+    void OnSelectInFrustum(wxCommandEvent& event);
+    void OnFrustumDepthRange(wxCommandEvent& event);
+    void OnSelectWeakCameras(wxCommandEvent& event);
+    void OnSelectCameraComponent(wxCommandEvent& event);
     void OnResetView(wxCommandEvent& event);
     void OnIncreasePointSize(wxCommandEvent& event);
     void OnDecreasePointSize(wxCommandEvent& event);
     void OnIncreaseCamSize(wxCommandEvent& event);
     void OnDecreaseCamSize(wxCommandEvent& event);
+    void OnColorMode(wxCommandEvent& event);
+    void OnColormap(wxCommandEvent& event);
+    void OnColorRange(wxCommandEvent& event);
+    void OnViewLayout(wxCommandEvent& event);
+    void OnShowPhotos(wxCommandEvent& event);
+    void OnHidePhotos(wxCommandEvent& event);
 	void OnAbout(wxCommandEvent& event);
 
+    struct LoadedModel {
+        Scene* scene;
+        wxString dir; // directory the model was imported from
+        wxString sessionPath;
+        bool visible = true;
+        std::shared_ptr<EditJournal> journal; // against dir, or against sessionPath for models opened from it
+        // Edits made while exports over dir or saves over sessionPath run, each journal
+        // taking over once its file is written
+        std::vector<std::shared_ptr<EditJournal>> exportJournals;
+    };
+    void AddModel(const LoadedModel& model);
+    std::shared_ptr<EditJournal> StartJournal(const wxString& base, bool sessionBase, const ImportOptions& options,
+        const std::vector<EditJournal::Record>& records = std::vector<EditJournal::Record>(),
+        const std::string& replaces = std::string());
+    void RecordEdit(Scene* scene, JournalEdit edit, std::vector<int> values);
+    void RecoverJournals();
+    LoadedModel* ActiveModel();
+    void RebuildModelMenu();
+
     OSGCanvas* m_canvas;
     wxPanel* m_panel;
     wxMenuBar* m_menuBar;
     wxBoxSizer* m_sizer;
-    class Scene* m_scene = nullptr;
+    wxMenu* m_modelMenu;
+    std::vector<LoadedModel> m_models;
+    class Scene* m_scene = nullptr; // scene of the active model
+    SessionSaver m_sessionSaver;
+    CancellationToken m_cancel; // cancelled when the frame goes away, stops pending imports
+    wxString m_journalDir;
+    int m_journalsStarted = 0;
 
     wxDECLARE_EVENT_TABLE();
 };
@@ -0,0 +1,218 @@
+#include "ModelFilter.h"
+#include "CompressedFile.h"
+#include "Parallel.h"
+#include "TextParsing.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+
+bool PointFilter::Keeps(const PointLine& point) const
+{
+	if (use_box) {
+		const double xyz[3] = { point.x, point.y, point.z };
+		for (int i = 0; i < 3; ++i)
+			if (!(xyz[i] >= box_min[i] && xyz[i] <= box_max[i])) return false;
+	}
+	if (point.error > max_error) return false;
+	if (point.track.size() / 2 < min_track_length) return false;
+	if (id_list != IdList::None) {
+		bool listed = std::binary_search(ids.begin(), ids.end(), point.id);
+		if (listed != (id_list == IdList::Keep)) return false;
+	}
+	return true;
+}
+
+// One bit per point id, enough for the ids of the removed points of any model
+class IdBits {
+public:
+	void Insert(int id)
+	{
+		if (id < 0) return;
+		size_t word = static_cast<size_t>(id) >> 6;
+		if (word >= bits_.size()) bits_.resize(std::max(word + 1, bits_.size() * 2));
+		bits_[word] |= uint64_t(1) << (id & 63);
+	}
+	bool Contains(int id) const
+	{
+		if (id < 0) return false;
+		size_t word = static_cast<size_t>(id) >> 6;
+		return word < bits_.size() && (bits_[word] >> (id & 63)) & 1;
+	}
+
+private:
+	std::vector<uint64_t> bits_;
+};
+
+// Read up to `count` chunks, false if there were none left
+static bool NextBatch(TextStreamReader& reader, std::vector<std::string>& batch, size_t count)
+{
+	batch.clear();
+	std::string chunk;
+	while (batch.size() < count && reader.Next(chunk)) batch.push_back(std::move(chunk));
+	return !batch.empty();
+}
+
+static bool Cancelled(const CancellationToken* cancel)
+{
+	return cancel && cancel->IsCancelled();
+}
+
+// Whether the line after the ones in [p, end) is the points line of an image, given
+// whether the first one is
+static bool EndsBeforePointsLine(const char* p, const char* end, bool points_line)
+{
+	while (p < end) {
+		const char* line_end = LineEnd(p, end);
+		points_line = !points_line && IsDataLine(p, line_end);
+		p = line_end < end ? line_end + 1 : end;
+	}
+	return points_line;
+}
+
+// Copy a points line of images.txt, every third field being a point id, with the
+// removed ids replaced by -1. Returns how many were replaced.
+static size_t NullRemoved(const char* p, const char* end, const IdBits& removed, std::string& out)
+{
+	size_t nulled = 0;
+	const char* copied = p;
+	for (int field = 0;; ++field) {
+		while (p < end && IsFieldSpace(*p)) ++p;
+		if (p == end) break;
+		const char* begin = p;
+		while (p < end && !IsFieldSpace(*p)) ++p;
+		int id;
+		if (field % 3 != 2 || std::from_chars(begin, p, id).ptr != p || !removed.Contains(id)) continue;
+		out.append(copied, begin);
+		out += "-1";
+		copied = p;
+		++nulled;
+	}
+	out.append(copied, end);
+	return nulled;
+}
+
+static bool CopyFile(const std::string& from, const std::string& to)
+{
+	TextStreamReader reader;
+	TextFileWriter writer;
+	if (!reader.Open(from) || !writer.Open(to)) return false;
+	std::string chunk;
+	while (reader.Next(chunk)) writer.Write(std::move(chunk));
+	bool read = reader.Close();
+	return writer.Close() && read;
+}
+
+bool FilterModel(const ModelFiles& input, const ModelFiles& output, const PointFilter& filter,
+	FilterStats* stats, const CancellationToken* cancel)
+{
+	FilterStats counts;
+	std::string points_path = FindModelFile(input.points);
+	std::string cameras_path = FindModelFile(input.cameras);
+	std::string images_path = FindModelFile(input.images);
+	if (points_path.empty() || cameras_path.empty() || images_path.empty()) return false;
+
+	// Reading, filtering and writing overlap: the reader and writer threads work on
+	// their chunks while the pool filters a batch of one chunk per thread
+	const size_t batchSize = ThreadPool::Instance().Concurrency();
+	std::vector<std::string> batch;
+	std::vector<std::string> kept(batchSize);
+	IdBits removed;
+
+	// Pass 1: points3D.txt
+	{
+		TextStreamReader reader;
+		TextFileWriter writer;
+		if (!reader.Open(points_path) || !writer.Open(output.points)) return false;
+		std::vector<std::vector<int>> removedIds(batchSize);
+		std::vector<size_t> read(batchSize), written(batchSize);
+		while (!Cancelled(cancel) && NextBatch(reader, batch, batchSize)) {
+			ParallelFor(batch.size(), [&](size_t begin, size_t end) {
+				PointLine point;
+				for (size_t c = begin; c < end; ++c) {
+					kept[c].clear();
+					removedIds[c].clear();
+					read[c] = written[c] = 0;
+					const char* p = batch[c].data();
+					const char* chunk_end = p + batch[c].size();
+					while (p < chunk_end) {
+						const char* line = p;
+						const char* line_end = LineEnd(line, chunk_end);
+						p = line_end < chunk_end ? line_end + 1 : chunk_end;
+						// Comments and lines Import would skip pass through unchanged
+						if (IsDataLine(line, line_end) && ParsePointLine(line, line_end, point)) {
+							++read[c];
+							if (!filter.Keeps(point)) {
+								removedIds[c].push_back(point.id);
+								continue;
+							}
+							++written[c];
+						}
+						kept[c].append(line, line_end);
+						kept[c] += '\n';
+					}
+				}
+			}, 1);
+			for (size_t c = 0; c < batch.size(); ++c) {
+				for (int id : removedIds[c]) removed.Insert(id);
+				counts.points_read += read[c];
+				counts.points_kept += written[c];
+				writer.Write(std::move(kept[c]));
+			}
+		}
+		bool readOk = reader.Close();
+		if (!writer.Close() || !readOk || Cancelled(cancel)) return false;
+	}
+
+	// Pass 2: images.txt. Each image has a header and a points line, so a serial scan
+	// finds whether a chunk starts in the middle of an image before the pool
+	// rewrites the chunks.
+	{
+		TextStreamReader reader;
+		TextFileWriter writer;
+		if (!reader.Open(images_path) || !writer.Open(output.images)) return false;
+		std::vector<char> startsWithPoints(batchSize);
+		std::vector<size_t> images(batchSize), nulled(batchSize);
+		bool points_line = false;
+		while (!Cancelled(cancel) && NextBatch(reader, batch, batchSize)) {
+			for (size_t c = 0; c < batch.size(); ++c) {
+				startsWithPoints[c] = points_line;
+				points_line = EndsBeforePointsLine(batch[c].data(), batch[c].data() + batch[c].size(), points_line);
+			}
+			ParallelFor(batch.size(), [&](size_t begin, size_t end) {
+				for (size_t c = begin; c < end; ++c) {
+					kept[c].clear();
+					images[c] = nulled[c] = 0;
+					bool points = startsWithPoints[c] != 0;
+					const char* p = batch[c].data();
+					const char* chunk_end = p + batch[c].size();
+					while (p < chunk_end) {
+						const char* line = p;
+						const char* line_end = LineEnd(line, chunk_end);
+						p = line_end < chunk_end ? line_end + 1 : chunk_end;
+						if (points) {
+							++images[c];
+							nulled[c] += NullRemoved(line, line_end, removed, kept[c]);
+							points = false;
+						}
+						else {
+							kept[c].append(line, line_end);
+							points = IsDataLine(line, line_end);
+						}
+						kept[c] += '\n';
+					}
+				}
+			}, 1);
+			for (size_t c = 0; c < batch.size(); ++c) {
+				counts.images += images[c];
+				counts.observations_removed += nulled[c];
+				writer.Write(std::move(kept[c]));
+			}
+		}
+		bool readOk = reader.Close();
+		if (!writer.Close() || !readOk || Cancelled(cancel)) return false;
+	}
+
+	if (!CopyFile(cameras_path, output.cameras)) return false;
+	if (stats) *stats = counts;
+	return true;
+}
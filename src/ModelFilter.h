@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <vector>
+
+class CancellationToken;
+struct PointLine;
+
+// Which points of points3D.txt survive FilterModel; a point has to pass every test
+struct PointFilter {
+    enum class IdList { None, Keep, Remove };
+
+    bool use_box = false;
+    double box_min[3] = { 0, 0, 0 };
+    double box_max[3] = { 0, 0, 0 };
+    double max_error = std::numeric_limits<double>::infinity();
+    size_t min_track_length = 0; // observations, not track ints
+    IdList id_list = IdList::None;
+    std::vector<int> ids; // ascending
+
+    bool Keeps(const PointLine& point) const;
+};
+
+struct ModelFiles {
+    std::string points;
+    std::string cameras;
+    std::string images;
+};
+
+struct FilterStats {
+    size_t points_read = 0;
+    size_t points_kept = 0;
+    size_t images = 0;
+    size_t observations_removed = 0; // point ids in images.txt set to -1
+};
+
+// Write a copy of a text model holding just the points filter keeps, without ever
+// loading it: points3D.txt is streamed through once, kept lines copied verbatim,
+// then images.txt is streamed with the observations of removed points set to -1,
+// and cameras.txt copied. Memory stays at a few chunks per thread plus a bit per
+// point id. Inputs may be compressed; outputs are compressed by their extension.
+// Returns false if a file could not be read or written, or once cancel is cancelled.
+bool FilterModel(const ModelFiles& input, const ModelFiles& output, const PointFilter& filter,
+                 FilterStats* stats = nullptr, const CancellationToken* cancel = nullptr);
@@ -4,12 +4,17 @@
 #include "OSGCanvas.h"
 #include <osgViewer/ViewerEventHandlers>
 #include <osgGA/TrackballManipulator>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
 #include <vector>
 #include <wx/dcclient.h>
 #include <osg/ComputeBoundsVisitor>
-#include <osg/Point>
 #include <osg/LineWidth>
-#include <osg/BlendFunc>
+#include <osg/Point>
+#include "DepthBuffer.h"
+#include "Parallel.h"
+#include "SceneGraph.h"
 
 wxBEGIN_EVENT_TABLE(OSGCanvas, wxGLCanvas)
     EVT_PAINT(OSGCanvas::OnPaint)
@@ -24,16 +29,15 @@ OSGCanvas::OSGCanvas(wxWindow* parent)
 {
     m_gc = new GraphicsWindowWX(this);
     m_glContext = new wxGLContext(this);
-    int w, h;
-    GetClientSize(&w, &h);
-    m_viewer = new osgViewer::Viewer;
+    m_viewer = new osgViewer::CompositeViewer;
+    // Frames are drawn from the paint handler, on the thread owning the wx context
+    m_viewer->setThreadingModel(osgViewer::ViewerBase::SingleThreaded);
     m_root = new osg::Group;
-    m_viewer->setSceneData(m_root.get());
-    m_viewer->setCameraManipulator(new osgGA::TrackballManipulator);
-    m_viewer->getCamera()->setGraphicsContext(m_gc.get());
-    m_viewer->getCamera()->setViewport(new osg::Viewport(0, 0, w, h));
-    m_viewer->getCamera()->setProjectionMatrixAsPerspective(45.0f, static_cast<double>(w)/h, 0.1, 1000.0);
-    m_viewer->getCamera()->setClearColor(osg::Vec4(1.0f, 1.0f, 1.0f, 1.0f)); // dark background
+    AddView(VIEW_FREE);
+    LayoutViews();
+    m_shading = CreatePointShading();
+    // Photos finish loading on the pool, the next frame places them
+    m_photos.SetReadyCallback([this]() { CallAfter([this]() { Refresh(false); }); });
 
     long style = GetWindowStyle();
     style |= wxWANTS_CHARS;
@@ -45,13 +49,286 @@ void OSGCanvas::SetContextCurrent()
     m_glContext->SetCurrent(*this);
 }
 
+// Node mask bits of the selection overlay, one per view; every other node keeps its
+// default mask and is drawn by all views
+static const osg::Node::NodeMask kOverlayMask = 0xff;
+
+void OSGCanvas::AddView(ViewDirection direction)
+{
+    osg::ref_ptr<osgViewer::View> view = new osgViewer::View;
+    view->setSceneData(m_root.get());
+    view->setCameraManipulator(new osgGA::TrackballManipulator);
+    osg::Camera* camera = view->getCamera();
+    camera->setGraphicsContext(m_gc.get());
+    camera->setClearColor(osg::Vec4(1.0f, 1.0f, 1.0f, 1.0f)); // dark background
+    // LayoutViews sets viewports and projections, resizing the window leaves them be
+    camera->setProjectionResizePolicy(osg::Camera::FIXED);
+    camera->setCullMask(~kOverlayMask | (1u << m_views.size()));
+    m_viewer->addView(view.get());
+    m_views.push_back(view);
+    m_viewDirections.push_back(direction);
+}
+
+void OSGCanvas::LayoutViews()
+{
+    int w, h;
+    GetClientSize(&w, &h);
+    w = std::max(w, 1);
+    h = std::max(h, 1);
+    // Viewports have their origin at the bottom left
+    std::vector<osg::ref_ptr<osg::Viewport>> viewports;
+    if (m_layout == LAYOUT_SINGLE) {
+        viewports.push_back(new osg::Viewport(0, 0, w, h));
+    }
+    else {
+        int left = w / 2;
+        viewports.push_back(new osg::Viewport(0, 0, left, h));
+        if (m_layout == LAYOUT_SPLIT) {
+            viewports.push_back(new osg::Viewport(left, 0, w - left, h));
+        }
+        else {
+            int bottom = h / 2;
+            viewports.push_back(new osg::Viewport(left, bottom, w - left, h - bottom));
+            viewports.push_back(new osg::Viewport(left, 0, w - left, bottom));
+        }
+    }
+    for (size_t i = 0; i < m_views.size() && i < viewports.size(); ++i) {
+        osg::Camera* camera = m_views[i]->getCamera();
+        osg::Viewport* viewport = viewports[i].get();
+        camera->setViewport(viewport);
+        camera->setProjectionMatrixAsPerspective(45.0f,
+            std::max(viewport->width(), 1.0) / std::max(viewport->height(), 1.0), 0.1, 1000.0);
+    }
+}
+
+void OSGCanvas::SetViewLayout(ViewLayout layout)
+{
+    static const ViewDirection directions[] = { VIEW_FREE, VIEW_TOP, VIEW_FRONT };
+    size_t count = layout == LAYOUT_SINGLE ? 1 : layout == LAYOUT_SPLIT ? 2 : 3;
+    m_layout = layout;
+    while (m_views.size() > count) {
+        m_viewer->removeView(m_views.back().get());
+        m_views.pop_back();
+        m_viewDirections.pop_back();
+    }
+    if (m_focusView >= count) m_focusView = 0;
+    osg::ComputeBoundsVisitor cbv;
+    m_root->accept(cbv);
+    while (m_views.size() < count) {
+        AddView(directions[m_views.size()]);
+        HomeView(m_views.size() - 1, cbv.getBoundingBox());
+    }
+    LayoutViews();
+    m_photosDirty = true;
+    Refresh(false);
+}
 
-void OSGCanvas::SetScene(Scene* scene) {
+// Free views look at the model from the front and above, fixed views straight down
+// or along +y, all with z up
+void OSGCanvas::HomeView(size_t view, const osg::BoundingBox& bb)
+{
+    if (!bb.valid()) return;
+    osg::Vec3f center = bb.center();
+    float radius = bb.radius();
+    osg::Vec3f eye(center.x(), center.y() - radius * 3.0f, center.z() + radius * 1.0f);
+    osg::Vec3f up(0.0f, 0.0f, 1.0f);
+    if (m_viewDirections[view] == VIEW_TOP) {
+        eye = center + osg::Vec3f(0.0f, 0.0f, radius * 3.0f);
+        up.set(0.0f, 1.0f, 0.0f);
+    }
+    else if (m_viewDirections[view] == VIEW_FRONT) {
+        eye = center - osg::Vec3f(0.0f, radius * 3.0f, 0.0f);
+    }
+    auto manip = dynamic_cast<osgGA::TrackballManipulator*>(m_views[view]->getCameraManipulator());
+    if (manip) {
+        manip->setHomePosition(eye, center, up);
+        manip->home(0.0);
+    }
+}
+
+size_t OSGCanvas::ViewAt(int x, int y) const
+{
+    int w, h;
+    GetClientSize(&w, &h);
+    for (size_t i = 0; i < m_views.size(); ++i) {
+        const osg::Viewport* viewport = m_views[i]->getCamera()->getViewport();
+        if (viewport && x >= viewport->x() && x < viewport->x() + viewport->width() &&
+            h - y >= viewport->y() && h - y < viewport->y() + viewport->height())
+            return i;
+    }
+    return m_focusView;
+}
+
+
+void OSGCanvas::AddScene(Scene* scene)
+{
+    std::unique_ptr<Model> model(new Model);
+    model->scene = scene;
+    model->node = new osg::Switch;
+    model->tint = ModelTint(m_modelsAdded++);
+    m_root->addChild(model->node.get());
+    m_models.push_back(std::move(model));
+    bool first = m_models.size() == 1;
+    m_active = m_models.back().get();
     m_scene = scene;
-    UpdateSceneGraph();
+    UpdateSceneGraph(first);
     Refresh();
 }
 
+void OSGCanvas::RemoveScene(Scene* scene)
+{
+    for (size_t i = 0; i < m_models.size(); ++i)
+    {
+        if (m_models[i]->scene != scene) continue;
+        // Dropping the node releases the model's geometry
+        m_root->removeChild(m_models[i]->node.get());
+        bool wasActive = m_models[i].get() == m_active;
+        m_models.erase(m_models.begin() + i);
+        if (wasActive)
+        {
+            m_active = m_models.empty() ? nullptr : m_models.back().get();
+            m_scene = m_active ? m_active->scene : nullptr;
+        }
+        break;
+    }
+    Refresh(false);
+}
+
+void OSGCanvas::SetActiveScene(Scene* scene)
+{
+    for (auto& model : m_models)
+    {
+        if (model->scene != scene) continue;
+        m_active = model.get();
+        m_scene = scene;
+        break;
+    }
+}
+
+void OSGCanvas::SetSceneVisible(Scene* scene, bool visible)
+{
+    for (auto& model : m_models)
+    {
+        if (model->scene != scene) continue;
+        if (visible) model->node->setAllChildrenOn();
+        else model->node->setAllChildrenOff();
+    }
+    // Photos of hidden models make room for the shown ones
+    m_photosDirty = true;
+    Refresh(false);
+}
+
+void OSGCanvas::ReloadScene()
+{
+    // Scene contents changed outside the canvas, indices are no longer valid
+    if (!m_active) return;
+    m_active->selectedPoints.clear();
+    m_active->selectedCameras.clear();
+    m_active->pointChanges.clear();
+    m_active->imageChanges.clear();
+    UpdateSceneGraph(false);
+}
+
+void OSGCanvas::SceneTransformed(const SimilarityTransform& transform)
+{
+    if (!m_active) return;
+    // Point positions are refilled from the scene in place, no arrays are reallocated
+    osg::Geometry* pointsGeom = m_active->pointsGeode.valid() && m_active->pointsGeode->getNumDrawables() > 0 ?
+        dynamic_cast<osg::Geometry*>(m_active->pointsGeode->getDrawable(0)) : nullptr;
+    osg::Vec3Array* vertices = pointsGeom ? dynamic_cast<osg::Vec3Array*>(pointsGeom->getVertexArray()) : nullptr;
+    const std::vector<const Point3D*>& points = m_scene->PointsByIndex();
+    if (vertices && vertices->size() == points.size()) {
+        ParallelFor(points.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) (*vertices)[i].set(points[i]->x, points[i]->y, points[i]->z);
+        }, 16384);
+        vertices->dirty();
+        pointsGeom->dirtyBound();
+    }
+
+    // Camera frustums move rigidly with the points
+    const std::array<double, 4>& q = transform.qvec;
+    osg::Quat rotation(q[1], q[2], q[3], q[0]);
+    if (rotation.length() > 0) rotation /= rotation.length();
+    osg::Matrixd matrix = osg::Matrixd::scale(transform.scale, transform.scale, transform.scale) *
+        osg::Matrixd::rotate(rotation) *
+        osg::Matrixd::translate(transform.translation[0], transform.translation[1], transform.translation[2]);
+    if (m_active->camerasGeode.valid()) {
+        for (unsigned i = 0; i < m_active->camerasGeode->getNumDrawables(); ++i) {
+            osg::Geometry* geom = dynamic_cast<osg::Geometry*>(m_active->camerasGeode->getDrawable(i));
+            osg::Vec3Array* verts = geom ? dynamic_cast<osg::Vec3Array*>(geom->getVertexArray()) : nullptr;
+            if (!verts) continue;
+            for (osg::Vec3& v : *verts) v = osg::Vec3(osg::Vec3d(v) * matrix);
+            verts->dirty();
+            geom->dirtyBound();
+        }
+    }
+    DropPhotos(*m_active);
+
+    // Height coloring follows the new up direction and range
+    if (m_colorMode != PointColorMode::Rgb) SetColorMode(m_colorMode);
+    ResetView();
+}
+
+void OSGCanvas::PointValuesChanged()
+{
+    if (!m_active || !m_scene) return;
+    osg::Geometry* pointsGeom = m_active->pointsGeode.valid() && m_active->pointsGeode->getNumDrawables() > 0 ?
+        dynamic_cast<osg::Geometry*>(m_active->pointsGeode->getDrawable(0)) : nullptr;
+    osg::Vec2Array* values = pointsGeom ?
+        dynamic_cast<osg::Vec2Array*>(pointsGeom->getVertexAttribArray(kPointValuesAttribute)) : nullptr;
+    const std::vector<const Point3D*>& points = m_scene->PointsByIndex();
+    if (values && values->size() == points.size()) {
+        ParallelFor(points.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+                (*values)[i].set(static_cast<float>(points[i]->error), static_cast<float>(points[i]->track.size() / 2));
+        }, 16384);
+        values->dirty();
+    }
+    else DrawPoints(*m_active);
+    osg::Vec3 up = SceneUpAxis(*m_scene);
+    m_shading.heightAxis->set(up);
+    m_shading.valueRange->set(PointValueRange(*m_scene, m_colorMode, up));
+    Refresh(false);
+}
+
+void OSGCanvas::GetSessionState(SessionState& state) const
+{
+    if (!m_active) return;
+    state.selectedPoints = m_active->selectedPoints;
+    state.selectedCameras = m_active->selectedCameras;
+    state.lastSelectMode = m_active->lastSelectMode;
+    state.cursorMode = m_cursorMode;
+    state.pointSize = pointSize;
+    state.cameraSize = cameraSize;
+    auto manip = m_views[0]->getCameraManipulator();
+    if (manip) {
+        osg::Matrixd matrix = manip->getMatrix();
+        std::copy(matrix.ptr(), matrix.ptr() + 16, state.viewMatrix);
+    }
+}
+
+void OSGCanvas::RestoreSessionState(const SessionState& state)
+{
+    if (!m_scene) return;
+    m_active->selectedPoints.clear();
+    m_active->selectedCameras.clear();
+    int npt = m_scene->GetPoints().size();
+    int ncam = m_scene->GetImages().size();
+    for (int i : state.selectedPoints)
+        if (i >= 0 && i < npt) m_active->selectedPoints.push_back(i);
+    for (int i : state.selectedCameras)
+        if (i >= 0 && i < ncam) m_active->selectedCameras.push_back(i);
+    m_active->lastSelectMode = state.lastSelectMode;
+    pointSize = state.pointSize;
+    cameraSize = state.cameraSize;
+    SetCursorMode(static_cast<CursorMode>(state.cursorMode));
+    auto manip = m_views[0]->getCameraManipulator();
+    if (manip) manip->setByMatrix(osg::Matrixd(state.viewMatrix));
+    // Point size lives in the point geometry state, rebuild it with the restored values
+    DrawPoints(*m_active);
+    UpdateSelect();
+}
+
 void OSGCanvas::SetCursorMode(CursorMode mode)
 {
     m_cursorMode = mode;
@@ -93,12 +370,32 @@ void OSGCanvas::OnKeyDown(wxKeyEvent& event)
         Refresh(false);
         break;
     }
+    case 'l':
+    case 'L':
+    {
+        SetCursorMode(MODE_LASSO);
+        Refresh(false);
+        break;
+    }
     case 'v':
     case 'V':
     {
         InvertSelected();
         break;
     }
+    case 'f':
+    case 'F':
+    {
+        SelectPointsInFrustum();
+        break;
+    }
+    case 'o':
+    case 'O':
+    {
+        if (event.ControlDown()) SelectObservingCameras();
+        else SelectObservedPoints();
+        break;
+    }
     case 'n':
     case 'N':
     {
@@ -151,56 +448,108 @@ void OSGCanvas::OnKeyUp(wxKeyEvent& event)
 
 
 void OSGCanvas::DeleteSelected() {
-    // TODO: Remove selected points from scene and data
     if (m_scene == nullptr) return;
-    if (lastSelectMode == MODE_RECTANGLE || lastSelectMode == MODE_POLYGON)
+    if (m_active->lastSelectMode == MODE_RECTANGLE || m_active->lastSelectMode == MODE_POLYGON)
     {
-        m_scene->DeletePoints(selectedPoints);
-        selectedPoints.clear();
+        std::vector<int> ids;
+        ids.reserve(m_active->selectedPoints.size());
+        for (int index : m_active->selectedPoints) ids.push_back(m_scene->PointsByIndex()[index]->id);
+        m_scene->DeletePoints(m_active->selectedPoints);
+        m_active->selectedPoints.clear();
+        if (m_onEdit) m_onEdit(m_scene, JournalEdit::DeletePoints, std::move(ids));
     }
-    else if (lastSelectMode == MODE_RECTANGLE_CAMERA || lastSelectMode == MODE_POLYGON_CAMERA)
+    else if (m_active->lastSelectMode == MODE_RECTANGLE_CAMERA || m_active->lastSelectMode == MODE_POLYGON_CAMERA)
     {
-        m_scene->DeleteImages(selectedCameras);
-        selectedCameras.clear();
+        std::vector<int> ids;
+        ids.reserve(m_active->selectedCameras.size());
+        for (int index : m_active->selectedCameras) ids.push_back(m_scene->ImagesByIndex()[index]->id);
+        // Also recomputes the errors of the points that lost track elements
+        m_scene->DeleteImages(m_active->selectedCameras);
+        m_active->selectedCameras.clear();
+        if (m_onEdit) m_onEdit(m_scene, JournalEdit::DeleteImages, std::move(ids));
     }
+    // Deletions shift positions, the statuses of a comparison no longer line up
+    m_active->pointChanges.clear();
+    m_active->imageChanges.clear();
     UpdateSceneGraph(false);
+    // Track lengths and errors of the remaining points changed, and so may their range
+    PointValuesChanged();
     Refresh();
 }
 
 void OSGCanvas::InvertSelected()
 {
     if (m_scene == nullptr) return;
-    if (lastSelectMode == MODE_RECTANGLE || lastSelectMode == MODE_POLYGON)
+    if (m_active->lastSelectMode == MODE_RECTANGLE || m_active->lastSelectMode == MODE_POLYGON)
     {
         int npt = m_scene->GetPoints().size();
         std::vector<char> flags(npt, 1);
-        for(int i: selectedPoints)
+        for(int i: m_active->selectedPoints)
         {
             flags[i] = 0;
         }
-        selectedPoints.clear();
+        m_active->selectedPoints.clear();
         for (int i = 0; i < npt; i++)
         {
-            if (flags[i]) selectedPoints.push_back(i);
+            if (flags[i]) m_active->selectedPoints.push_back(i);
         }
     }
-    else if (lastSelectMode == MODE_RECTANGLE_CAMERA || lastSelectMode == MODE_POLYGON_CAMERA)
+    else if (m_active->lastSelectMode == MODE_RECTANGLE_CAMERA || m_active->lastSelectMode == MODE_POLYGON_CAMERA)
     {
         int npt = m_scene->GetImages().size();
         std::vector<char> flags(npt, 1);
-        for(int i: selectedCameras)
+        for(int i: m_active->selectedCameras)
         {
             flags[i] = 0;
         }
-        selectedCameras.clear();
+        m_active->selectedCameras.clear();
         for (int i = 0; i < npt; i++)
         {
-            if (flags[i]) selectedCameras.push_back(i);
+            if (flags[i]) m_active->selectedCameras.push_back(i);
         }
     }
     UpdateSelect();
 }
 
+void OSGCanvas::SelectObservedPoints()
+{
+    if (m_scene == nullptr || m_active->selectedCameras.empty()) return;
+    m_active->selectedPoints = m_scene->PointsObservedBy(m_active->selectedCameras);
+    // The cameras stay highlighted, follow-up edits act on the points
+    m_active->lastSelectMode = MODE_RECTANGLE;
+    UpdateSelect();
+}
+
+void OSGCanvas::SelectObservingCameras()
+{
+    if (m_scene == nullptr || m_active->selectedPoints.empty()) return;
+    m_active->selectedCameras = m_scene->ImagesObserving(m_active->selectedPoints);
+    m_active->lastSelectMode = MODE_RECTANGLE_CAMERA;
+    UpdateSelect();
+}
+
+void OSGCanvas::SelectCameras(const std::vector<int>& imageIndices)
+{
+    if (m_scene == nullptr) return;
+    m_active->selectedCameras = imageIndices;
+    m_active->lastSelectMode = MODE_RECTANGLE_CAMERA;
+    UpdateSelect();
+}
+
+void OSGCanvas::SetFrustumDepthRange(double minDepth, double maxDepth)
+{
+    m_frustumMinDepth = minDepth;
+    m_frustumMaxDepth = maxDepth;
+}
+
+void OSGCanvas::SelectPointsInFrustum()
+{
+    if (m_scene == nullptr || m_active->selectedCameras.empty()) return;
+    m_active->selectedPoints = m_scene->PointsInFrustum(m_active->selectedCameras, m_frustumMinDepth, m_frustumMaxDepth);
+    m_active->lastSelectMode = MODE_RECTANGLE;
+    UpdateSelect();
+}
+
 void OSGCanvas::ResetView()
 {
     osg::ComputeBoundsVisitor cbv;
@@ -209,17 +558,7 @@ void OSGCanvas::ResetView()
 
     if (bb.valid())
     {
-        osg::Vec3f center = bb.center();
-        float radius = bb.radius();
-
-        osg::Vec3f eye(center.x(), center.y() - radius * 3.0f, center.z() + radius * 1.0f);
-        osg::Vec3f up(0.0f, 0.0f, 1.0f);
-
-        auto manip = dynamic_cast<osgGA::TrackballManipulator*>(m_viewer->getCameraManipulator());
-        if (manip) {
-            manip->setHomePosition(eye, center, up);
-            manip->home(0.0);
-        }
+        for (size_t i = 0; i < m_views.size(); ++i) HomeView(i, bb);
         Refresh(false);
     }
 }
@@ -234,6 +573,8 @@ void OSGCanvas::OnPaint(wxPaintEvent& event) {
 void OSGCanvas::OnMouse(wxMouseEvent& event) {
     int x = event.GetX();
     int y = event.GetY();
+    // A click picks the view to work in, unless it continues a selection begun elsewhere
+    if (event.ButtonDown() && !dragging && !polygonDrawing) m_focusView = ViewAt(x, y);
 
     if (m_cursorMode == MODE_NORMAL) {
         /*if (event.LeftDClick()) {
@@ -315,6 +656,14 @@ void OSGCanvas::OnMouse(wxMouseEvent& event) {
             // Calculate selection in polygon
             SelectObjectsInPolygon(polygonPoints);
         }
+    } else if (m_cursorMode == MODE_LASSO) {
+        if (event.LeftDown()) {
+            BeginLasso(x, y);
+        } else if (event.Dragging() && event.LeftIsDown() && polygonDrawing) {
+            ExtendLasso(x, y);
+        } else if (event.LeftUp() && polygonDrawing) {
+            FinishLasso();
+        }
     }
 }
 
@@ -322,172 +671,139 @@ void OSGCanvas::OnMouse(wxMouseEvent& event) {
 void OSGCanvas::OnSize(wxSizeEvent& event) {
     int w, h;
     GetClientSize(&w, &h);
-    if (m_viewer && m_viewer->getCamera()) {
-        m_viewer->getCamera()->setViewport(0, 0, w, h);
-        m_viewer->getCamera()->setProjectionMatrixAsPerspective(45.0f, static_cast<double>(w)/h, 0.1, 1000.0);
-    }
     if (m_gc.valid())
     {
         // update the window dimensions, in case the window has been resized.
         m_gc->getEventQueue()->windowResize(0, 0, w, h);
         m_gc->resized(0, 0, w, h);
     }
+    // After resized, which scales the viewports in proportion
+    if (m_viewer.valid()) LayoutViews();
     Refresh();
 }
 
 
 void OSGCanvas::Render() {
-    if (m_viewer.valid()) m_viewer->frame();
+    if (!m_viewer.valid()) return;
+    UpdatePhotos();
+    m_viewer->frame();
 }
 
 void OSGCanvas::ScalePoint(int delta)
 {
     if (delta > 0) pointSize *= 2.0f;
     else pointSize *= 0.5f;
-    if (pointsGeode.valid())
+    for (auto& model : m_models)
     {
-        osg::Geode* geode = pointsGeode.get();
+        if (!model->pointsGeode.valid()) continue;
+        osg::Geode* geode = model->pointsGeode.get();
         if (geode && geode->getNumDrawables() > 0) {
             osg::Geometry* geom = dynamic_cast<osg::Geometry*>(geode->getDrawable(0));
             if (geom) {
                 osg::ref_ptr<osg::Point> pointSizer = new osg::Point(pointSize); // 3 pixels
                 geom->getOrCreateStateSet()->setAttribute(pointSizer.get());
                 geom->dirtyBound();
-                Refresh(false);
             }
         }
     }
+    Refresh(false);
+}
+
+void OSGCanvas::DrawCameras(Model& model)
+{
+    DropPhotos(model);
+    if (model.camerasGeode.valid())
+    {
+        model.node->removeChild(model.camerasGeode);
+        model.camerasGeode = nullptr;
+    }
+    bool changes = m_colorMode == PointColorMode::Changes &&
+        model.imageChanges.size() == model.scene->GetImages().size();
+    model.camerasGeode = BuildCamerasGeode(*model.scene, model.selectedCameras, model.tint, cameraSize,
+        changes ? &model.imageChanges : nullptr);
+    if (!model.camerasGeode.valid()) return;
+    model.node->addChild(model.camerasGeode.get());
+    Refresh(false);
 }
 
-void OSGCanvas::DrawCameras()
-{
-    if (camerasGeode.valid())
-    {
-        m_root->removeChild(camerasGeode);
-        camerasGeode.release();
-    }
-    if (m_scene->GetImages().size() == 0) return;
-    std::vector<char> flags(m_scene->GetImages().size(),0);
-    for (int index : selectedCameras)
-    {
-        flags[index] = 1;
-    }
-    double scale = 0.2;
-    double minx=FLT_MAX, maxx=-FLT_MAX, miny=FLT_MAX, maxy=-FLT_MAX;
-    std::vector<osg::Vec3d> Cs;
-    std::vector<osg::Matrix> Rs;
-    for (auto it = m_scene->GetImages().begin(); it != m_scene->GetImages().end(); ++it) {
-        const Image& img = it->second;
-        osg::Quat q(img.qvec[1], img.qvec[2], img.qvec[3], img.qvec[0]);
-        osg::Matrix R;
-        R.makeRotate(q);   // R is camera-to-world rotation? NO, it's world-to-camera!
-        // Camera center in world coords
-        osg::Vec3d t(img.tvec[0], img.tvec[1], img.tvec[2]);
-        osg::Vec3d C = -(R * t);   // C = -R^T * t
-        Cs.push_back(C);
-        Rs.push_back(R);
-        if (C.x() < minx) minx = C.x();
-        if (C.x() > maxx) maxx = C.x();
-        if (C.y() < miny) miny = C.y();
-        if (C.y() > maxy) maxy = C.y();
-    }
-    double dx = maxx - minx;
-    double dy = maxy - miny;
-    scale = 0.5*std::sqrt(dx*dx+dy*dy) * cameraSize; // Size of pyramid
-    camerasGeode = new osg::Geode;
-    for (int i = 0; i < Rs.size();i++) {
-        osg::ref_ptr<osg::Geometry> camGeom = new osg::Geometry;
-        osg::ref_ptr<osg::Vec3Array> camVerts = new osg::Vec3Array;
-        osg::ref_ptr<osg::Vec4Array> camColors = new osg::Vec4Array;
-
-        // Define pyramid base in camera local coordinates
-        std::vector<osg::Vec3d> base = {
-            osg::Vec3d(-scale, -scale, scale),
-            osg::Vec3d(scale, -scale, scale),
-            osg::Vec3d(scale,  scale, scale),
-            osg::Vec3d(-scale,  scale, scale)
-        };
-        // Transform base to world coordinates
-        osg::Matrix R=Rs[i];// = osg::Matrix::transpose(R);  // world-from-camera rotation
-        osg::Vec3d C = Cs[i];   // C = -R^T * t
-
-        for (auto& v : base) v = R * v + C;
-        // Apex
-        osg::Vec3d apex = C;
-        // Add vertices
-        camVerts->push_back(apex); // 0
-        for (int j = 0; j < 4; ++j) camVerts->push_back(base[j]); // 1-4
-        // Color: green
-        osg::Vec4 camColor(1, 0, 0, 1);
-        osg::Vec4 planeColor(1, 0.2, 0.2, 0.3f);
-        if (flags[i])
-        {
-            camColor = { 0, 0, 1, 1 };
-            planeColor = { 0.2, 0.2, 1.0, 0.3f };
-        }
-        for (int j = 0; j < 5; ++j) camColors->push_back(camColor);
-        camGeom->setVertexArray(camVerts.get());
-        camGeom->setColorArray(camColors.get(), osg::Array::BIND_PER_VERTEX);
-
-        // Draw base square
-        osg::ref_ptr<osg::DrawElementsUInt> baseLines = new osg::DrawElementsUInt(osg::PrimitiveSet::LINE_LOOP, 0);
-        baseLines->push_back(1); baseLines->push_back(2); baseLines->push_back(3); baseLines->push_back(4);
-        camGeom->addPrimitiveSet(baseLines.get());
-        // Draw sides
-        for (int j = 1; j <= 4; ++j) {
-            osg::ref_ptr<osg::DrawElementsUInt> side = new osg::DrawElementsUInt(osg::PrimitiveSet::LINES, 0);
-            side->push_back(0); side->push_back(j);
-            camGeom->addPrimitiveSet(side.get());
-        }
+void OSGCanvas::DropPhotos(Model& model)
+{
+    if (model.photosGeode.valid()) model.node->removeChild(model.photosGeode.get());
+    model.photosGeode = nullptr;
+    model.photoCameras.clear();
+    m_photosDirty = true;
+}
 
-        osg::ref_ptr<osg::StateSet> ssCam = camGeom->getOrCreateStateSet();
-        // Enable blending
-        ssCam->setMode(GL_BLEND, osg::StateAttribute::ON);
-        // Set blending function (optional, commonly used for standard alpha blending)
-        ssCam->setAttributeAndModes(new osg::BlendFunc(
-            osg::BlendFunc::SRC_ALPHA, osg::BlendFunc::ONE_MINUS_SRC_ALPHA));
-
-        osg::ref_ptr<osg::LineWidth> lineWidth = new osg::LineWidth(2.0); // 3 pixels
-        ssCam->setAttribute(lineWidth.get());
-        ssCam->setRenderingHint(osg::StateSet::TRANSPARENT_BIN);
-        ssCam->setMode(GL_DEPTH_WRITEMASK, osg::StateAttribute::OFF);
-        ssCam->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
-
-        // --- Image plane rectangle (filled) ---
-        osg::ref_ptr<osg::Geometry> planeGeom = new osg::Geometry;
-        osg::ref_ptr<osg::Vec3Array> planeVerts = new osg::Vec3Array;
-        for (int j = 0; j < 4; ++j)
-            planeVerts->push_back(base[j]);
-
-        osg::ref_ptr<osg::Vec4Array> planeColors = new osg::Vec4Array;
-        for (int j = 0; j < 4; ++j)
-            planeColors->push_back(planeColor); // semi-transparent green
-
-        planeGeom->setVertexArray(planeVerts.get());
-        planeGeom->setColorArray(planeColors.get(), osg::Array::BIND_PER_VERTEX);
-        planeGeom->addPrimitiveSet(new osg::DrawArrays(osg::PrimitiveSet::QUADS, 0, 4));
-
-        // State for transparency
-        osg::StateSet* ssPlane = planeGeom->getOrCreateStateSet();
-        ssPlane->setMode(GL_BLEND, osg::StateAttribute::ON);
-        ssPlane->setAttributeAndModes(new osg::BlendFunc(
-            osg::BlendFunc::SRC_ALPHA, osg::BlendFunc::ONE_MINUS_SRC_ALPHA));
-        ssPlane->setRenderingHint(osg::StateSet::TRANSPARENT_BIN);
-        ssPlane->setMode(GL_DEPTH_WRITEMASK, osg::StateAttribute::OFF);
-        ssPlane->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
-
-        camerasGeode->addDrawable(camGeom.get());
-        camerasGeode->addDrawable(planeGeom.get());
-    }
-    m_root->addChild(camerasGeode.get());
+void OSGCanvas::SetImageRoot(const wxString& root)
+{
+    m_photos.SetImageRoot(root.ToStdString());
+    m_photosDirty = true;
     Refresh(false);
 }
 
+// Photos go on the image planes of the cameras in view nearest the eye, over all
+// shown models. Runs before every frame, but only picks cameras again once the view
+// moved, a cameras geode was rebuilt or photos arrived, so thousands of cameras
+// cost a scan per changed view and never more than m_maxPhotos textures.
+void OSGCanvas::UpdatePhotos()
+{
+    bool arrived = m_photos.Collect();
+    osgGA::CameraManipulator* manip = m_views[m_focusView]->getCameraManipulator();
+    osg::Matrixd view = manip ? manip->getInverseMatrix() : FocusCamera()->getViewMatrix();
+    osg::Matrixd projection = FocusCamera()->getProjectionMatrix();
+    if (!arrived && !m_photosDirty && view == m_photoView && projection == m_photoProjection) return;
+    m_photoView = view;
+    m_photoProjection = projection;
+    m_photosDirty = false;
+
+    struct Candidate {
+        double distance;
+        Model* model;
+        int camera;
+    };
+    std::vector<Candidate> nearest;
+    size_t maxPhotos = m_photos.ImageRoot().empty() ? 0 : m_maxPhotos;
+    osg::Vec3d eye = osg::Matrixd::inverse(view).getTrans();
+    for (auto& model : m_models) {
+        if (!model->camerasGeode.valid() || !model->node->getNewChildDefaultValue()) continue;
+        const std::vector<CameraPose>& poses = model->scene->GetCameraPoses();
+        for (int camera : CamerasNearView(*model->scene, view, projection, maxPhotos))
+            nearest.push_back({ (PoseCenter(poses[camera]) - eye).length2(), model.get(), camera });
+    }
+    std::sort(nearest.begin(), nearest.end(),
+        [](const Candidate& a, const Candidate& b) { return a.distance < b.distance; });
+    if (nearest.size() > maxPhotos) nearest.resize(maxPhotos);
+    std::vector<std::string> names;
+    for (const Candidate& candidate : nearest)
+        names.emplace_back(candidate.model->scene->ImagesByIndex()[candidate.camera]->name);
+    m_photos.Want(names);
+
+    // A model's photo geode is only rebuilt when its set of shown photos changed
+    for (auto& model : m_models) {
+        std::vector<int> cameras;
+        std::vector<osg::Texture2D*> textures;
+        for (size_t i = 0; i < nearest.size(); ++i) {
+            if (nearest[i].model != model.get()) continue;
+            osg::Texture2D* texture = m_photos.Find(names[i]);
+            if (!texture) continue;
+            cameras.push_back(nearest[i].camera);
+            textures.push_back(texture);
+        }
+        if (cameras == model->photoCameras) continue;
+        if (model->photosGeode.valid()) model->node->removeChild(model->photosGeode.get());
+        model->photosGeode = nullptr;
+        model->photoCameras = cameras;
+        if (cameras.empty()) continue;
+        model->photosGeode = BuildPhotoPlanesGeode(model->camerasGeode.get(), cameras, textures);
+        model->node->addChild(model->photosGeode.get());
+    }
+}
+
 void OSGCanvas::ScaleCamera(int delta)
 {
     if (delta > 0) cameraSize *= 2.0f;
     else cameraSize *= 0.5f;
-    DrawCameras();
+    for (auto& model : m_models) DrawCameras(*model);
 }
 
 void OSGCanvas::DrawPolygon()
@@ -510,6 +826,7 @@ void OSGCanvas::DrawPolygon()
         hudCamera->setClearMask(GL_DEPTH_BUFFER_BIT);
         hudCamera->setProjectionMatrix(osg::Matrix::ortho2D(0, w, 0, h));
         hudCamera->setViewport(0, 0, w, h);
+        hudCamera->setNodeMask(1u << m_focusView);
 
         osg::ref_ptr<osg::Geode> hudGeode = new osg::Geode;
         osg::ref_ptr<osg::Geometry> polyGeom = new osg::Geometry;
@@ -537,7 +854,7 @@ void OSGCanvas::DrawPolygon()
         m_root->addChild(hudCamera.get());
         Refresh();
     }
-    if ((m_cursorMode == MODE_POLYGON || m_cursorMode==MODE_POLYGON_CAMERA )&& polygonDrawing)
+    if ((m_cursorMode == MODE_POLYGON || m_cursorMode==MODE_POLYGON_CAMERA || m_cursorMode == MODE_LASSO) && polygonDrawing)
     {
         int w = GetSize().GetWidth();
         int h = GetSize().GetHeight();
@@ -547,6 +864,7 @@ void OSGCanvas::DrawPolygon()
         hudCamera->setClearMask(GL_DEPTH_BUFFER_BIT);
         hudCamera->setProjectionMatrix(osg::Matrix::ortho2D(0, w, 0, h));
         hudCamera->setViewport(0, 0, w, h);
+        hudCamera->setNodeMask(1u << m_focusView);
 
         osg::ref_ptr<osg::Geode> hudGeode = new osg::Geode;
         osg::ref_ptr<osg::Geometry> polyGeom = new osg::Geometry;
@@ -572,97 +890,110 @@ void OSGCanvas::DrawPolygon()
     }
 }
 
-void OSGCanvas::DrawPoints()
+void OSGCanvas::DrawPoints(Model& model)
 {
-    if (pointsGeode.valid())
+    if (model.pointsGeode.valid())
     {
-        m_root->removeChild(pointsGeode);
-        pointsGeode.release();
+        model.node->removeChild(model.pointsGeode);
+        model.pointsGeode = nullptr;
     }
-    pointsGeode = new osg::Geode;
-    osg::ref_ptr<osg::Geometry> pointsGeom = new osg::Geometry;
-    osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array;
-    osg::ref_ptr<osg::Vec4Array> colors = new osg::Vec4Array;
-    for (auto it = m_scene->GetPoints().begin(); it != m_scene->GetPoints().end(); ++it) {
-        const Point3D& pt = it->second;
-        vertices->push_back(osg::Vec3(pt.x, pt.y, pt.z));
-        colors->push_back(osg::Vec4(pt.color[0] / 255.0, pt.color[1] / 255.0, pt.color[2] / 255.0, 1.0));
-    }
-    pointsGeom->setVertexArray(vertices.get());
-    pointsGeom->setColorArray(colors.get(), osg::Array::BIND_PER_VERTEX);
-    pointsGeom->addPrimitiveSet(new osg::DrawArrays(osg::PrimitiveSet::POINTS, 0, vertices->size()));
-    osg::ref_ptr<osg::Point> pointSizer = new osg::Point(pointSize); // 3 pixels
-    pointsGeom->getOrCreateStateSet()->setAttribute(pointSizer.get());
-    pointsGeom->getOrCreateStateSet()->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
-    pointsGeode->addDrawable(pointsGeom.get());
-    m_root->addChild(pointsGeode.get());
+    model.pointsGeode = BuildPointsGeode(*model.scene, model.tint, pointSize, &m_shading);
+    model.node->addChild(model.pointsGeode.get());
+    UpdatePointFlags(model);
+}
+
+// Selection and, in membership mode, observation by the selected cameras or, in
+// changes mode, the change status go into the per-point flags; the base colors are
+// never touched
+void OSGCanvas::UpdatePointFlags(Model& model)
+{
+    osg::Vec2ubArray* flags = PointFlags(model.pointsGeode.get());
+    if (!flags) return;
+    std::vector<char> selected(flags->size(), 0);
+    for (int i : model.selectedPoints) selected[i] = 1;
+    std::vector<unsigned char> second(flags->size(), 0);
+    if (m_colorMode == PointColorMode::ImageMembership)
+        for (int i : model.scene->PointsObservedBy(model.selectedCameras)) second[i] = 255;
+    bool changes = m_colorMode == PointColorMode::Changes && model.pointChanges.size() == flags->size();
+    ParallelFor(flags->size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            unsigned char value = second[i];
+            if (changes) value = static_cast<unsigned char>(static_cast<int>(model.pointChanges[i]) * kChangeFlagStep);
+            (*flags)[i].set(selected[i] ? 255 : 0, value);
+        }
+    }, 65536);
+    flags->dirty();
 }
 
 void OSGCanvas::UpdateSelect()
 {
-    if (!pointsGeode.valid()) return;
-    osg::Geode* geode = pointsGeode.get();  // your geode
-    if (geode && geode->getNumDrawables() > 0) {
-        osg::Geometry* geom = dynamic_cast<osg::Geometry*>(geode->getDrawable(0));
-        if (geom) {
-            osg::Vec4Array* colors = dynamic_cast<osg::Vec4Array*>(geom->getColorArray());
-            if (colors) {
-                // Now you can access or modify colors
-                std::vector<char> flags(colors->size(),0);
-                for (int i : selectedPoints) flags[i] = 1;
-                int index = 0;
-                for (auto it = m_scene->GetPoints().begin(); it != m_scene->GetPoints().end(); ++it, index++) {
-                    const Point3D& pt = it->second;
-                    osg::Vec4& c = (*colors)[index];
-                    if (flags[index])
-                    {
-                        c[0] = 0;
-                        c[1] = 0;
-                        c[2] = 255;
-                    }
-                    else
-                    {
-                        c[0] = pt.color[0] / 255.0f;
-                        c[1] = pt.color[1] / 255.0f;
-                        c[2] = pt.color[2] / 255.0f;
-                    }
-                }
-                colors->dirty();
-                geom->dirtyDisplayList();
-                Refresh(false);
-            }
+    if (!m_active || !m_active->pointsGeode.valid()) return;
+    UpdatePointFlags(*m_active);
+    Refresh(false);
+    //cameras
+    if (m_active) DrawCameras(*m_active);
+}
+
+void OSGCanvas::SetColorMode(PointColorMode mode)
+{
+    bool changesToggled = (mode == PointColorMode::Changes) != (m_colorMode == PointColorMode::Changes);
+    m_colorMode = mode;
+    m_shading.colorMode->set(static_cast<int>(mode));
+    if (m_scene) {
+        osg::Vec3 up = SceneUpAxis(*m_scene);
+        m_shading.heightAxis->set(up);
+        m_shading.valueRange->set(PointValueRange(*m_scene, mode, up));
+    }
+    // Membership and change flags are only kept up to date while they are shown
+    if (mode == PointColorMode::ImageMembership || mode == PointColorMode::Changes)
+        for (auto& model : m_models) UpdatePointFlags(*model);
+    // Cameras take their change colors or go back to the model tints
+    if (changesToggled)
+        for (auto& model : m_models) DrawCameras(*model);
+    Refresh(false);
+}
+
+void OSGCanvas::SetChanges(Scene* scene, std::vector<DiffStatus> pointChanges, std::vector<DiffStatus> imageChanges)
+{
+    for (auto& model : m_models)
+    {
+        if (model->scene != scene) continue;
+        model->pointChanges = std::move(pointChanges);
+        model->imageChanges = std::move(imageChanges);
+        if (m_colorMode == PointColorMode::Changes) {
+            UpdatePointFlags(*model);
+            DrawCameras(*model);
         }
+        break;
     }
-    //cameras
-    DrawCameras();
+    Refresh(false);
+}
+
+void OSGCanvas::SetColormap(Colormap colormap)
+{
+    m_shading.colormap->set(static_cast<int>(colormap));
+    Refresh(false);
+}
+
+void OSGCanvas::SetColorRange(float minValue, float maxValue)
+{
+    m_shading.valueRange->set(osg::Vec2(minValue, maxValue));
+    Refresh(false);
 }
 
 void OSGCanvas::UpdateSceneGraph(bool reset) {
     if (!m_scene) return;
     // Add points as OSG geometry
-    DrawPoints();
+    DrawPoints(*m_active);
     // Add cameras as square pyramid wireframes
-    DrawCameras();
+    DrawCameras(*m_active);
     if (reset)
     {
         osg::ComputeBoundsVisitor cbv;
-        if (camerasGeode.valid()) camerasGeode->accept(cbv);
+        if (m_active->camerasGeode.valid()) m_active->camerasGeode->accept(cbv);
         else m_root->accept(cbv);
         osg::BoundingBox bb = cbv.getBoundingBox();
-        if (bb.valid())
-        {
-            osg::Vec3f center = bb.center();
-            float radius = bb.radius();
-
-            osg::Vec3f eye(center.x(), center.y() - radius * 3.0f, center.z() + radius * 1.0f);
-            osg::Vec3f up(0.0f, 0.0f, 1.0f);
-
-            auto manip = dynamic_cast<osgGA::TrackballManipulator*>(m_viewer->getCameraManipulator());
-            if (manip) {
-                manip->setHomePosition(eye, center, up);
-                manip->home(0.0);
-            }
-        }
+        for (size_t i = 0; i < m_views.size(); ++i) HomeView(i, bb);
     }
     
     Refresh(false);
@@ -682,65 +1013,172 @@ static bool PointInPolygon(int x, int y, const std::vector<OSGCanvas::Point2D>&
     return inside;
 }
 void OSGCanvas::SelectObjectsInPolygon(const std::vector<Point2D>& polygon) {
-    lastSelectMode = m_cursorMode;
-    selectedPoints.clear();
-    selectedCameras.clear();
+    if (!m_active) return;
+    m_active->lastSelectMode = m_cursorMode;
+    m_active->selectedPoints.clear();
+    m_active->selectedCameras.clear();
     if (!m_scene || polygon.size() < 3) return;
     // Get viewport, projection, and modelview matrices
-    osg::Matrixd projection = m_viewer->getCamera()->getProjectionMatrix();
-    osg::Matrixd modelview = m_viewer->getCamera()->getViewMatrix();
-    osg::Matrixd viewport = m_viewer->getCamera()->getViewport()->computeWindowMatrix();
+    // The window matrix places the focus view's viewport within the canvas
+    osg::Matrixd projection = FocusCamera()->getProjectionMatrix();
+    osg::Matrixd modelview = FocusCamera()->getViewMatrix();
+    osg::Matrixd viewport = FocusCamera()->getViewport()->computeWindowMatrix();
     osg::Matrixd mat = modelview * projection * viewport;
-    if (lastSelectMode == MODE_RECTANGLE || lastSelectMode == MODE_POLYGON)
+    // Hits are gathered per block and concatenated in block order, so the selection
+    // stays sorted
+    auto concat = [](std::vector<int> a, std::vector<int> b) {
+        if (a.empty()) return b;
+        a.insert(a.end(), b.begin(), b.end());
+        return a;
+    };
+    if (m_active->lastSelectMode == MODE_RECTANGLE || m_active->lastSelectMode == MODE_POLYGON)
     {
-        int index = 0;
         int w, h;
         GetClientSize(&w, &h);
-        for (auto it = m_scene->GetPoints().begin(); it != m_scene->GetPoints().end(); ++it, index++) {
-            const Point3D& pt = it->second;
-            osg::Vec3d obj(pt.x, pt.y, pt.z);
-            osg::Vec3d win = mat.preMult(obj);
-            if (PointInPolygon(win.x(), h - win.y(), polygon)) {
-                selectedPoints.push_back(index);
-            }
-        }
+        const std::vector<const Point3D*>& points = m_scene->PointsByIndex();
+        std::vector<char> visible;
+        if (m_visibleOnly) visible = VisiblePoints();
+        m_active->selectedPoints = ParallelReduce(points.size(), std::vector<int>(),
+            [&](size_t begin, size_t end) {
+                std::vector<int> hits;
+                for (size_t index = begin; index < end; index++) {
+                    if (m_visibleOnly && !visible[index]) continue;
+                    const Point3D& pt = *points[index];
+                    osg::Vec3d obj(pt.x, pt.y, pt.z);
+                    osg::Vec3d win = mat.preMult(obj);
+                    if (PointInPolygon(win.x(), h - win.y(), polygon)) {
+                        hits.push_back(static_cast<int>(index));
+                    }
+                }
+                return hits;
+            }, concat, 16384);
     }
     else
     {
-        std::vector<osg::Vec3d> Cs;
-        for (auto it = m_scene->GetImages().begin(); it != m_scene->GetImages().end(); ++it) {
-            const Image& img = it->second;
-            osg::Quat q(img.qvec[1], img.qvec[2], img.qvec[3], img.qvec[0]);
-            osg::Matrix Rt;
-            Rt.makeRotate(q);   // R is camera-to-world rotation? NO, it's world-to-camera!
-            // Camera center in world coords
-            osg::Vec3d t(img.tvec[0], img.tvec[1], img.tvec[2]);
-            osg::Vec3d C = -(Rt * t);   // C = -R^T * t
-            Cs.push_back(C);
-        }
-        int index = 0;
+        const std::vector<CameraPose>& poses = m_scene->GetCameraPoses();
         int w, h;
         GetClientSize(&w, &h);
-        for (auto it = m_scene->GetImages().begin(); it != m_scene->GetImages().end(); ++it, index++) {
-            const Image& img = it->second;
-            osg::Quat q(img.qvec[1], img.qvec[2], img.qvec[3], img.qvec[0]);
-            osg::Matrix Rt;
-            Rt.makeRotate(q);   // R is camera-to-world rotation? NO, it's world-to-camera!
-            // Camera center in world coords
-            osg::Vec3d t(img.tvec[0], img.tvec[1], img.tvec[2]);
-            osg::Vec3d obj = -(Rt * t);   // C = -R^T * t
+        m_active->selectedCameras = ParallelReduce(poses.size(), std::vector<int>(),
+            [&](size_t begin, size_t end) {
+                std::vector<int> hits;
+                for (size_t index = begin; index < end; index++) {
+                    osg::Vec3d obj = PoseCenter(poses[index]);
+                    osg::Vec3d win = mat.preMult(obj);
+                    if (PointInPolygon(win.x(), h - win.y(), polygon)) {
+                        hits.push_back(static_cast<int>(index));
+                    }
+                }
+                return hits;
+            }, concat, 1024);
+    }
+    polygonPoints.clear();
+    SetCursorMode(MODE_NORMAL);
+    DrawPolygon();
+    UpdateSelect();
+}
+
+// Rasterizes the active model's points into a depth buffer with splats as large as
+// they are drawn and flags the points close to the front-most depth at their pixel
+std::vector<char> OSGCanvas::VisiblePoints()
+{
+    osg::Camera* camera = FocusCamera();
+    osg::Matrixd modelview = camera->getViewMatrix();
+    osg::Matrixd mat = modelview * camera->getProjectionMatrix() * camera->getViewport()->computeWindowMatrix();
+    int w, h;
+    GetClientSize(&w, &h);
+    const std::vector<const Point3D*>& points = m_scene->PointsByIndex();
+    std::vector<float> xs(points.size()), ys(points.size()), depths(points.size());
+    ParallelFor(points.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            osg::Vec3d obj(points[i]->x, points[i]->y, points[i]->z);
             osg::Vec3d win = mat.preMult(obj);
-            if (PointInPolygon(win.x(), h - win.y(), polygon)) {
-                selectedCameras.push_back(index);
-            }
+            xs[i] = static_cast<float>(win.x());
+            ys[i] = static_cast<float>(h - win.y());
+            depths[i] = static_cast<float>(-modelview.preMult(obj).z());
         }
+    }, 16384);
+    DepthBuffer buffer;
+    buffer.Build(xs, ys, depths, w, h, static_cast<int>(std::lround(pointSize)));
+    std::vector<char> visible(points.size());
+    ParallelFor(points.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++)
+            visible[i] = buffer.Visible(xs[i], ys[i], depths[i], m_visibleDepthTolerance);
+    }, 16384);
+    return visible;
+}
+
+// Window coordinate as an int the way PointInPolygon receives it, clamped so points
+// far behind the camera stay representable
+static int WindowCoord(double v)
+{
+    return static_cast<int>(std::max(-1e9, std::min(1e9, v)));
+}
+
+void OSGCanvas::BeginLasso(int x, int y)
+{
+    if (!m_active || !m_scene) return;
+    m_active->lastSelectMode = MODE_POLYGON;
+    m_active->selectedPoints.clear();
+    m_active->selectedCameras.clear();
+    UpdateSelect();
+
+    // Project every point once; the lasso then only revisits points near its growth
+    osg::Matrixd mat = FocusCamera()->getViewMatrix() * FocusCamera()->getProjectionMatrix() *
+        FocusCamera()->getViewport()->computeWindowMatrix();
+    int w, h;
+    GetClientSize(&w, &h);
+    const std::vector<const Point3D*>& points = m_scene->PointsByIndex();
+    std::vector<int> xs(points.size()), ys(points.size());
+    ParallelFor(points.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            osg::Vec3d win = mat.preMult(osg::Vec3d(points[i]->x, points[i]->y, points[i]->z));
+            xs[i] = WindowCoord(win.x());
+            ys[i] = WindowCoord(h - win.y());
+        }
+    }, 16384);
+    std::vector<char> visible;
+    if (m_visibleOnly) visible = VisiblePoints();
+    m_lasso.Begin(std::move(xs), std::move(ys), w, h, m_visibleOnly ? &visible : nullptr);
+    m_lasso.AddVertex(x, y);
+    polygonPoints.assign(1, { x, y });
+    polygonDrawing = true;
+    DrawPolygon();
+}
+
+void OSGCanvas::ExtendLasso(int x, int y)
+{
+    const Point2D& last = polygonPoints.back();
+    if (std::abs(x - last.x) + std::abs(y - last.y) < 3) return;
+    polygonPoints.push_back({ x, y });
+    const std::vector<int>& toggled = m_lasso.AddVertex(x, y);
+    osg::Vec2ubArray* flags = m_active ? PointFlags(m_active->pointsGeode.get()) : nullptr;
+    if (flags && !toggled.empty()) {
+        const std::vector<char>& inside = m_lasso.Inside();
+        for (int i : toggled) (*flags)[i].x() = inside[i] ? 255 : 0;
+        flags->dirty();
     }
+    ShowStatus(wxString::Format("Lasso: %zu points", m_lasso.Count()));
+    DrawPolygon();
+}
+
+void OSGCanvas::FinishLasso()
+{
+    polygonDrawing = false;
+    if (m_active) m_active->selectedPoints = m_lasso.Selected();
+    m_lasso.Clear();
     polygonPoints.clear();
+    ShowStatus(wxString::Format("%zu points selected", m_active ? m_active->selectedPoints.size() : 0));
     SetCursorMode(MODE_NORMAL);
     DrawPolygon();
     UpdateSelect();
 }
 
+void OSGCanvas::ShowStatus(const wxString& text)
+{
+    wxFrame* frame = wxDynamicCast(wxGetTopLevelParent(this), wxFrame);
+    if (frame && frame->GetStatusBar()) frame->SetStatusText(text);
+}
+
 GraphicsWindowWX::GraphicsWindowWX(OSGCanvas* canvas)
 {
     _canvas = canvas;
@@ -1,10 +1,20 @@
 #pragma once
 #include <wx/wx.h>
 #include <wx/glcanvas.h>
-#include <osgViewer/Viewer>
+#include <osgViewer/CompositeViewer>
+#include <osgViewer/View>
 #include <osgViewer/GraphicsWindow>
+#include <osg/BoundingBox>
 #include <osg/Group>
+#include <osg/Switch>
+#include <functional>
+#include <memory>
+#include "EditJournal.h"
+#include "ImageTextures.h"
+#include "LassoSelector.h"
 #include "Scene.h"
+#include "SceneGraph.h"
+#include "Session.h"
 
 class OSGCanvas : public wxGLCanvas {
 public:
@@ -13,25 +23,100 @@ public:
         MODE_RECTANGLE,
         MODE_POLYGON,
         MODE_RECTANGLE_CAMERA,
-        MODE_POLYGON_CAMERA
+        MODE_POLYGON_CAMERA,
+        MODE_LASSO // freehand point selection, previewed while dragging
     };
     struct Point2D { int x, y; };
     void SetCursorMode(CursorMode mode);
     CursorMode GetCursorMode() const { return m_cursorMode; }
+    // Views side by side in the canvas, all drawing the one scene graph through one
+    // GL context so geometry is uploaded once. Selections are per model and show in
+    // every view; they are made in the view last clicked into.
+    enum ViewLayout {
+        LAYOUT_SINGLE = 0, // free view
+        LAYOUT_SPLIT, // free view left, top view right
+        LAYOUT_THREE // free view left, top view and front view stacked on the right
+    };
+    void SetViewLayout(ViewLayout layout);
+    ViewLayout GetViewLayout() const { return m_layout; }
 public:
     OSGCanvas(wxWindow* parent);
-    void SetScene(class Scene* scene);
+    // Models are owned by the caller, the canvas keeps one subgraph and selection per model.
+    // Selection and deletion apply to the active model.
+    void AddScene(class Scene* scene);
+    void RemoveScene(class Scene* scene);
+    void SetActiveScene(class Scene* scene);
+    void SetSceneVisible(class Scene* scene, bool visible);
+    void ReloadScene();
+    // The active scene was moved by Scene::Transform. Positions are updated in the
+    // existing geometry instead of rebuilding it, selections stay valid.
+    void SceneTransformed(const SimilarityTransform& transform);
+    // Errors or track lengths of the active scene's points changed. The shader's
+    // values are refilled in place and the colormap range recomputed for the current
+    // mode; selections stay valid.
+    void PointValuesChanged();
+    void GetSessionState(SessionState& state) const;
+    void RestoreSessionState(const SessionState& state);
     void DeleteSelected();
+    // Told about every edit the canvas makes to a scene, with the ids it removed
+    using EditCallback = std::function<void(class Scene* scene, JournalEdit edit, std::vector<int> ids)>;
+    void SetEditCallback(EditCallback callback) { m_onEdit = std::move(callback); }
     void InvertSelected();
+    void SelectObservedPoints();
+    void SelectObservingCameras();
+    // Replace the camera selection of the active model with the given image positions
+    void SelectCameras(const std::vector<int>& imageIndices);
+    // Points inside the frustums of the selected cameras
+    void SelectPointsInFrustum();
+    void SetFrustumDepthRange(double minDepth, double maxDepth);
     void ResetView();
     void SelectObjectsInPolygon(const std::vector<Point2D>& polygon);
+    // Restrict point selection to points on the visible surface
+    void SetVisibleOnly(bool visibleOnly) { m_visibleOnly = visibleOnly; }
+    // Point coloring, applied to every model. A new mode starts out mapping the
+    // active model's full value range.
+    void SetColorMode(PointColorMode mode);
+    PointColorMode GetColorMode() const { return m_colorMode; }
+    void SetColormap(Colormap colormap);
+    void SetColorRange(float minValue, float maxValue);
+    // How a model's points and cameras differ from another model's, by position, as
+    // shown in the Changes color mode. Edits of the model drop them.
+    void SetChanges(class Scene* scene, std::vector<DiffStatus> pointChanges, std::vector<DiffStatus> imageChanges);
+    // Show the photos of the cameras nearest the eye on their image planes, read from
+    // root + "\\" + image name; an empty root shows plain planes again
+    void SetImageRoot(const wxString& root);
     void SetContextCurrent();
     void DrawPolygon();
-    void DrawCameras();
-    void DrawPoints();
     void ScalePoint(int delta);
     void ScaleCamera(int delta);
 protected:
+    // A loaded model under its own switch node
+    struct Model {
+        class Scene* scene = nullptr;
+        osg::ref_ptr<osg::Switch> node;
+        osg::ref_ptr<osg::Geode> pointsGeode;
+        osg::ref_ptr<osg::Geode> camerasGeode;
+        osg::ref_ptr<osg::Geode> photosGeode; // over the image planes of photoCameras
+        std::vector<int> photoCameras;
+        std::vector<int> selectedPoints;
+        std::vector<int> selectedCameras;
+        std::vector<DiffStatus> pointChanges; // empty unless compared to another model
+        std::vector<DiffStatus> imageChanges;
+        int lastSelectMode = 0;
+        osg::Vec4 tint; // camera color, alpha is how much it is blended into point colors
+    };
+
+    void DrawCameras(Model& model);
+    void DrawPoints(Model& model);
+    void DropPhotos(Model& model);
+    void UpdatePhotos();
+    enum ViewDirection { VIEW_FREE, VIEW_TOP, VIEW_FRONT };
+    void AddView(ViewDirection direction);
+    void LayoutViews();
+    void HomeView(size_t view, const osg::BoundingBox& bb);
+    // View whose viewport holds the window position, y pointing down
+    size_t ViewAt(int x, int y) const;
+    osg::Camera* FocusCamera() const { return m_views[m_focusView]->getCamera(); }
     void OnPaint(wxPaintEvent& event);
     void OnMouse(wxMouseEvent& event);
     void OnSize(wxSizeEvent& event);
@@ -41,10 +126,23 @@ protected:
     void Render();
     void UpdateSceneGraph(bool reset=true);
     void UpdateSelect();
+    void UpdatePointFlags(Model& model);
+    std::vector<char> VisiblePoints();
+    void BeginLasso(int x, int y);
+    void ExtendLasso(int x, int y);
+    void FinishLasso();
+    void ShowStatus(const wxString& text);
 
-    osg::ref_ptr<osgViewer::Viewer> m_viewer;
+    osg::ref_ptr<osgViewer::CompositeViewer> m_viewer;
+    std::vector<osg::ref_ptr<osgViewer::View>> m_views; // m_views[0] is the free view
+    std::vector<ViewDirection> m_viewDirections;
+    size_t m_focusView = 0; // view selections, the overlay and photos go by
+    ViewLayout m_layout = LAYOUT_SINGLE;
     osg::ref_ptr<osg::Group> m_root;
-    class Scene* m_scene = nullptr;
+    std::vector<std::unique_ptr<Model>> m_models;
+    Model* m_active = nullptr;
+    class Scene* m_scene = nullptr; // scene of the active model
+    int m_modelsAdded = 0;
     CursorMode m_cursorMode = MODE_NORMAL;
 
     wxGLContext* m_glContext;
@@ -53,16 +151,23 @@ protected:
     Point2D rectStart, rectEnd;
     std::vector<Point2D> polygonPoints;
     bool polygonDrawing = false;
+    LassoSelector m_lasso;
+    PointShading m_shading;
+    PointColorMode m_colorMode = PointColorMode::Rgb;
+    EditCallback m_onEdit;
+    ImageTextureCache m_photos;
+    size_t m_maxPhotos = 64; // image planes showing their photo at once
+    bool m_photosDirty = false; // a cameras geode was rebuilt since the photos were placed
+    osg::Matrixd m_photoView, m_photoProjection; // view the photos were picked for
 
-    std::vector<int> selectedPoints;
-    std::vector<int> selectedCameras;
-    osg::ref_ptr<osg::Geode> camerasGeode;
-    osg::ref_ptr<osg::Geode> pointsGeode;
     osg::ref_ptr<osg::Camera> hudCamera;
 
     float pointSize = 2.0f;
     float cameraSize = 0.05f;
-    int lastSelectMode = 0;
+    double m_frustumMinDepth = 0;
+    double m_frustumMaxDepth = std::numeric_limits<double>::infinity();
+    bool m_visibleOnly = false;
+    float m_visibleDepthTolerance = 0.02f; // fraction of the front-most depth
 
     wxDECLARE_EVENT_TABLE();
 };
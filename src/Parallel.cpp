@@ -0,0 +1,129 @@
+#include "Parallel.h"
+#include <chrono>
+#include <iterator>
+
+// Index of the pool worker running on this thread, -1 on other threads
+static thread_local int t_workerIndex = -1;
+
+ThreadPool& ThreadPool::Instance()
+{
+	// At least one worker even on a single core, so submitted background jobs never
+	// run inline on the submitting thread
+	static ThreadPool pool(std::max(2u, std::thread::hardware_concurrency()) - 1);
+	return pool;
+}
+
+ThreadPool::ThreadPool(size_t numWorkers)
+{
+	for (size_t i = 0; i < numWorkers; ++i) queues_.push_back(std::make_unique<Queue>());
+	for (size_t i = 0; i < numWorkers; ++i) workers_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex_);
+		stop_ = true;
+	}
+	wake_.notify_all();
+	for (auto& worker : workers_) worker.join();
+}
+
+void ThreadPool::Submit(Task task, const void* group)
+{
+	if (workers_.empty()) {
+		task();
+		return;
+	}
+	// Workers keep their own tasks local, everyone else spreads them out
+	size_t target = t_workerIndex >= 0 ? static_cast<size_t>(t_workerIndex) : next_++ % queues_.size();
+	{
+		// Counted along with the push, so a pop can never decrement it first
+		std::lock_guard<std::mutex> sleepLock(sleepMutex_);
+		std::lock_guard<std::mutex> lock(queues_[target]->mutex);
+		queues_[target]->tasks.push_back({ std::move(task), group });
+		++queued_;
+	}
+	wake_.notify_one();
+}
+
+bool ThreadPool::Pop(Task& task, const void* group)
+{
+	size_t n = queues_.size();
+	if (n == 0) return false;
+	if (group) {
+		// Newest first, a waiter's own tasks were pushed last
+		for (size_t i = 0; i < n; ++i) {
+			Queue& queue = *queues_[i];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			for (auto it = queue.tasks.rbegin(); it != queue.tasks.rend(); ++it) {
+				if (it->group != group) continue;
+				task = std::move(it->task);
+				queue.tasks.erase(std::next(it).base());
+				return true;
+			}
+		}
+		return false;
+	}
+	// Own queue newest first, it is still warm in cache
+	if (t_workerIndex >= 0) {
+		Queue& own = *queues_[t_workerIndex];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.tasks.empty()) {
+			task = std::move(own.tasks.back().task);
+			own.tasks.pop_back();
+			return true;
+		}
+	}
+	// Steal the oldest task of another queue, those tend to be the largest
+	size_t start = t_workerIndex >= 0 ? static_cast<size_t>(t_workerIndex) + 1 : next_.load();
+	for (size_t i = 0; i < n; ++i) {
+		Queue& victim = *queues_[(start + i) % n];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty()) {
+			task = std::move(victim.tasks.front().task);
+			victim.tasks.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ThreadPool::RunOne(const void* group)
+{
+	Task task;
+	if (!Pop(task, group)) return false;
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex_);
+		--queued_;
+	}
+	task();
+	return true;
+}
+
+void ThreadPool::WorkerLoop(size_t index)
+{
+	t_workerIndex = static_cast<int>(index);
+	for (;;) {
+		if (RunOne()) continue;
+		std::unique_lock<std::mutex> lock(sleepMutex_);
+		wake_.wait(lock, [this]() { return stop_ || queued_ > 0; });
+		if (stop_) return;
+	}
+}
+
+void TaskGroup::Wait()
+{
+	ThreadPool& pool = ThreadPool::Instance();
+	for (;;) {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (outstanding_ == 0) return;
+		}
+		if (pool.RunOne(this)) continue;
+		// Remaining tasks are running elsewhere; wake up now and then to help with
+		// tasks they add to the group
+		std::unique_lock<std::mutex> lock(mutex_);
+		done_.wait_for(lock, std::chrono::milliseconds(1), [this]() { return outstanding_ == 0; });
+	}
+}
@@ -0,0 +1,148 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Flag for stopping long running work early. Copies share the same flag.
+class CancellationToken {
+public:
+    CancellationToken() : flag_(std::make_shared<std::atomic<bool>>(false)) {}
+    void Cancel() const { flag_->store(true, std::memory_order_relaxed); }
+    bool IsCancelled() const { return flag_->load(std::memory_order_relaxed); }
+
+private:
+    std::shared_ptr<std::atomic<bool>> flag_;
+};
+
+// Process-wide work-stealing pool. Every worker owns a deque it pushes to and pops
+// from at the back; idle workers steal from the front of the others. Threads that
+// wait for a task group run that group's queued tasks meanwhile, so parallel loops
+// may nest, but never unrelated work such as a background import.
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    static ThreadPool& Instance();
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Worker threads plus the thread that waits for them
+    size_t Concurrency() const { return workers_.size() + 1; }
+    // group tags the task for RunOne, null for tasks nobody waits on
+    void Submit(Task task, const void* group = nullptr);
+    // Run one queued task on the calling thread, with a group only one of its tasks.
+    // False if there was none.
+    bool RunOne(const void* group = nullptr);
+
+private:
+    struct Entry {
+        Task task;
+        const void* group;
+    };
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Entry> tasks;
+    };
+
+    explicit ThreadPool(size_t numWorkers);
+    bool Pop(Task& task, const void* group);
+    void WorkerLoop(size_t index);
+
+    std::vector<std::unique_ptr<Queue>> queues_; // one per worker
+    std::vector<std::thread> workers_;
+    std::atomic<size_t> next_{ 0 }; // round robin target for submissions from outside the pool
+    std::mutex sleepMutex_;
+    std::condition_variable wake_;
+    size_t queued_ = 0; // guarded by sleepMutex_
+    bool stop_ = false;
+};
+
+// Tasks submitted together and waited for together
+class TaskGroup {
+public:
+    TaskGroup() = default;
+    ~TaskGroup() { Wait(); }
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    template <typename Fn>
+    void Run(Fn fn)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++outstanding_;
+        }
+        ThreadPool::Instance().Submit([this, fn]() {
+            fn();
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--outstanding_ == 0) done_.notify_all();
+        }, this);
+    }
+    // Help with the group's queued tasks until every one of them has finished
+    void Wait();
+
+private:
+    std::mutex mutex_;
+    std::condition_variable done_;
+    size_t outstanding_ = 0;
+};
+
+// Number of blocks [0, count) is split into: a few per thread so that idle threads
+// can steal the rest of an uneven loop, but none smaller than minBlock
+inline size_t ParallelBlocks(size_t count, size_t minBlock)
+{
+    size_t maxBlocks = (count + minBlock - 1) / std::max<size_t>(minBlock, 1);
+    return std::min(ThreadPool::Instance().Concurrency() * 4, maxBlocks);
+}
+
+// Split [0, count) into contiguous blocks and run fn(begin, end) on each block on
+// the shared pool. Small ranges run inline on the calling thread. Blocks not yet
+// started are skipped once cancel is cancelled.
+template <typename Fn>
+void ParallelFor(size_t count, Fn&& fn, size_t minBlock = 1024, const CancellationToken* cancel = nullptr)
+{
+    if (count == 0) return;
+    size_t blocks = ParallelBlocks(count, minBlock);
+    if (blocks <= 1) {
+        if (!cancel || !cancel->IsCancelled()) fn(size_t(0), count);
+        return;
+    }
+    size_t block = (count + blocks - 1) / blocks;
+    TaskGroup group;
+    for (size_t begin = block; begin < count; begin += block) {
+        size_t end = std::min(count, begin + block);
+        group.Run([&fn, begin, end, cancel]() {
+            if (!cancel || !cancel->IsCancelled()) fn(begin, end);
+        });
+    }
+    if (!cancel || !cancel->IsCancelled()) fn(size_t(0), block);
+    group.Wait();
+}
+
+// Reduce [0, count) by computing map(begin, end) on blocks in parallel and folding
+// the block results with combine in block order, so combine need not be commutative
+template <typename T, typename Map, typename Combine>
+T ParallelReduce(size_t count, T identity, Map&& map, Combine&& combine, size_t minBlock = 1024,
+                 const CancellationToken* cancel = nullptr)
+{
+    if (count == 0) return identity;
+    size_t blocks = ParallelBlocks(count, minBlock);
+    size_t block = (count + blocks - 1) / blocks;
+    blocks = (count + block - 1) / block;
+    std::vector<T> partial(blocks, identity);
+    ParallelFor(blocks, [&](size_t first, size_t last) {
+        for (size_t b = first; b < last; ++b)
+            partial[b] = map(b * block, std::min(count, (b + 1) * block));
+    }, 1, cancel);
+    T result = std::move(identity);
+    for (T& part : partial) result = combine(std::move(result), std::move(part));
+    return result;
+}
@@ -1,210 +1,1573 @@
 #include "Scene.h"
+#include "CameraModels.h"
+#include "CompressedFile.h"
+#include "MappedFile.h"
+#include "Parallel.h"
+#include "TextParsing.h"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <iomanip>
-#include <iostream>
-#include <set>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+
+// Split a text buffer into about `parts` ranges that start at line beginnings
+static std::vector<const char*> SplitAtLines(const char* data, size_t size, size_t parts)
+{
+	std::vector<const char*> bounds{ data };
+	const char* end = data + size;
+	for (size_t i = 1; i < parts; ++i) {
+		const char* p = std::max(bounds.back(), data + size / parts * i);
+		if (p >= end) break;
+		p = LineEnd(p, end);
+		if (p < end) ++p;
+		if (p > bounds.back() && p < end) bounds.push_back(p);
+	}
+	bounds.push_back(end);
+	return bounds;
+}
+
+// Call f(x, y, point3D_id) for every observation on a POINTS2D line
+template <typename F>
+static void ParseObservations(const char* begin, const char* end, F&& f)
+{
+	FieldReader pts(begin, end);
+	double x, y;
+	int pt_id;
+	while (pts.Next(x) && pts.Next(y) && pts.Next(pt_id)) f(x, y, pt_id);
+}
+
+bool Scene::Import(const std::string& points_path, const std::string& cameras_path, const std::string& images_path,
+	const ImportOptions& options, const CancellationToken* cancel) {
+	MarkEdited();
+	float_observations_ = options.float_observations;
+	// Each file may also be stored as .gz or .zst next to the given path. A compressed
+	// points3D.txt is decompressed on the pool while cameras and images are parsed.
+	std::string resolved_points = FindModelFile(points_path);
+	std::string resolved_cameras = FindModelFile(cameras_path);
+	std::string resolved_images = FindModelFile(images_path);
+	if (resolved_points.empty() || resolved_cameras.empty() || resolved_images.empty()) return false;
+	TextFileReader pt_file;
+	bool pt_opened = false;
+	TaskGroup openPoints;
+	openPoints.Run([&]() { pt_opened = pt_file.Open(resolved_points); });
 
-bool Scene::Import(const std::string& points_path, const std::string& cameras_path, const std::string& images_path) {
 	// Parse cameras.txt
-	std::ifstream cam_file(cameras_path);
-	if (!cam_file.is_open()) return false;
-	std::string line;
-	while (std::getline(cam_file, line)) {
+	std::map<int, Camera>& cameras = cameras_.Mutable();
+	TextFileReader cam_file;
+	if (!cam_file.Open(resolved_cameras)) return false;
+	for (const char* p = cam_file.Data(), *end = p + cam_file.Size(); p < end;) {
+		const char* line_end = LineEnd(p, end);
+		std::string line(p, line_end);
+		p = line_end < end ? line_end + 1 : end;
 		if (line.empty() || line[0] == '#') continue;
 		std::istringstream iss(line);
 		Camera cam;
 		iss >> cam.id >> cam.model >> cam.width >> cam.height;
 		double param;
-		while (iss >> param) cam.params.push_back(param);
-		cameras_[cam.id] = cam;
+		cam.num_params = 0;
+		while (cam.num_params < kMaxCameraParams && iss >> param) cam.params[cam.num_params++] = param;
+		cameras[cam.id] = cam;
 	}
-	cam_file.close();
+	cam_file.Close();
 
-	// Parse images.txt
-	std::ifstream img_file(images_path);
-	if (!img_file.is_open()) return false;
-	while (std::getline(img_file, line)) {
-		if (line.empty() || line[0] == '#') continue;
-		std::istringstream iss(line);
-		Image img;
-		iss >> img.id;
-		img.qvec.resize(4); img.tvec.resize(3);
-		for (int i = 0; i < 4; ++i) iss >> img.qvec[i];
-		for (int i = 0; i < 3; ++i) iss >> img.tvec[i];
-		iss >> img.camera_id >> img.name;
-		// Next line: 2D points (optional, skip for now)
-		std::getline(img_file, line);
-		std::istringstream pts_iss(line);
-		img.points2D.clear();
-		double x, y;
-		int pt_id;
-		while (pts_iss >> x >> y >> pt_id) {
-			img.points2D.push_back({ x, y, pt_id });
-		}
-		images_[img.id] = img;
-
-	}
-	img_file.close();
-
-	// Parse points3D.txt
-	std::ifstream pt_file(points_path);
-	if (!pt_file.is_open()) return false;
-	while (std::getline(pt_file, line)) {
-		if (line.empty() || line[0] == '#') continue;
-		std::istringstream iss(line);
-		Point3D pt;
-		iss >> pt.id >> pt.x >> pt.y >> pt.z;
-		pt.color.resize(3);
-		int r, g, b;
-		iss >> r >> g >> b;
-		pt.color[0] = static_cast<unsigned char>(r);
-		pt.color[1] = static_cast<unsigned char>(g);
-		pt.color[2] = static_cast<unsigned char>(b);
-		iss >> pt.error;
-		int track_id;
-		while (iss >> track_id) pt.track.push_back(track_id);
-		points_[pt.id] = pt;
-	}
-	pt_file.close();
+	// Parse images.txt. Every image takes two lines, so the lines are paired up front
+	// and the pairs parsed in parallel blocks, then appended in file order.
+	TextFileReader img_file;
+	if (!img_file.Open(resolved_images)) return false;
+	struct ImageLines {
+		const char* header;
+		const char* header_end;
+		const char* points;
+		const char* points_end;
+	};
+	std::vector<ImageLines> imageLines;
+	{
+		const char* p = img_file.Data();
+		const char* end = p + img_file.Size();
+		while (p < end) {
+			ImageLines lines;
+			lines.header = p;
+			lines.header_end = LineEnd(p, end);
+			p = lines.header_end < end ? lines.header_end + 1 : end;
+			if (!IsDataLine(lines.header, lines.header_end)) continue;
+			lines.points = p;
+			lines.points_end = LineEnd(p, end);
+			p = lines.points_end < end ? lines.points_end + 1 : end;
+			imageLines.push_back(lines);
+		}
+	}
+	// Lazy imports copy the observation lines into obs.text instead of parsing them
+	Observations& obs = obs_.Mutable();
+	std::vector<uint64_t> textBegin;
+	if (options.lazy_observations) {
+		textBegin.resize(imageLines.size() + 1);
+		uint64_t total = obs.text.size();
+		for (size_t i = 0; i < imageLines.size(); ++i) {
+			ImageLines& lines = imageLines[i];
+			if (lines.points_end > lines.points && lines.points_end[-1] == '\r') --lines.points_end;
+			textBegin[i] = total;
+			total += lines.points_end - lines.points;
+		}
+		textBegin.back() = total;
+		obs.text.resize(total);
+	}
+	struct ImageBlock {
+		std::vector<Image> images;
+		std::vector<std::string_view> names; // into the mapped file
+		std::vector<int> point3D_ids;
+		std::vector<double> xy;
+		std::vector<float> xy_f;
+	};
+	std::vector<ImageBlock> imageBlocks((imageLines.size() + 255) / 256);
+	ParallelFor(imageBlocks.size(), [&](size_t begin, size_t end) {
+		for (size_t b = begin; b < end; ++b) {
+			ImageBlock& block = imageBlocks[b];
+			size_t last = std::min(imageLines.size(), (b + 1) * 256);
+			for (size_t i = b * 256; i < last; ++i) {
+				FieldReader header(imageLines[i].header, imageLines[i].header_end);
+				Image img;
+				std::string_view name;
+				if (!header.Next(img.id)) continue;
+				for (int k = 0; k < 4; ++k) header.Next(img.qvec[k]);
+				for (int k = 0; k < 3; ++k) header.Next(img.tvec[k]);
+				header.Next(img.camera_id);
+				header.Next(name);
+				// 2D points, block-relative until the blocks are joined
+				img.obs_begin = static_cast<uint32_t>(block.point3D_ids.size());
+				if (options.lazy_observations) {
+					img.obs_text_begin = textBegin[i];
+					img.obs_text_size = static_cast<uint32_t>(textBegin[i + 1] - textBegin[i]);
+					img.obs_pending = true;
+					std::memcpy(&obs.text[0] + img.obs_text_begin, imageLines[i].points, img.obs_text_size);
+				}
+				else {
+					ParseObservations(imageLines[i].points, imageLines[i].points_end, [&](double x, double y, int pt_id) {
+						if (float_observations_) {
+							block.xy_f.push_back(static_cast<float>(x));
+							block.xy_f.push_back(static_cast<float>(y));
+						}
+						else {
+							block.xy.push_back(x);
+							block.xy.push_back(y);
+						}
+						block.point3D_ids.push_back(pt_id);
+					});
+				}
+				img.num_obs = static_cast<uint32_t>(block.point3D_ids.size() - img.obs_begin);
+				block.images.push_back(img);
+				block.names.push_back(name);
+			}
+		}
+	}, 1, cancel);
+	if (cancel && cancel->IsCancelled()) return false;
+	size_t totalObs = obs.point3D_ids.size();
+	for (const ImageBlock& block : imageBlocks) totalObs += block.point3D_ids.size();
+	obs.point3D_ids.reserve(totalObs);
+	if (float_observations_) obs.xy_f.reserve(2 * totalObs);
+	else obs.xy.reserve(2 * totalObs);
+	for (ImageBlock& block : imageBlocks) {
+		uint32_t base = static_cast<uint32_t>(obs.point3D_ids.size());
+		for (size_t i = 0; i < block.images.size(); ++i) {
+			Image& img = block.images[i];
+			img.obs_begin += base;
+			img.name = names_->Intern(block.names[i]);
+		}
+		images_.Insert(std::move(block.images));
+		obs.point3D_ids.insert(obs.point3D_ids.end(), block.point3D_ids.begin(), block.point3D_ids.end());
+		obs.xy.insert(obs.xy.end(), block.xy.begin(), block.xy.end());
+		obs.xy_f.insert(obs.xy_f.end(), block.xy_f.begin(), block.xy_f.end());
+		block = ImageBlock();
+	}
+	img_file.Close();
+
+	// Parse points3D.txt in line aligned blocks of about a megabyte
+	openPoints.Wait();
+	if (!pt_opened) return false;
+	std::vector<const char*> bounds = SplitAtLines(pt_file.Data(), pt_file.Size(),
+		std::max<size_t>(1, pt_file.Size() >> 20));
+	std::vector<std::vector<Point3D>> pointBlocks(bounds.size() - 1);
+	// Binary tracks take about half of their text
+	std::vector<std::pmr::memory_resource*> trackArenas(pointBlocks.size());
+	for (size_t b = 0; b < trackArenas.size(); ++b) trackArenas[b] = NewTrackArena((bounds[b + 1] - bounds[b]) / 2);
+	ParallelFor(pointBlocks.size(), [&](size_t begin, size_t end) {
+		PointLine point;
+		for (size_t b = begin; b < end; ++b) {
+			const char* p = bounds[b];
+			const char* block_end = bounds[b + 1];
+			while (p < block_end) {
+				const char* line = p;
+				const char* line_end = LineEnd(line, block_end);
+				p = line_end < block_end ? line_end + 1 : block_end;
+				if (!IsDataLine(line, line_end) || !ParsePointLine(line, line_end, point)) continue;
+				// Built in place: moving a track into a point with another arena would copy it
+				pointBlocks[b].push_back({ point.id, point.x, point.y, point.z, point.color, point.error,
+					std::pmr::vector<int>(point.track.begin(), point.track.end(), trackArenas[b]) });
+			}
+		}
+	}, 1, cancel);
+	if (cancel && cancel->IsCancelled()) return false;
+	// Blocks follow each other in id order in files as COLMAP writes them and are
+	// appended one at a time, anything else is merged in at once
+	bool ascending = true;
+	const Point3D* previous = nullptr;
+	for (const std::vector<Point3D>& block : pointBlocks) {
+		if (block.empty()) continue;
+		if (previous && block.front().id <= previous->id) ascending = false;
+		for (size_t i = 1; i < block.size(); ++i)
+			if (block[i].id <= block[i - 1].id) ascending = false;
+		previous = &block.back();
+	}
+	if (!ascending) {
+		for (size_t b = 1; b < pointBlocks.size(); ++b) {
+			pointBlocks[0].insert(pointBlocks[0].end(), std::make_move_iterator(pointBlocks[b].begin()),
+				std::make_move_iterator(pointBlocks[b].end()));
+			std::vector<Point3D>().swap(pointBlocks[b]);
+		}
+	}
+	for (auto& block : pointBlocks) {
+		points_.Insert(std::move(block));
+		std::vector<Point3D>().swap(block);
+	}
+	pt_file.Close();
+	UpdateCameraPoses();
+	UpdateIndex();
 	return true;
 }
 
+// Format items [0, count) in parallel blocks of blockSize and write them out in order.
+// Only a batch of blocks is held in memory at a time; the writer compresses and
+// writes one batch while the next is formatted.
+template <typename Format>
+static void WriteBlocks(TextFileWriter& file, size_t count, size_t blockSize, Format&& format)
+{
+	size_t batch = ThreadPool::Instance().Concurrency() * 4;
+	std::vector<std::string> blocks(batch);
+	for (size_t first = 0; first < count; first += batch * blockSize) {
+		size_t numBlocks = std::min(batch, (count - first + blockSize - 1) / blockSize);
+		ParallelFor(numBlocks, [&](size_t begin, size_t end) {
+			for (size_t b = begin; b < end; ++b) {
+				std::ostringstream out;
+				size_t itemBegin = first + b * blockSize;
+				format(out, itemBegin, std::min(count, itemBegin + blockSize));
+				blocks[b] = out.str();
+			}
+		}, 1);
+		for (size_t b = 0; b < numBlocks; ++b) file.Write(std::move(blocks[b]));
+	}
+}
+
 bool Scene::Export(const std::string& points_path, const std::string& cameras_path, const std::string& images_path) const {
+	// Paths ending in .gz or .zst are written compressed
 	// Write cameras.txt
-	std::ofstream cam_file(cameras_path);
-	if (!cam_file.is_open()) return false;
-	cam_file << "# Camera list with one line of data per camera:\n";
-	cam_file << "#   CAMERA_ID, MODEL, WIDTH, HEIGHT, PARAMS\n";
-	for (auto it = cameras_.begin(); it != cameras_.end(); ++it) {
+	TextFileWriter cam_file;
+	if (!cam_file.Open(cameras_path)) return false;
+	std::ostringstream cameras;
+	cameras << "# Camera list with one line of data per camera:\n";
+	cameras << "#   CAMERA_ID, MODEL, WIDTH, HEIGHT, PARAMS\n";
+	for (auto it = cameras_->begin(); it != cameras_->end(); ++it) {
 		const Camera& cam = it->second;
-		cam_file << cam.id << " " << cam.model << " " << cam.width << " " << cam.height;
-		for (size_t i = 0; i < cam.params.size(); ++i) cam_file << " " << cam.params[i];
-		cam_file << "\n";
+		cameras << cam.id << " " << cam.model << " " << cam.width << " " << cam.height;
+		for (int i = 0; i < cam.num_params; ++i) cameras << " " << cam.params[i];
+		cameras << "\n";
 	}
-	cam_file.close();
+	cam_file.Write(cameras.str());
+	if (!cam_file.Close()) return false;
 
 	// Write images.txt
-	std::ofstream img_file(images_path);
-	if (!img_file.is_open()) return false;
-	img_file << std::fixed << std::setprecision(12);
-	img_file << "# Image list with one line of data per image:\n";
-	img_file << "#   IMAGE_ID, QVEC (qw, qx, qy, qz), TVEC (tx, ty, tz), CAMERA_ID, NAME\n";
-	for (auto it = images_.begin(); it != images_.end(); ++it) {
-		const Image& img = it->second;
-		img_file << img.id;
-		for (size_t i = 0; i < img.qvec.size(); ++i) img_file << " " << img.qvec[i];
-		for (size_t i = 0; i < img.tvec.size(); ++i) img_file << " " << img.tvec[i];
-		img_file << " " << img.camera_id << " " << img.name << "\n";
-		// 2D points not written for simplicity
-		for (const auto& pt : img.points2D) {
-			img_file << pt.x << " " << pt.y << " " << pt.point3D_id << " ";
-		}
-		img_file << "\n"; // end of 2D points line
-	}
-	img_file.close();
+	TextFileWriter img_file;
+	if (!img_file.Open(images_path)) return false;
+	img_file.Write("# Image list with one line of data per image:\n"
+		"#   IMAGE_ID, QVEC (qw, qx, qy, qz), TVEC (tx, ty, tz), CAMERA_ID, NAME\n");
+	WriteBlocks(img_file, index_->image_ptrs.size(), 64, [&](std::ostringstream& out, size_t begin, size_t end) {
+		out << std::fixed << std::setprecision(12);
+		for (size_t n = begin; n < end; ++n) {
+			const Image& img = *index_->image_ptrs[n];
+			out << img.id;
+			for (size_t i = 0; i < img.qvec.size(); ++i) out << " " << img.qvec[i];
+			for (size_t i = 0; i < img.tvec.size(); ++i) out << " " << img.tvec[i];
+			out << " " << img.camera_id << " " << img.name << "\n";
+			if (img.obs_text_size > 0) {
+				// Unchanged since a lazy import, stream the line as it was read
+				out.write(obs_->text.data() + img.obs_text_begin, img.obs_text_size);
+			}
+			else if (float_observations_) {
+				// Shortest form that reads back to the same float
+				out << std::defaultfloat << std::setprecision(std::numeric_limits<float>::max_digits10);
+				for (uint32_t k = 0; k < img.num_obs; ++k) {
+					size_t i = img.obs_begin + k;
+					out << obs_->xy_f[2 * i] << " " << obs_->xy_f[2 * i + 1] << " " << obs_->point3D_ids[i] << " ";
+				}
+				out << std::fixed << std::setprecision(12);
+			}
+			else {
+				for (uint32_t k = 0; k < img.num_obs; ++k) {
+					size_t i = img.obs_begin + k;
+					out << obs_->xy[2 * i] << " " << obs_->xy[2 * i + 1] << " " << obs_->point3D_ids[i] << " ";
+				}
+			}
+			out << "\n"; // end of 2D points line
+		}
+	});
+	if (!img_file.Close()) return false;
 
 	// Write points3D.txt
-	std::ofstream pt_file(points_path);
-	if (!pt_file.is_open()) return false;
-	pt_file << "# 3D point list with one line of data per point:\n";
-	pt_file << "#   POINT3D_ID, X, Y, Z, R, G, B, ERROR, TRACK[]\n";
-	for (auto it = points_.begin(); it != points_.end(); ++it) {
-		const Point3D& pt = it->second;
-		pt_file << pt.id << " " << pt.x << " " << pt.y << " " << pt.z << " "
+	TextFileWriter pt_file;
+	if (!pt_file.Open(points_path)) return false;
+	pt_file.Write("# 3D point list with one line of data per point:\n"
+		"#   POINT3D_ID, X, Y, Z, R, G, B, ERROR, TRACK[]\n");
+	WriteBlocks(pt_file, index_->point_ptrs.size(), 4096, [&](std::ostringstream& out, size_t begin, size_t end) {
+		for (size_t n = begin; n < end; ++n) {
+			const Point3D& pt = *index_->point_ptrs[n];
+			out << pt.id << " " << pt.x << " " << pt.y << " " << pt.z << " "
 				<< static_cast<int>(pt.color[0]) << " " << static_cast<int>(pt.color[1]) << " " << static_cast<int>(pt.color[2]) << " "
 				<< pt.error;
-		for (size_t i = 0; i < pt.track.size(); ++i) pt_file << " " << pt.track[i];
-		pt_file << "\n";
+			for (size_t i = 0; i < pt.track.size(); ++i) out << " " << pt.track[i];
+			out << "\n";
+		}
+	});
+	return pt_file.Close();
+}
+
+static bool HostLittleEndian()
+{
+	const uint16_t one = 1;
+	unsigned char low;
+	std::memcpy(&low, &one, 1);
+	return low == 1;
+}
+
+// Store value little-endian at p and return the position after it
+template <typename T>
+static char* PutLE(char* p, T value)
+{
+	std::memcpy(p, &value, sizeof(T));
+	if (!HostLittleEndian()) std::reverse(p, p + sizeof(T));
+	return p + sizeof(T);
+}
+
+template <typename T>
+static T GetLE(const char* p)
+{
+	char bytes[sizeof(T)];
+	std::memcpy(bytes, p, sizeof(T));
+	if (!HostLittleEndian()) std::reverse(bytes, bytes + sizeof(T));
+	T value;
+	std::memcpy(&value, bytes, sizeof(T));
+	return value;
+}
+
+bool Scene::ExportPLY(const std::string& path, const std::vector<int>* selection) const
+{
+	std::vector<const Point3D*> selected;
+	if (selection) {
+		selected.reserve(selection->size());
+		for (int index : *selection)
+			if (index >= 0 && index < static_cast<int>(index_->point_ptrs.size())) selected.push_back(index_->point_ptrs[index]);
 	}
-	pt_file.close();
-	return true;
+	const std::vector<const Point3D*>& points = selection ? selected : index_->point_ptrs;
+
+	FILE* file = std::fopen(path.c_str(), "wb");
+	if (!file) return false;
+	std::string header = "ply\nformat binary_little_endian 1.0\ncomment COLMAP sparse points\n"
+		"element vertex " + std::to_string(points.size()) + "\n"
+		"property double x\nproperty double y\nproperty double z\n"
+		"property uchar red\nproperty uchar green\nproperty uchar blue\n"
+		"property float error\nproperty uint track_length\nend_header\n";
+	bool ok = std::fwrite(header.data(), 1, header.size(), file) == header.size();
+
+	// Records are packed into one batch in parallel while the previous batch is
+	// written, alternating between two buffers
+	const size_t kRecordSize = 3 * sizeof(double) + 3 + sizeof(float) + sizeof(uint32_t);
+	const size_t kBatch = 1 << 18;
+	std::vector<char> buffers[2];
+	bool written = true;
+	TaskGroup writer;
+	for (size_t first = 0, batch = 0; ok && first < points.size(); first += kBatch, ++batch) {
+		size_t count = std::min(kBatch, points.size() - first);
+		std::vector<char>& buffer = buffers[batch % 2];
+		buffer.resize(count * kRecordSize);
+		ParallelFor(count, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i) {
+				const Point3D& pt = *points[first + i];
+				char* p = buffer.data() + i * kRecordSize;
+				p = PutLE(p, pt.x);
+				p = PutLE(p, pt.y);
+				p = PutLE(p, pt.z);
+				for (int c = 0; c < 3; ++c) *p++ = static_cast<char>(pt.color[c]);
+				p = PutLE(p, static_cast<float>(pt.error));
+				PutLE(p, static_cast<uint32_t>(pt.track.size() / 2));
+			}
+		}, 16384);
+		writer.Wait();
+		ok = written;
+		writer.Run([&buffer, &written, file]() {
+			if (std::fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size()) written = false;
+		});
+	}
+	writer.Wait();
+	ok = ok && written;
+	return std::fclose(file) == 0 && ok;
 }
 
-void Scene::DeletePoints(std::vector<int>& selected)
+namespace {
+
+enum class PlyType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64 };
+
+struct PlyProperty {
+	std::string name;
+	PlyType type;
+	size_t offset; // within the record
+};
+
+struct PlyElement {
+	std::string name;
+	size_t count = 0;
+	size_t stride = 0;
+	bool has_list = false; // variable sized records, cannot be skipped by stride
+	std::vector<PlyProperty> properties;
+};
+
+bool PlyTypeFromName(const std::string& name, PlyType& type)
 {
-	auto it = points_.begin();
-	int currentIndex = 0;
-	int selIdx = 0;
+	static const std::pair<const char*, PlyType> kTypes[] = {
+		{ "char", PlyType::Int8 }, { "int8", PlyType::Int8 }, { "uchar", PlyType::UInt8 }, { "uint8", PlyType::UInt8 },
+		{ "short", PlyType::Int16 }, { "int16", PlyType::Int16 }, { "ushort", PlyType::UInt16 }, { "uint16", PlyType::UInt16 },
+		{ "int", PlyType::Int32 }, { "int32", PlyType::Int32 }, { "uint", PlyType::UInt32 }, { "uint32", PlyType::UInt32 },
+		{ "float", PlyType::Float32 }, { "float32", PlyType::Float32 }, { "double", PlyType::Float64 }, { "float64", PlyType::Float64 }
+	};
+	for (const auto& t : kTypes) {
+		if (name == t.first) {
+			type = t.second;
+			return true;
+		}
+	}
+	return false;
+}
 
-	while (it != points_.end() && selIdx < selected.size()) {
-		if (currentIndex == selected[selIdx]) {
-			// Erase returns iterator to the next element
-			it = points_.erase(it);
-			++selIdx; // move to next selected index
+size_t PlyTypeSize(PlyType type)
+{
+	switch (type) {
+	case PlyType::Int8: case PlyType::UInt8: return 1;
+	case PlyType::Int16: case PlyType::UInt16: return 2;
+	case PlyType::Int32: case PlyType::UInt32: case PlyType::Float32: return 4;
+	default: return 8;
+	}
+}
+
+double ReadPly(const char* p, PlyType type)
+{
+	switch (type) {
+	case PlyType::Int8: return static_cast<signed char>(*p);
+	case PlyType::UInt8: return static_cast<unsigned char>(*p);
+	case PlyType::Int16: return GetLE<int16_t>(p);
+	case PlyType::UInt16: return GetLE<uint16_t>(p);
+	case PlyType::Int32: return GetLE<int32_t>(p);
+	case PlyType::UInt32: return GetLE<uint32_t>(p);
+	case PlyType::Float32: return GetLE<float>(p);
+	default: return GetLE<double>(p);
+	}
+}
+
+}
+
+bool Scene::ImportPLY(const std::string& path, const CancellationToken* cancel)
+{
+	MarkEdited();
+	MappedFile file;
+	if (!file.Open(path)) return false;
+	const char* p = file.Data();
+	const char* end = p + file.Size();
+
+	// Header, one keyword line at a time up to end_header
+	std::vector<PlyElement> elements;
+	bool binary_le = false;
+	for (bool first = true;; first = false) {
+		if (p >= end) return false;
+		const char* line_end = LineEnd(p, end);
+		std::istringstream iss(std::string(p, line_end));
+		p = line_end < end ? line_end + 1 : end;
+		std::string keyword;
+		iss >> keyword;
+		if (first) {
+			if (keyword != "ply") return false;
 		}
-		else {
-			++it;
+		else if (keyword == "format") {
+			std::string format;
+			iss >> format;
+			binary_le = format == "binary_little_endian";
+		}
+		else if (keyword == "element") {
+			PlyElement element;
+			iss >> element.name >> element.count;
+			elements.push_back(element);
+		}
+		else if (keyword == "property") {
+			if (elements.empty()) return false;
+			PlyElement& element = elements.back();
+			std::string type_name;
+			iss >> type_name;
+			if (type_name == "list") {
+				element.has_list = true;
+				continue;
+			}
+			PlyProperty property;
+			if (!PlyTypeFromName(type_name, property.type)) return false;
+			iss >> property.name;
+			property.offset = element.stride;
+			element.stride += PlyTypeSize(property.type);
+			element.properties.push_back(property);
 		}
-		++currentIndex;
+		else if (keyword == "end_header") break;
 	}
-#if 1
-	//delete unused images
-	std::map<int, int> imgPts;
-	for (auto& img : images_)
-	{
-		imgPts[img.first] = 0;
+	if (!binary_le) return false;
+
+	// Elements ahead of the vertices are skipped, which needs fixed size records
+	const PlyElement* vertex = nullptr;
+	for (const PlyElement& element : elements) {
+		if (element.name == "vertex") {
+			vertex = &element;
+			break;
+		}
+		if (element.has_list) return false;
+		p += element.count * element.stride;
 	}
-	for (auto& pt : points_)
-	{
-		for (int i = 0;i < pt.second.track.size();i += 2)
-		{
-			imgPts[pt.second.track[i]] += 1;
+	if (!vertex || vertex->has_list || p > end || static_cast<size_t>(end - p) / std::max<size_t>(vertex->stride, 1) < vertex->count)
+		return false;
+
+	auto find = [&](std::initializer_list<const char*> names) -> const PlyProperty* {
+		for (const PlyProperty& property : vertex->properties)
+			for (const char* name : names)
+				if (property.name == name) return &property;
+		return nullptr;
+	};
+	const PlyProperty* xyz[3] = { find({ "x" }), find({ "y" }), find({ "z" }) };
+	const PlyProperty* rgb[3] = { find({ "red", "r", "diffuse_red" }), find({ "green", "g", "diffuse_green" }),
+		find({ "blue", "b", "diffuse_blue" }) };
+	const PlyProperty* error = find({ "error" });
+	if (!xyz[0] || !xyz[1] || !xyz[2]) return false;
+
+	int next_id = points_.empty() ? 1 : points_.back().id + 1;
+	std::vector<Point3D> points(vertex->count);
+	const char* records = p;
+	ParallelFor(points.size(), [&](size_t begin, size_t last) {
+		for (size_t i = begin; i < last; ++i) {
+			const char* record = records + i * vertex->stride;
+			Point3D& pt = points[i];
+			pt.id = next_id + static_cast<int>(i);
+			pt.x = ReadPly(record + xyz[0]->offset, xyz[0]->type);
+			pt.y = ReadPly(record + xyz[1]->offset, xyz[1]->type);
+			pt.z = ReadPly(record + xyz[2]->offset, xyz[2]->type);
+			pt.color.fill(255);
+			for (int c = 0; c < 3; ++c) {
+				if (!rgb[c]) continue;
+				double value = ReadPly(record + rgb[c]->offset, rgb[c]->type);
+				// Floating point colors are in [0, 1]
+				if (rgb[c]->type == PlyType::Float32 || rgb[c]->type == PlyType::Float64) value *= 255;
+				pt.color[c] = static_cast<unsigned char>(std::max(0.0, std::min(255.0, std::round(value))));
+			}
+			pt.error = error ? ReadPly(record + error->offset, error->type) : 0;
 		}
+	}, 16384, cancel);
+	if (cancel && cancel->IsCancelled()) return false;
+	points_.Insert(std::move(points));
+	UpdateIndex();
+	return true;
+}
+
+void Scene::DeletePoints(std::vector<int>& selected)
+{
+	MarkEdited();
+	// Chunks without any of the points stay shared with snapshots
+	std::vector<int> ids;
+	ids.reserve(selected.size());
+	for (int index : selected) {
+		if (index >= 0 && index < static_cast<int>(index_->point_ids.size())) ids.push_back(index_->point_ids[index]);
 	}
-	auto itImg = images_.begin();
-	while(itImg!=images_.end())
+	std::sort(ids.begin(), ids.end());
+	points_.Erase(ids);
+
+	// Delete the images no remaining point observes
+	std::vector<const Point3D*> points;
+	points.reserve(points_.size());
+	for (const Point3D& pt : points_) points.push_back(&pt);
+	// Flag per image position that some remaining point observes it
+	std::vector<char> used = ParallelReduce(points.size(), std::vector<char>(),
+		[&](size_t begin, size_t end) {
+			std::vector<char> flags(index_->image_ids.size(), 0);
+			for (size_t p = begin; p < end; ++p) {
+				const std::pmr::vector<int>& track = points[p]->track;
+				for (size_t i = 0; i < track.size(); i += 2) {
+					int index = ImageIndex(track[i]);
+					if (index >= 0) flags[index] = 1;
+				}
+			}
+			return flags;
+		},
+		[](std::vector<char> a, std::vector<char> b) {
+			if (a.empty()) return b;
+			for (size_t i = 0; i < b.size(); ++i) a[i] |= b[i];
+			return a;
+		}, 16384);
+	// The index still has every image at its old position
+	images_.EraseIf([&](const Image& img) { return used.empty() || !used[ImageIndex(img.id)]; });
+	std::vector<CameraPose>& poses = poses_.Mutable();
+	size_t poseOut = 0;
+	for (size_t poseIdx = 0; poseIdx < poses.size(); ++poseIdx)
 	{
-		if (imgPts[itImg->first] == 0)
-		{
-			itImg = images_.erase(itImg);
-		}
-		else itImg++;
+		if (!used.empty() && used[poseIdx]) poses[poseOut++] = poses[poseIdx];
 	}
-	std::cout << images_.size() << std::endl;
-#endif
+	poses.resize(poseOut);
+	UpdateIndex();
 }
 
 void Scene::DeleteImages(std::vector<int>& selected)
 {
-	std::set<int> ids;
-	auto it = images_.begin();
-	int currentIndex = 0;
-	int selIdx = 0;
+	MarkEdited();
+	std::vector<int> positions;
+	for (int index : selected)
+		if (index >= 0 && index < static_cast<int>(index_->image_ids.size())) positions.push_back(index);
+	std::sort(positions.begin(), positions.end());
+	positions.erase(std::unique(positions.begin(), positions.end()), positions.end());
+	// Ids ascend with positions
+	std::vector<int> ids;
+	ids.reserve(positions.size());
+	for (int index : positions) ids.push_back(index_->image_ids[index]);
+	images_.Erase(ids);
 
-	while (it != images_.end() && selIdx < selected.size()) {
-		if (currentIndex == selected[selIdx]) {
-			// Erase returns iterator to the next element
-			ids.insert(it->first);
-			it = images_.erase(it);
+	std::vector<CameraPose>& poses = poses_.Mutable();
+	size_t poseOut = 0, selIdx = 0;
+	for (size_t currentIndex = 0; currentIndex < poses.size(); ++currentIndex) {
+		if (selIdx < positions.size() && positions[selIdx] == static_cast<int>(currentIndex)) {
 			++selIdx; // move to next selected index
+			continue;
+		}
+		poses[poseOut++] = poses[currentIndex];
+	}
+	poses.resize(poseOut);
+
+	// Only the chunks of points that saw a deleted image are written. Points losing
+	// their last observation go; points that never had any, e.g. from a PLY, stay.
+	auto deleted = [&](int id) { return std::binary_search(ids.begin(), ids.end(), id); };
+	std::vector<int> emptied, shortened;
+	points_.EditIf(
+		[&](const Point3D& pt) {
+			for (size_t i = 0; i < pt.track.size(); i += 2)
+				if (deleted(pt.track[i])) return true;
+			return false;
+		},
+		[&](Point3D& pt) {
+			for (int i = pt.track.size()-2; i>=0; i-=2)
+			{
+				if (deleted(pt.track[i]))
+				{
+					pt.track.erase(pt.track.begin() + i, pt.track.begin() + i + 2);
+				}
+			}
+			(pt.track.empty() ? emptied : shortened).push_back(pt.id);
+		});
+	points_.Erase(emptied);
+	UpdateIndex();
+	UpdatePointErrors(shortened);
+}
+
+ConsolidateStats Scene::Consolidate(const ConsolidateOptions& options)
+{
+	MarkEdited();
+	LoadObservations();
+	ConsolidateStats stats;
+	std::vector<Image*> images = MutableImages();
+
+	// image id -> position in images_
+	std::unordered_map<int, int> imageIndex;
+	imageIndex.reserve(images.size());
+	for (size_t i = 0; i < images.size(); ++i) imageIndex[images[i]->id] = static_cast<int>(i);
+
+	// Drop track elements that reference deleted images or out of range observations
+	std::vector<Point3D*> points = MutablePoints();
+	std::atomic<size_t> danglingTrack(0);
+	std::vector<char> emptied(points.size(), 0);
+	ParallelFor(points.size(), [&](size_t begin, size_t end) {
+		size_t dangling = 0;
+		for (size_t p = begin; p < end; ++p) {
+			std::pmr::vector<int>& track = points[p]->track;
+			bool observed = !track.empty();
+			size_t out = 0;
+			for (size_t i = 0; i + 1 < track.size(); i += 2) {
+				auto found = imageIndex.find(track[i]);
+				if (found == imageIndex.end() || track[i + 1] < 0 ||
+					track[i + 1] >= static_cast<int>(images[found->second]->num_obs)) {
+					++dangling;
+					continue;
+				}
+				track[out++] = track[i];
+				track[out++] = track[i + 1];
+			}
+			track.resize(out);
+			emptied[p] = observed && out == 0;
+		}
+		danglingTrack += dangling;
+	});
+
+	// Points that lost all their observations can not be triangulated, drop them.
+	// Points that never had any, e.g. from a PLY, are kept.
+	std::vector<int> emptiedIds;
+	for (size_t p = 0; p < points.size(); ++p)
+		if (emptied[p]) emptiedIds.push_back(points[p]->id);
+	points_.Erase(emptiedIds);
+	stats.removed_points = emptiedIds.size();
+	points = MutablePoints();
+
+	// point id -> new point id
+	std::unordered_map<int, int> pointRemap;
+	pointRemap.reserve(points.size());
+	for (size_t i = 0; i < points.size(); ++i)
+		pointRemap[points[i]->id] = options.renumber_points ? static_cast<int>(i) + 1 : points[i]->id;
+
+	// Null or erase observations of deleted points and rewrite the surviving references.
+	// Erased observations are marked first and squeezed out below.
+	const int kErased = std::numeric_limits<int>::min();
+	Observations& obs = obs_.Mutable();
+	std::vector<uint32_t> kept(images.size());
+	std::atomic<size_t> danglingObs(0);
+	ParallelFor(images.size(), [&](size_t begin, size_t end) {
+		size_t dangling = 0;
+		for (size_t i = begin; i < end; ++i) {
+			int* ids = obs.point3D_ids.data() + images[i]->obs_begin;
+			uint32_t count = 0;
+			bool changed = false;
+			for (uint32_t k = 0; k < images[i]->num_obs; ++k) {
+				int before = ids[k];
+				if (ids[k] != -1) {
+					auto found = pointRemap.find(ids[k]);
+					if (found == pointRemap.end()) {
+						++dangling;
+						ids[k] = options.remove_dangling ? kErased : -1;
+					}
+					else ids[k] = found->second;
+				}
+				if (ids[k] != kErased) ++count;
+				changed |= ids[k] != before;
+			}
+			kept[i] = count;
+			// The line read by a lazy import no longer matches
+			if (changed) images[i]->obs_text_size = 0;
+		}
+		danglingObs += dangling;
+	}, 64);
+
+	// Repack the observations of the surviving images without the holes left by
+	// deleted images and erased observations. obsRemap[i][k] is the new index of
+	// observation k of image i within its image, -1 when erased.
+	std::vector<uint32_t> newBegin(images.size());
+	size_t total = 0;
+	for (size_t i = 0; i < images.size(); ++i) {
+		newBegin[i] = static_cast<uint32_t>(total);
+		total += kept[i];
+	}
+	std::vector<std::vector<int>> obsRemap(options.remove_dangling ? images.size() : 0);
+	std::vector<int> packedIds(total);
+	std::vector<double> packedXY(float_observations_ ? 0 : 2 * total);
+	std::vector<float> packedXYf(float_observations_ ? 2 * total : 0);
+	ParallelFor(images.size(), [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			Image& img = *images[i];
+			if (options.remove_dangling) obsRemap[i].assign(img.num_obs, -1);
+			size_t out = newBegin[i];
+			for (uint32_t k = 0; k < img.num_obs; ++k) {
+				size_t src = img.obs_begin + k;
+				if (obs.point3D_ids[src] == kErased) continue;
+				if (options.remove_dangling) obsRemap[i][k] = static_cast<int>(out - newBegin[i]);
+				packedIds[out] = obs.point3D_ids[src];
+				if (float_observations_) {
+					packedXYf[2 * out] = obs.xy_f[2 * src];
+					packedXYf[2 * out + 1] = obs.xy_f[2 * src + 1];
+				}
+				else {
+					packedXY[2 * out] = obs.xy[2 * src];
+					packedXY[2 * out + 1] = obs.xy[2 * src + 1];
+				}
+				++out;
+			}
+			img.obs_begin = newBegin[i];
+			img.num_obs = kept[i];
+		}
+	}, 64);
+	obs.point3D_ids.swap(packedIds);
+	obs.xy.swap(packedXY);
+	obs.xy_f.swap(packedXYf);
+	if (std::none_of(images.begin(), images.end(), [](const Image* img) { return img->obs_text_size > 0; }))
+		std::string().swap(obs.text);
+
+	// Rewrite tracks into the new image ids and observation indices
+	ParallelFor(points.size(), [&](size_t begin, size_t end) {
+		size_t dangling = 0;
+		for (size_t p = begin; p < end; ++p) {
+			Point3D& pt = *points[p];
+			std::pmr::vector<int>& track = pt.track;
+			size_t out = 0;
+			for (size_t i = 0; i + 1 < track.size(); i += 2) {
+				int index = imageIndex.find(track[i])->second;
+				int idx = options.remove_dangling ? obsRemap[index][track[i + 1]] : track[i + 1];
+				if (idx < 0) {
+					++dangling;
+					continue;
+				}
+				track[out++] = options.renumber_images ? index + 1 : track[i];
+				track[out++] = idx;
+			}
+			track.resize(out);
+			pt.id = pointRemap.find(pt.id)->second;
+		}
+		danglingTrack += dangling;
+	});
+
+	// New ids follow the old order, which the maps keep. Point ids were already
+	// rewritten above.
+	if (options.renumber_images)
+		for (size_t i = 0; i < images.size(); ++i) images[i]->id = static_cast<int>(i) + 1;
+
+	UpdateIndex();
+	stats.dangling_observations = danglingObs;
+	stats.dangling_track_elements = danglingTrack;
+	return stats;
+}
+
+std::shared_ptr<const Scene> Scene::Snapshot() const
+{
+	return std::shared_ptr<const Scene>(new Scene(*this));
+}
+
+void Scene::MarkEdited()
+{
+	static std::atomic<uint64_t> lastVersion(0);
+	version_ = ++lastVersion;
+}
+
+std::pmr::memory_resource* Scene::NewTrackArena(size_t bytes)
+{
+	track_arenas_->push_back(std::make_unique<std::pmr::monotonic_buffer_resource>(std::max<size_t>(bytes, 1024)));
+	return track_arenas_->back().get();
+}
+
+std::vector<Point3D*> Scene::MutablePoints()
+{
+	points_.MakeUnique();
+	std::vector<Point3D*> points;
+	points.reserve(points_.size());
+	for (size_t c = 0; c < points_.NumChunks(); ++c)
+		for (Point3D& pt : points_.MutableChunk(c)) points.push_back(&pt);
+	return points;
+}
+
+std::vector<Image*> Scene::MutableImages()
+{
+	images_.MakeUnique();
+	std::vector<Image*> images;
+	images.reserve(images_.size());
+	for (size_t c = 0; c < images_.NumChunks(); ++c)
+		for (Image& img : images_.MutableChunk(c)) images.push_back(&img);
+	return images;
+}
+
+void Scene::UpdateCameraPoses()
+{
+	std::vector<const Image*> images;
+	images.reserve(images_.size());
+	for (const Image& img : images_) images.push_back(&img);
+	std::vector<CameraPose>& poses = poses_.Overwrite();
+	poses.resize(images.size());
+	ParallelFor(images.size(), [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) poses[i] = ComputeCameraPose(*images[i]);
+	}, 256);
+}
+
+CameraPose Scene::ComputeCameraPose(const Image& img)
+{
+	double w = img.qvec[0], x = img.qvec[1], y = img.qvec[2], z = img.qvec[3];
+	double norm = std::sqrt(w * w + x * x + y * y + z * z);
+	if (norm > 0) { w /= norm; x /= norm; y /= norm; z /= norm; }
+	// Camera-from-world rotation of the quaternion, transposed while filling R
+	double Rcw[9] = {
+		1 - 2 * (y * y + z * z), 2 * (x * y - w * z), 2 * (x * z + w * y),
+		2 * (x * y + w * z), 1 - 2 * (x * x + z * z), 2 * (y * z - w * x),
+		2 * (x * z - w * y), 2 * (y * z + w * x), 1 - 2 * (x * x + y * y)
+	};
+	CameraPose pose;
+	for (int r = 0; r < 3; ++r)
+		for (int c = 0; c < 3; ++c) pose.R[3 * r + c] = Rcw[3 * c + r];
+	// C = -R^T * t
+	for (int r = 0; r < 3; ++r)
+		pose.C[r] = -(pose.R[3 * r] * img.tvec[0] + pose.R[3 * r + 1] * img.tvec[1] + pose.R[3 * r + 2] * img.tvec[2]);
+	return pose;
+}
+
+// Hamilton product a * b of w, x, y, z quaternions
+static std::array<double, 4> QuaternionProduct(const std::array<double, 4>& a, const std::array<double, 4>& b)
+{
+	return {
+		a[0] * b[0] - a[1] * b[1] - a[2] * b[2] - a[3] * b[3],
+		a[0] * b[1] + a[1] * b[0] + a[2] * b[3] - a[3] * b[2],
+		a[0] * b[2] - a[1] * b[3] + a[2] * b[0] + a[3] * b[1],
+		a[0] * b[3] + a[1] * b[2] - a[2] * b[1] + a[3] * b[0]
+	};
+}
+
+// Unit length with w >= 0, so repeated compositions neither drift in length nor
+// flip between the two quaternions of a rotation. False for a zero quaternion.
+static bool NormalizeQuaternion(std::array<double, 4>& q)
+{
+	double norm = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+	if (!(norm > 0) || !std::isfinite(norm)) return false;
+	double inv = q[0] < 0 ? -1 / norm : 1 / norm;
+	for (double& v : q) v *= inv;
+	return true;
+}
+
+bool Scene::Transform(const SimilarityTransform& transform)
+{
+	std::array<double, 4> q = transform.qvec;
+	if (!(transform.scale > 0) || !NormalizeQuaternion(q)) return false;
+	MarkEdited();
+	const double s = transform.scale;
+	const double t[3] = { transform.translation[0], transform.translation[1], transform.translation[2] };
+	const double w = q[0], x = q[1], y = q[2], z = q[3];
+	const double sR[9] = {
+		s * (1 - 2 * (y * y + z * z)), s * 2 * (x * y - w * z), s * 2 * (x * z + w * y),
+		s * 2 * (x * y + w * z), s * (1 - 2 * (x * x + z * z)), s * 2 * (y * z - w * x),
+		s * 2 * (x * z - w * y), s * 2 * (y * z + w * x), s * (1 - 2 * (x * x + y * y))
+	};
+
+	// Points block by block: positions are gathered out of the map nodes into
+	// contiguous arrays, where the multiply-adds run as plain loops the compiler
+	// vectorizes, and scattered back
+	std::vector<Point3D*> points = MutablePoints();
+	const size_t kBlock = 256;
+	ParallelFor((points.size() + kBlock - 1) / kBlock, [&](size_t first, size_t last) {
+		double px[kBlock], py[kBlock], pz[kBlock];
+		for (size_t block = first; block < last; ++block) {
+			Point3D* const* pts = points.data() + block * kBlock;
+			size_t n = std::min(kBlock, points.size() - block * kBlock);
+			for (size_t i = 0; i < n; ++i) {
+				px[i] = pts[i]->x;
+				py[i] = pts[i]->y;
+				pz[i] = pts[i]->z;
+			}
+			for (size_t i = 0; i < n; ++i) {
+				double x0 = px[i], y0 = py[i], z0 = pz[i];
+				px[i] = sR[0] * x0 + sR[1] * y0 + sR[2] * z0 + t[0];
+				py[i] = sR[3] * x0 + sR[4] * y0 + sR[5] * z0 + t[1];
+				pz[i] = sR[6] * x0 + sR[7] * y0 + sR[8] * z0 + t[2];
+			}
+			for (size_t i = 0; i < n; ++i) {
+				pts[i]->x = px[i];
+				pts[i]->y = py[i];
+				pts[i]->z = pz[i];
+			}
+		}
+	}, 16);
+
+	// A camera sees X' = sRX + t where it saw X = R^T (X' - t) / s. Scaling camera
+	// coordinates by s, its rotation becomes Rc R^T, composed as quaternions, and its
+	// translation s tc - Rc R^T t.
+	const std::array<double, 4> qInverse = { q[0], -q[1], -q[2], -q[3] };
+	std::vector<Image*> images = MutableImages();
+	std::vector<CameraPose>& poses = poses_.Mutable();
+	ParallelFor(images.size(), [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			Image& img = *images[i];
+			std::array<double, 4> qc = QuaternionProduct(img.qvec, qInverse);
+			if (NormalizeQuaternion(qc)) img.qvec = qc;
+			// World-from-camera rotation of the new pose, i.e. (Rc R^T)^T
+			CameraPose pose = ComputeCameraPose(img);
+			for (int r = 0; r < 3; ++r)
+				img.tvec[r] = s * img.tvec[r] - (pose.R[r] * t[0] + pose.R[3 + r] * t[1] + pose.R[6 + r] * t[2]);
+			poses[i] = ComputeCameraPose(img);
+		}
+	}, 256);
+	UpdateIndex();
+	return true;
+}
+
+void Scene::UpdateIndex()
+{
+	Index& index = index_.Overwrite();
+	index.point_ptrs.clear();
+	index.point_ids.clear();
+	index.point_ptrs.reserve(points_.size());
+	index.point_ids.reserve(points_.size());
+	for (const Point3D& pt : points_) {
+		index.point_ptrs.push_back(&pt);
+		index.point_ids.push_back(pt.id);
+	}
+	index.image_ptrs.clear();
+	index.image_ids.clear();
+	index.image_ptrs.reserve(images_.size());
+	index.image_ids.reserve(images_.size());
+	pending_images_ = 0;
+	for (const Image& img : images_) {
+		index.image_ptrs.push_back(&img);
+		index.image_ids.push_back(img.id);
+		if (img.obs_pending) ++pending_images_;
+	}
+}
+
+void Scene::DecodeObservations(const Image& img, std::vector<int>& ids, std::vector<double>& xy,
+	std::vector<float>& xy_f) const
+{
+	const char* line = obs_->text.data() + img.obs_text_begin;
+	ParseObservations(line, line + img.obs_text_size, [&](double x, double y, int pt_id) {
+		if (float_observations_) {
+			xy_f.push_back(static_cast<float>(x));
+			xy_f.push_back(static_cast<float>(y));
 		}
 		else {
-			++it;
+			xy.push_back(x);
+			xy.push_back(y);
 		}
-		++currentIndex;
+		ids.push_back(pt_id);
+	});
+}
+
+void Scene::LoadObservations()
+{
+	if (pending_images_ == 0) return;
+	std::vector<const Image*> pending;
+	for (const Image& img : images_)
+		if (img.obs_pending) pending.push_back(&img);
+	struct Decoded {
+		std::vector<int> ids;
+		std::vector<double> xy;
+		std::vector<float> xy_f;
+	};
+	std::vector<Decoded> decoded(pending.size());
+	ParallelFor(pending.size(), [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) DecodeObservations(*pending[i], decoded[i].ids, decoded[i].xy, decoded[i].xy_f);
+	}, 16);
+	Observations& obs = obs_.Mutable();
+	size_t total = obs.point3D_ids.size();
+	for (const Decoded& d : decoded) total += d.ids.size();
+	obs.point3D_ids.reserve(total);
+	if (float_observations_) obs.xy_f.reserve(2 * total);
+	else obs.xy.reserve(2 * total);
+	// Appended after the observations decoded so far, in image order
+	size_t i = 0;
+	images_.EditIf([](const Image& img) { return img.obs_pending; }, [&](Image& img) {
+		Decoded& d = decoded[i++];
+		img.obs_begin = static_cast<uint32_t>(obs.point3D_ids.size());
+		img.num_obs = static_cast<uint32_t>(d.ids.size());
+		img.obs_pending = false;
+		obs.point3D_ids.insert(obs.point3D_ids.end(), d.ids.begin(), d.ids.end());
+		obs.xy.insert(obs.xy.end(), d.xy.begin(), d.xy.end());
+		obs.xy_f.insert(obs.xy_f.end(), d.xy_f.begin(), d.xy_f.end());
+		d = Decoded();
+	});
+	UpdateIndex();
+}
+
+// Position of id in a sorted id list, -1 if absent
+static int FindIndex(const std::vector<int>& ids, int id)
+{
+	auto it = std::lower_bound(ids.begin(), ids.end(), id);
+	if (it == ids.end() || *it != id) return -1;
+	return static_cast<int>(it - ids.begin());
+}
+
+int Scene::PointIndex(int point_id) const
+{
+	return FindIndex(index_->point_ids, point_id);
+}
+
+int Scene::ImageIndex(int image_id) const
+{
+	return FindIndex(index_->image_ids, image_id);
+}
+
+// Sorted, duplicate free indices out of per-thread hits. Few hits are sorted directly,
+// many are deduplicated through a flag per candidate instead.
+static std::vector<int> MergeHits(std::vector<std::vector<int>>& hits, size_t numCandidates)
+{
+	size_t total = 0;
+	for (const auto& h : hits) total += h.size();
+	std::vector<int> result;
+	if (total < numCandidates / 16) {
+		result.reserve(total);
+		for (const auto& h : hits) result.insert(result.end(), h.begin(), h.end());
+		std::sort(result.begin(), result.end());
+		result.erase(std::unique(result.begin(), result.end()), result.end());
 	}
-	//delete unused images
-#if 1
-	std::vector<int> toDelete;
-	for (auto& pt : points_)
-	{
+	else {
+		std::vector<char> flags(numCandidates, 0);
+		for (const auto& h : hits)
+			for (int i : h) flags[i] = 1;
+		for (size_t i = 0; i < numCandidates; ++i)
+			if (flags[i]) result.push_back(static_cast<int>(i));
+	}
+	return result;
+}
 
-		for (int i = pt.second.track.size()-2; i>=0; i-=2)
-		{
-			if (ids.find(pt.second.track[i])!=ids.end())
-			{
-				pt.second.track.erase(pt.second.track.begin() + i, pt.second.track.begin() + i + 2);
+std::vector<int> Scene::PointsObservedBy(const std::vector<int>& imageIndices) const
+{
+	std::vector<std::vector<int>> hits(imageIndices.size());
+	ParallelFor(imageIndices.size(), [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			int index = imageIndices[i];
+			if (index < 0 || index >= static_cast<int>(index_->image_ptrs.size())) continue;
+			const Image& img = *index_->image_ptrs[index];
+			auto visit = [&](int id) {
+				if (id == -1) return;
+				int pointIndex = PointIndex(id);
+				if (pointIndex >= 0) hits[i].push_back(pointIndex);
+			};
+			if (img.obs_pending) {
+				// Read the ids straight off the line without keeping the decoded result
+				const char* line = obs_->text.data() + img.obs_text_begin;
+				ParseObservations(line, line + img.obs_text_size, [&](double, double, int id) { visit(id); });
+				continue;
 			}
+			const int* ids = obs_->point3D_ids.data() + img.obs_begin;
+			for (uint32_t k = 0; k < img.num_obs; ++k) visit(ids[k]);
 		}
-		if (pt.second.track.size() == 0)
-		{
-			toDelete.push_back(pt.first);
+	}, 1);
+	return MergeHits(hits, index_->point_ptrs.size());
+}
+
+std::vector<int> Scene::ImagesObserving(const std::vector<int>& pointIndices) const
+{
+	std::vector<std::vector<int>> hits((pointIndices.size() + 4095) / 4096);
+	ParallelFor(hits.size(), [&](size_t begin, size_t end) {
+		for (size_t chunk = begin; chunk < end; ++chunk) {
+			size_t last = std::min(pointIndices.size(), (chunk + 1) * 4096);
+			for (size_t i = chunk * 4096; i < last; ++i) {
+				int index = pointIndices[i];
+				if (index < 0 || index >= static_cast<int>(index_->point_ptrs.size())) continue;
+				const std::pmr::vector<int>& track = index_->point_ptrs[index]->track;
+				for (size_t t = 0; t + 1 < track.size(); t += 2) {
+					int imageIndex = ImageIndex(track[t]);
+					if (imageIndex >= 0) hits[chunk].push_back(imageIndex);
+				}
+			}
 		}
+	}, 1);
+	return MergeHits(hits, index_->image_ptrs.size());
+}
+
+CovisibilityGraph Scene::BuildCovisibilityGraph(uint32_t minShared) const
+{
+	CovisibilityGraph graph;
+	size_t numImages = index_->image_ptrs.size();
+	size_t numPoints = index_->point_ptrs.size();
+	graph.offsets.assign(numImages + 1, 0);
+	if (numImages == 0) return graph;
+
+	// Image ids are usually close to dense, then a table maps them to positions
+	// without a search per track element
+	std::vector<int> idToIndex;
+	int minId = index_->image_ids.front();
+	if (static_cast<size_t>(index_->image_ids.back() - minId) < 16 * numImages + 1024) {
+		idToIndex.assign(index_->image_ids.back() - minId + 1, -1);
+		for (size_t i = 0; i < numImages; ++i) idToIndex[index_->image_ids[i] - minId] = static_cast<int>(i);
 	}
-	for (int id : toDelete)
-	{
-		points_.erase(id);
+	auto imageIndex = [&](int id) {
+		if (idToIndex.empty()) return ImageIndex(id);
+		return id < minId || id - minId >= static_cast<int>(idToIndex.size()) ? -1 : idToIndex[id - minId];
+	};
+
+	// Tracks packed back to back as a count followed by the ascending, duplicate free
+	// image positions, so one offset reaches all of a point's images
+	std::vector<size_t> trackStart(numPoints + 1, 0);
+	for (size_t p = 0; p < numPoints; ++p) trackStart[p + 1] = trackStart[p] + 1 + index_->point_ptrs[p]->track.size() / 2;
+	std::vector<int> unordered(trackStart[numPoints]);
+	ParallelFor(numPoints, [&](size_t begin, size_t end) {
+		for (size_t p = begin; p < end; ++p) {
+			const std::pmr::vector<int>& track = index_->point_ptrs[p]->track;
+			int* images = unordered.data() + trackStart[p] + 1;
+			int n = 0;
+			for (size_t t = 0; t + 1 < track.size(); t += 2) {
+				int index = imageIndex(track[t]);
+				if (index >= 0) images[n++] = index;
+			}
+			std::sort(images, images + n);
+			images[-1] = static_cast<int>(std::unique(images, images + n) - images);
+		}
+	}, 16384);
+
+	// Reordered by lowest image, so that the tracks through neighbouring images, which
+	// overlap in real captures, lie close together and rows read them from cache
+	std::vector<size_t> bucketStart(numImages + 2, 0);
+	for (size_t p = 0; p < numPoints; ++p) {
+		const int* track = unordered.data() + trackStart[p];
+		bucketStart[(track[0] > 0 ? track[1] : numImages) + 1] += 1 + track[0];
+	}
+	for (size_t i = 0; i <= numImages; ++i) bucketStart[i + 1] += bucketStart[i];
+	std::vector<int> tracks(bucketStart[numImages + 1]);
+	for (size_t p = 0; p < numPoints; ++p) {
+		const int* track = unordered.data() + trackStart[p];
+		size_t& pos = bucketStart[track[0] > 0 ? track[1] : numImages];
+		std::copy(track, track + 1 + track[0], tracks.begin() + pos);
+		trackStart[p] = pos;
+		pos += 1 + track[0];
+	}
+	unordered = std::vector<int>();
+	trackStart = std::vector<size_t>();
+	// Track offsets in their new order, for the passes below to walk tracks sequentially
+	std::vector<size_t> ordered;
+	ordered.reserve(numPoints);
+	for (size_t pos = 0; pos < tracks.size(); pos += 1 + tracks[pos]) ordered.push_back(pos);
+
+	// Tracks through each image: per-block histograms, then every block scatters
+	// into its own slice of each image's list
+	size_t numBlocks = std::min<size_t>(ThreadPool::Instance().Concurrency() * 4, numPoints / 65536 + 1);
+	size_t block = (numPoints + numBlocks - 1) / numBlocks;
+	std::vector<std::vector<size_t>> counts(numBlocks);
+	ParallelFor(numBlocks, [&](size_t first, size_t last) {
+		for (size_t b = first; b < last; ++b) {
+			counts[b].assign(numImages, 0);
+			for (size_t p = b * block; p < std::min(numPoints, (b + 1) * block); ++p) {
+				const int* track = tracks.data() + ordered[p];
+				for (int k = 1; k <= track[0]; ++k) ++counts[b][track[k]];
+			}
+		}
+	}, 1);
+	std::vector<size_t> imageStart(numImages + 1);
+	size_t total = 0;
+	for (size_t i = 0; i < numImages; ++i) {
+		imageStart[i] = total;
+		for (size_t b = 0; b < numBlocks; ++b) {
+			size_t count = counts[b][i];
+			counts[b][i] = total; // becomes the block's write position
+			total += count;
+		}
+	}
+	imageStart[numImages] = total;
+	std::vector<size_t> imageTracks(total);
+	ParallelFor(numBlocks, [&](size_t first, size_t last) {
+		for (size_t b = first; b < last; ++b) {
+			for (size_t p = b * block; p < std::min(numPoints, (b + 1) * block); ++p) {
+				const int* track = tracks.data() + ordered[p];
+				for (int k = 1; k <= track[0]; ++k) imageTracks[counts[b][track[k]]++] = ordered[p];
+			}
+		}
+	}, 1);
+	counts.clear();
+	ordered = std::vector<size_t>();
+
+	// Every row on its own: the partners of an image are counted over the tracks
+	// through it in a dense per-thread accumulator, which touches no shared state and
+	// needs no merging beyond concatenating rows. Row costs vary widely, so runs of
+	// kRows neighbouring rows, which share most tracks, are dealt out round robin.
+	const size_t kRows = 32;
+	std::vector<std::vector<int>> rowPartners(numImages);
+	std::vector<std::vector<uint32_t>> rowWeights(numImages);
+	size_t numRuns = (numImages + kRows - 1) / kRows;
+	size_t numStripes = std::min<size_t>(numRuns, ThreadPool::Instance().Concurrency() * 8);
+	ParallelFor(numStripes, [&](size_t first, size_t last) {
+		std::vector<uint32_t> shared(numImages, 0);
+		std::vector<int> touched;
+		for (size_t stripe = first; stripe < last; ++stripe) {
+			for (size_t run = stripe; run < numRuns; run += numStripes) {
+				for (size_t a = run * kRows; a < std::min(numImages, (run + 1) * kRows); ++a) {
+					for (size_t k = imageStart[a]; k < imageStart[a + 1]; ++k) {
+						const int* track = tracks.data() + imageTracks[k];
+						for (int j = 1; j <= track[0]; ++j) {
+							int b = track[j];
+							if (b != static_cast<int>(a) && shared[b]++ == 0) touched.push_back(b);
+						}
+					}
+					std::sort(touched.begin(), touched.end());
+					for (int b : touched) {
+						if (shared[b] >= minShared) {
+							rowPartners[a].push_back(b);
+							rowWeights[a].push_back(shared[b]);
+						}
+						shared[b] = 0;
+					}
+					touched.clear();
+				}
+			}
+		}
+	}, 1);
+
+	for (size_t i = 0; i < numImages; ++i) graph.offsets[i + 1] = graph.offsets[i] + rowPartners[i].size();
+	graph.partners.resize(graph.offsets[numImages]);
+	graph.weights.resize(graph.offsets[numImages]);
+	ParallelFor(numImages, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			std::copy(rowPartners[i].begin(), rowPartners[i].end(), graph.partners.begin() + graph.offsets[i]);
+			std::copy(rowWeights[i].begin(), rowWeights[i].end(), graph.weights.begin() + graph.offsets[i]);
+		}
+	}, 256);
+	return graph;
+}
+
+std::vector<std::vector<int>> CovisibilityGraph::Components() const
+{
+	// Union-find over the edges, each seen from its lower end; roots stay the lowest
+	// image of their component
+	size_t n = NumImages();
+	std::vector<int> parent(n);
+	std::iota(parent.begin(), parent.end(), 0);
+	auto find = [&](int i) {
+		while (parent[i] != i) {
+			parent[i] = parent[parent[i]];
+			i = parent[i];
+		}
+		return i;
+	};
+	for (size_t a = 0; a < n; ++a) {
+		for (size_t k = offsets[a]; k < offsets[a + 1]; ++k) {
+			if (partners[k] <= static_cast<int>(a)) continue;
+			int ra = find(static_cast<int>(a)), rb = find(partners[k]);
+			if (ra != rb) parent[std::max(ra, rb)] = std::min(ra, rb);
+		}
 	}
-#endif
-}
\ No newline at end of file
+	std::vector<int> label(n, -1);
+	std::vector<std::vector<int>> components;
+	for (size_t i = 0; i < n; ++i) {
+		int root = find(static_cast<int>(i));
+		if (label[root] < 0) {
+			label[root] = static_cast<int>(components.size());
+			components.emplace_back();
+		}
+		components[label[root]].push_back(static_cast<int>(i));
+	}
+	std::stable_sort(components.begin(), components.end(),
+		[](const std::vector<int>& a, const std::vector<int>& b) { return a.size() > b.size(); });
+	return components;
+}
+
+std::vector<int> CovisibilityGraph::WeakImages(size_t minPartners) const
+{
+	std::vector<int> weak;
+	for (size_t i = 0; i < NumImages(); ++i)
+		if (NumPartners(i) < minPartners) weak.push_back(static_cast<int>(i));
+	return weak;
+}
+
+std::vector<int> Scene::PointsInFrustum(const std::vector<int>& imageIndices, double minDepth, double maxDepth) const
+{
+	// Camera-from-world transform and image bounds of each frustum
+	struct Frustum {
+		double R[9], C[3];
+		double fx, fy, cx, cy;
+		double width, height;
+	};
+	std::vector<Frustum> frustums;
+	for (int index : imageIndices) {
+		if (index < 0 || index >= static_cast<int>(index_->image_ptrs.size())) continue;
+		auto cam = cameras_->find(index_->image_ptrs[index]->camera_id);
+		if (cam == cameras_->end()) continue;
+		// Pinhole part of the camera model. Distortion is left out, it only bends the
+		// frustum sides slightly.
+		Frustum f;
+		if (cam->second.num_params < 4 ||
+			!PinholeIntrinsics(CameraModelFromName(cam->second.model), cam->second.params.data(), f.fx, f.fy, f.cx, f.cy))
+			continue;
+		const CameraPose& pose = (*poses_)[index];
+		for (int r = 0; r < 3; ++r)
+			for (int c = 0; c < 3; ++c) f.R[3 * r + c] = pose.R[3 * c + r];
+		for (int i = 0; i < 3; ++i) f.C[i] = pose.C[i];
+		f.width = cam->second.width;
+		f.height = cam->second.height;
+		frustums.push_back(f);
+	}
+	if (frustums.empty()) return {};
+
+	minDepth = std::max(minDepth, 1e-9);
+	std::vector<char> inside(index_->point_ptrs.size(), 0);
+	ParallelFor(index_->point_ptrs.size(), [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			const Point3D& pt = *index_->point_ptrs[i];
+			for (const Frustum& f : frustums) {
+				double dx = pt.x - f.C[0], dy = pt.y - f.C[1], dz = pt.z - f.C[2];
+				double z = f.R[6] * dx + f.R[7] * dy + f.R[8] * dz;
+				if (z < minDepth || z > maxDepth) continue;
+				double u = f.fx * (f.R[0] * dx + f.R[1] * dy + f.R[2] * dz) / z + f.cx;
+				double v = f.fy * (f.R[3] * dx + f.R[4] * dy + f.R[5] * dz) / z + f.cy;
+				if (u >= 0 && u <= f.width && v >= 0 && v <= f.height) {
+					inside[i] = 1;
+					break;
+				}
+			}
+		}
+	});
+	std::vector<int> result;
+	for (size_t i = 0; i < inside.size(); ++i)
+		if (inside[i]) result.push_back(static_cast<int>(i));
+	return result;
+}
+
+// Model of every camera, Invalid where it cannot be projected, counted in unknown.
+// Cameras with fewer parameters than their model reads cannot be projected either.
+static std::unordered_map<int, CameraModelId> ResolveCameraModels(const std::map<int, Camera>& cameras, size_t* unknown)
+{
+	std::unordered_map<int, CameraModelId> models;
+	for (const auto& cam : cameras) {
+		CameraModelId id = CameraModelFromName(cam.second.model);
+		if (cam.second.num_params < CameraModelNumParams(id)) id = CameraModelId::Invalid;
+		if (id == CameraModelId::Invalid && unknown) ++*unknown;
+		models[cam.first] = id;
+	}
+	return models;
+}
+
+void Scene::UpdatePointErrors(const std::vector<int>& pointIds)
+{
+	if (pointIds.empty()) return;
+	std::unordered_map<int, CameraModelId> models = ResolveCameraModels(*cameras_, nullptr);
+	// Observations of pending images are decoded on the side, once per image, and
+	// the images stay pending
+	struct Decoded {
+		std::vector<int> ids;
+		std::vector<double> xy;
+		std::vector<float> xy_f;
+	};
+	std::unordered_map<int, Decoded> decoded;
+	auto observation = [&](const Image& img, uint32_t k, ImagePoint2D& ob) {
+		if (!img.obs_pending) {
+			if (k >= img.num_obs) return false;
+			ob = GetObservation(img, k);
+			return true;
+		}
+		auto it = decoded.find(img.id);
+		if (it == decoded.end()) {
+			it = decoded.emplace(img.id, Decoded()).first;
+			DecodeObservations(img, it->second.ids, it->second.xy, it->second.xy_f);
+		}
+		const Decoded& d = it->second;
+		if (k >= d.ids.size()) return false;
+		if (float_observations_) ob = { d.xy_f[2 * k], d.xy_f[2 * k + 1], d.ids[k] };
+		else ob = { d.xy[2 * k], d.xy[2 * k + 1], d.ids[k] };
+		return true;
+	};
+
+	points_.EditIf(
+		[&](const Point3D& pt) { return std::binary_search(pointIds.begin(), pointIds.end(), pt.id); },
+		[&](Point3D& pt) {
+			double sum = 0;
+			size_t count = 0;
+			for (size_t t = 0; t + 1 < pt.track.size(); t += 2) {
+				int imageIndex = ImageIndex(pt.track[t]);
+				if (imageIndex < 0) continue;
+				const Image& img = *index_->image_ptrs[imageIndex];
+				auto model = models.find(img.camera_id);
+				if (model == models.end() || model->second == CameraModelId::Invalid) continue;
+				ImagePoint2D ob;
+				if (!observation(img, static_cast<uint32_t>(pt.track[t + 1]), ob) || ob.point3D_id != pt.id) continue;
+				const CameraPose& pose = (*poses_)[imageIndex];
+				double dx = pt.x - pose.C[0], dy = pt.y - pose.C[1], dz = pt.z - pose.C[2];
+				double X = pose.R[0] * dx + pose.R[3] * dy + pose.R[6] * dz;
+				double Y = pose.R[1] * dx + pose.R[4] * dy + pose.R[7] * dz;
+				double Z = pose.R[2] * dx + pose.R[5] * dy + pose.R[8] * dz;
+				if (Z <= 0) continue;
+				double u = 0, v = 0;
+				const double* params = cameras_->at(img.camera_id).params.data();
+				DispatchCameraModel(model->second, [&](auto kernel) {
+					ProjectBatch<decltype(kernel)>(params, &X, &Y, &Z, 1, &u, &v);
+				});
+				sum += std::hypot(u - ob.x, v - ob.y);
+				++count;
+			}
+			if (count > 0) pt.error = sum / count;
+		});
+	UpdateIndex();
+}
+
+ReprojectionStats Scene::UpdateReprojectionErrors()
+{
+	MarkEdited();
+	LoadObservations();
+	ReprojectionStats stats;
+	// Resolve each camera's model once; images then run the kernel of their camera
+	std::unordered_map<int, CameraModelId> models = ResolveCameraModels(*cameras_, &stats.unknown_cameras);
+
+	// Per-observation pixel error aligned with the packed observations, NaN where
+	// the observation has no point or the point lies behind the camera
+	const double kNaN = std::numeric_limits<double>::quiet_NaN();
+	std::vector<double> obsError(obs_->point3D_ids.size(), kNaN);
+	ParallelFor(index_->image_ptrs.size(), [&](size_t begin, size_t end) {
+		// Camera-frame coordinates of one image's observed points, structure of arrays
+		std::vector<double> X, Y, Z, u, v;
+		std::vector<uint32_t> slots;
+		for (size_t i = begin; i < end; ++i) {
+			const Image& img = *index_->image_ptrs[i];
+			auto model = models.find(img.camera_id);
+			if (model == models.end() || model->second == CameraModelId::Invalid) continue;
+			const CameraPose& pose = (*poses_)[i];
+			X.clear(); Y.clear(); Z.clear(); slots.clear();
+			for (uint32_t k = 0; k < img.num_obs; ++k) {
+				int pointIndex = obs_->point3D_ids[img.obs_begin + k] == -1 ? -1 : PointIndex(obs_->point3D_ids[img.obs_begin + k]);
+				if (pointIndex < 0) continue;
+				const Point3D& pt = *index_->point_ptrs[pointIndex];
+				double dx = pt.x - pose.C[0], dy = pt.y - pose.C[1], dz = pt.z - pose.C[2];
+				// Camera-from-world is the transpose of pose.R
+				double z = pose.R[2] * dx + pose.R[5] * dy + pose.R[8] * dz;
+				if (z <= 0) continue;
+				X.push_back(pose.R[0] * dx + pose.R[3] * dy + pose.R[6] * dz);
+				Y.push_back(pose.R[1] * dx + pose.R[4] * dy + pose.R[7] * dz);
+				Z.push_back(z);
+				slots.push_back(img.obs_begin + k);
+			}
+			u.resize(X.size());
+			v.resize(X.size());
+			const double* params = cameras_->at(img.camera_id).params.data();
+			DispatchCameraModel(model->second, [&](auto kernel) {
+				ProjectBatch<decltype(kernel)>(params, X.data(), Y.data(), Z.data(), X.size(), u.data(), v.data());
+			});
+			for (size_t n = 0; n < slots.size(); ++n) {
+				ImagePoint2D ob = GetObservation(img, slots[n] - img.obs_begin);
+				obsError[slots[n]] = std::hypot(u[n] - ob.x, v[n] - ob.y);
+			}
+		}
+	}, 16);
+
+	// Mean over each point's track. Track elements name the observation, which must
+	// still point back at the point.
+	std::vector<Point3D*> points = MutablePoints();
+	std::vector<ReprojectionStats> partial((points.size() + 4095) / 4096);
+	ParallelFor(partial.size(), [&](size_t begin, size_t end) {
+		for (size_t chunk = begin; chunk < end; ++chunk) {
+			ReprojectionStats& part = partial[chunk];
+			size_t last = std::min(points.size(), (chunk + 1) * 4096);
+			for (size_t i = chunk * 4096; i < last; ++i) {
+				Point3D& pt = *points[i];
+				double sum = 0;
+				size_t count = 0;
+				for (size_t t = 0; t + 1 < pt.track.size(); t += 2) {
+					int imageIndex = ImageIndex(pt.track[t]);
+					if (imageIndex < 0) continue;
+					const Image& img = *index_->image_ptrs[imageIndex];
+					uint32_t idx = static_cast<uint32_t>(pt.track[t + 1]);
+					if (idx >= img.num_obs || obs_->point3D_ids[img.obs_begin + idx] != pt.id) continue;
+					double e = obsError[img.obs_begin + idx];
+					if (std::isnan(e)) continue;
+					sum += e;
+					++count;
+				}
+				if (count == 0) {
+					++part.unmeasured_points;
+					continue;
+				}
+				pt.error = sum / count;
+				part.observations += count;
+				part.mean_error += sum;
+				++part.points;
+			}
+		}
+	}, 1);
+	for (const ReprojectionStats& part : partial) {
+		stats.points += part.points;
+		stats.unmeasured_points += part.unmeasured_points;
+		stats.observations += part.observations;
+		stats.mean_error += part.mean_error;
+	}
+	if (stats.observations > 0) stats.mean_error /= stats.observations;
+	UpdateIndex();
+	return stats;
+}
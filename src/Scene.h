@@ -1,15 +1,28 @@
 #pragma once
+#include <array>
+#include <limits>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
 #include <map>
 #include <memory>
+#include <memory_resource>
+#include "CowStorage.h"
+#include "StringPool.h"
+
+class CancellationToken;
+
+// Largest parameter count of the COLMAP camera models (FULL_OPENCV, THIN_PRISM_FISHEYE)
+constexpr int kMaxCameraParams = 12;
 
 struct Camera {
     int id;
     std::string model;
     int width, height;
-    std::vector<double> params;
+    std::array<double, kMaxCameraParams> params{};
+    int num_params = 0;
 };
 
 struct ImagePoint2D {
@@ -21,34 +34,226 @@ struct ImagePoint2D {
 struct Image {
     int id;
     int camera_id;
-    std::string name;
-    std::vector<double> qvec; // quaternion
-    std::vector<double> tvec; // translation
-    std::vector<ImagePoint2D> points2D; // (point3D_id, idx)
+    std::string_view name; // interned in the owning Scene
+    std::array<double, 4> qvec; // quaternion
+    std::array<double, 3> tvec; // translation
+    // Observations live in the Scene's packed arrays at [obs_begin, obs_begin + num_obs)
+    uint32_t obs_begin = 0;
+    uint32_t num_obs = 0;
+    // POINTS2D line as read from images.txt, kept by lazy imports in the Scene's text
+    // buffer at [obs_text_begin, obs_text_begin + obs_text_size) and written back
+    // verbatim on export until the observations change
+    uint64_t obs_text_begin = 0;
+    uint32_t obs_text_size = 0;
+    bool obs_pending = false; // line not decoded yet, num_obs is 0 until it is
 };
 
 struct Point3D {
     int id;
     double x, y, z;
-    std::vector<unsigned char> color; // RGB
+    std::array<unsigned char, 3> color; // RGB
     double error;
-    std::vector<int> track; // image ids
+    std::pmr::vector<int> track; // image id, point2D index pairs, allocated from the owning Scene's arenas
+                                 // or, once its chunk was cloned, from the heap
+};
+
+// World-from-camera rotation (row-major) and camera center of an image
+struct CameraPose {
+    double R[9];
+    double C[3];
+};
+
+struct ImportOptions {
+    bool float_observations = false; // store 2D observation coordinates as float32, halving their memory
+    bool lazy_observations = false; // keep observation lines as text and decode them when first needed
+};
+
+struct ConsolidateOptions {
+    bool remove_dangling = false; // erase dangling observations instead of setting point3D_id to -1
+    bool renumber_points = false; // reassign point ids as 1..N in id order
+    bool renumber_images = false; // reassign image ids as 1..N in id order
+};
+
+struct ConsolidateStats {
+    size_t dangling_observations = 0; // observations that referenced a deleted point
+    size_t dangling_track_elements = 0; // track elements that referenced a deleted image or observation
+    size_t removed_points = 0; // points left without any track element
+};
+
+struct ReprojectionStats {
+    size_t points = 0; // points whose error was updated
+    size_t unmeasured_points = 0; // points without a usable observation, error left as is
+    size_t observations = 0; // observations that contributed
+    size_t unknown_cameras = 0; // cameras with a model that cannot be projected or too few parameters
+    double mean_error = 0; // mean pixel error over the contributing observations
+};
+
+// Similarity transform X' = scale * R * X + translation of world coordinates, R being
+// the rotation of qvec (w, x, y, z like Image::qvec)
+struct SimilarityTransform {
+    double scale = 1;
+    std::array<double, 4> qvec = { 1, 0, 0, 0 };
+    std::array<double, 3> translation = { 0, 0, 0 };
+};
+
+// Image-image covisibility as a symmetric sparse matrix over image positions in
+// compressed row form: the partners of image i are partners[offsets[i], offsets[i + 1]),
+// ascending, and weights holds how many points each pair observes in common
+struct CovisibilityGraph {
+    std::vector<size_t> offsets; // one per image plus one
+    std::vector<int> partners;
+    std::vector<uint32_t> weights;
+
+    size_t NumImages() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    size_t NumPartners(size_t image) const { return offsets[image + 1] - offsets[image]; }
+    // Image positions of each connected component, largest component first
+    std::vector<std::vector<int>> Components() const;
+    // Images with fewer than minPartners covisible partners, ascending
+    std::vector<int> WeakImages(size_t minPartners) const;
 };
 
 class Scene {
 public:
-    bool Import(const std::string& points_path, const std::string& cameras_path, const std::string& images_path);
+    Scene() = default;
+    Scene& operator=(const Scene&) = delete;
+
+    // Immutable copy for background jobs such as exports, which read it while the
+    // scene goes on being edited. It shares all storage, so taking it is O(1); the
+    // scene clones a chunk of points or images, or one of its arrays, the first time
+    // it writes there while a snapshot holds it. Observations still pending from a
+    // lazy import are read off their text by the snapshot.
+    std::shared_ptr<const Scene> Snapshot() const;
+    // Changes with every call that edits the scene and is copied into snapshots, so a
+    // scene still matches a snapshot while the versions are equal. Versions are drawn
+    // from one counter for all scenes and never repeat.
+    uint64_t Version() const { return version_; }
+
+    // Import gives up and returns false once cancel is cancelled
+    bool Import(const std::string& points_path, const std::string& cameras_path, const std::string& images_path,
+                const ImportOptions& options = ImportOptions(), const CancellationToken* cancel = nullptr);
     bool Export(const std::string& points_path, const std::string& cameras_path, const std::string& images_path) const;
+    // Binary little-endian PLY of the points with double x, y, z, uchar red, green, blue,
+    // float error and uint track_length (observations of the point). selection limits
+    // the export to those point positions.
+    bool ExportPLY(const std::string& path, const std::vector<int>* selection = nullptr) const;
+    // Add the vertices of a binary little-endian PLY as points with ids following the
+    // existing ones. Positions, colors and error are read; the points have no tracks.
+    bool ImportPLY(const std::string& path, const CancellationToken* cancel = nullptr);
+
+    const std::map<int, Camera>& GetCameras() const { return *cameras_; }
+    const ChunkedIdMap<Image>& GetImages() const { return images_; }
+    const ChunkedIdMap<Point3D>& GetPoints() const { return points_; }
+
+    // Decode the observations of every image still pending from a lazy import.
+    // Consolidate and UpdateReprojectionErrors do this themselves.
+    void LoadObservations();
+    bool HasPendingObservations() const { return pending_images_ > 0; }
+    // k-th observation of an image, k < img.num_obs. Pending images have none.
+    ImagePoint2D GetObservation(const Image& img, size_t k) const {
+        size_t i = img.obs_begin + k;
+        if (float_observations_) return { obs_->xy_f[2 * i], obs_->xy_f[2 * i + 1], obs_->point3D_ids[i] };
+        return { obs_->xy[2 * i], obs_->xy[2 * i + 1], obs_->point3D_ids[i] };
+    }
+    bool HasFloatObservations() const { return float_observations_; }
+    // Cached poses in GetImages() order, kept in sync with deletions
+    const std::vector<CameraPose>& GetCameraPoses() const { return *poses_; }
 
-    const std::map<int, Camera>& GetCameras() const { return cameras_; }
-    const std::map<int, Image>& GetImages() const { return images_; }
-    const std::map<int, Point3D>& GetPoints() const { return points_; }
+    // Selections refer to points and images by their position in GetPoints()/GetImages().
+    // These map between positions and ids without walking the maps.
+    const std::vector<const Point3D*>& PointsByIndex() const { return index_->point_ptrs; }
+    const std::vector<const Image*>& ImagesByIndex() const { return index_->image_ptrs; }
+    int PointIndex(int point_id) const; // -1 if absent
+    int ImageIndex(int image_id) const; // -1 if absent
+
+    // Visibility queries over positional indices, results sorted. Cost grows with the
+    // observations of the given images or the tracks of the given points.
+    std::vector<int> PointsObservedBy(const std::vector<int>& imageIndices) const;
+    std::vector<int> ImagesObserving(const std::vector<int>& pointIndices) const;
+    // Points inside the viewing frustum of any of the given images, limited to depths
+    // along the optical axis within [minDepth, maxDepth]
+    std::vector<int> PointsInFrustum(const std::vector<int>& imageIndices, double minDepth = 0,
+                                     double maxDepth = std::numeric_limits<double>::infinity()) const;
+    // Covisibility of all images from the point tracks. Pairs sharing fewer than
+    // minShared points are left out, so weak links do not hold components together.
+    CovisibilityGraph BuildCovisibilityGraph(uint32_t minShared = 1) const;
 
     void DeletePoints(std::vector<int>& selected);
+    // Points left without observations go. Those that lost some get their error
+    // recomputed over the rest of their track, decoding just the pending images it
+    // names, so a lazy import stays lazy.
     void DeleteImages(std::vector<int>& images);
+    // Repair references between images and points left behind by deletions and
+    // optionally make ids dense. Meant to be run before Export.
+    ConsolidateStats Consolidate(const ConsolidateOptions& options);
+    // Reproject every observed point through its camera model and set each point's
+    // error to the mean pixel distance over its track
+    ReprojectionStats UpdateReprojectionErrors();
+    // Move the whole model into another frame, e.g. to georeference it. Points are
+    // transformed and every pose is updated to see them as before, translations
+    // scaled along. False, changing nothing, for a non-positive scale or zero qvec.
+    bool Transform(const SimilarityTransform& transform);
 
 private:
-    std::map<int, Camera> cameras_;
-    std::map<int, Image> images_;
-    std::map<int, Point3D> points_;
+    // Session files read and write the containers and packed arrays directly
+    friend class SessionFile;
+
+    // Observations of all images packed back to back. Deleted images leave holes
+    // that Consolidate squeezes out. Coordinates are interleaved x,y in xy, or in
+    // xy_f when float_observations_ is set.
+    struct Observations {
+        std::vector<int> point3D_ids;
+        std::vector<double> xy;
+        std::vector<float> xy_f;
+        std::string text; // raw POINTS2D lines of lazily imported images, see Image::obs_text_begin
+    };
+    // Positional index, rebuilt whenever points or images are added, removed or
+    // their chunks cloned
+    struct Index {
+        std::vector<const Point3D*> point_ptrs;
+        std::vector<int> point_ids;
+        std::vector<const Image*> image_ptrs;
+        std::vector<int> image_ids;
+    };
+    using TrackArenas = std::vector<std::unique_ptr<std::pmr::monotonic_buffer_resource>>;
+
+    // Snapshots only
+    Scene(const Scene&) = default;
+
+    // Give the scene a new version, called on entry to every editing call
+    void MarkEdited();
+    void UpdateCameraPoses();
+    void UpdateIndex();
+    // Mean reprojection error over the track of each of these points, ascending ids.
+    // Points without a usable observation keep theirs.
+    void UpdatePointErrors(const std::vector<int>& pointIds);
+    static CameraPose ComputeCameraPose(const Image& img);
+    // Append the observations of a pending image to the given arrays, coordinates
+    // going to xy or xy_f depending on float_observations_
+    void DecodeObservations(const Image& img, std::vector<int>& ids, std::vector<double>& xy,
+                            std::vector<float>& xy_f) const;
+    // New arena for the tracks of points being added, starting with about bytes
+    std::pmr::memory_resource* NewTrackArena(size_t bytes);
+    // Every point and image for writing, chunks shared with snapshots cloned first.
+    // The index is stale afterwards until UpdateIndex.
+    std::vector<Point3D*> MutablePoints();
+    std::vector<Image*> MutableImages();
+
+    // Tracks come from monotonic arenas that only give memory back when the last
+    // Scene or snapshot holding them is gone, so an import makes a few large
+    // allocations instead of several per point and teardown frees them at once.
+    // Deletions leave their memory in the arenas. Parallel parsing gets an arena per
+    // block. Declared before the points so they outlive them.
+    std::shared_ptr<TrackArenas> track_arenas_ = std::make_shared<TrackArenas>();
+    // Append-only, so snapshots read their names while imports intern new ones
+    std::shared_ptr<StringPool> names_ = std::make_shared<StringPool>();
+
+    Cow<std::map<int, Camera>> cameras_;
+    ChunkedIdMap<Image> images_;
+    ChunkedIdMap<Point3D> points_;
+    Cow<Observations> obs_;
+    bool float_observations_ = false;
+    size_t pending_images_ = 0;
+    Cow<std::vector<CameraPose>> poses_;
+    Cow<Index> index_;
+    uint64_t version_ = 0;
 };
@@ -0,0 +1,181 @@
+#include "SceneDiff.h"
+#include "Parallel.h"
+#include "Scene.h"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <string_view>
+#include <unordered_map>
+
+static const double kPi = 3.14159265358979323846;
+
+// Tallies of one block of the point join
+struct PointTally {
+	size_t unchanged = 0;
+	size_t changed = 0;
+	size_t removed = 0;
+	double shift_sum = 0;
+	double max_shift = 0;
+};
+
+// Angle in degrees of the rotation between two world-from-camera rotations,
+// from the trace of Ra^T * Rb
+static double RotationAngle(const CameraPose& a, const CameraPose& b)
+{
+	double trace = 0;
+	for (int k = 0; k < 9; ++k) trace += a.R[k] * b.R[k];
+	double cosine = std::max(-1.0, std::min(1.0, (trace - 1) / 2));
+	return std::acos(cosine) * 180 / kPi;
+}
+
+static double Distance(const double a[3], const double b[3])
+{
+	double dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+	return std::sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+SceneDiff DiffScenes(const Scene& before, const Scene& after, const SceneDiffOptions& options)
+{
+	SceneDiff diff;
+
+	// Points: both lists are ordered by id, so each block of before points walks the
+	// matching stretch of after points. Every after point has at most one partner,
+	// so blocks write disjoint statuses.
+	const std::vector<const Point3D*>& a = before.PointsByIndex();
+	const std::vector<const Point3D*>& b = after.PointsByIndex();
+	diff.before_points.resize(a.size());
+	diff.after_points.assign(b.size(), DiffStatus::Added);
+	PointTally tally = ParallelReduce(a.size(), PointTally(),
+		[&](size_t begin, size_t end) {
+			PointTally t;
+			auto byId = [](const Point3D* p, int id) { return p->id < id; };
+			size_t j = std::lower_bound(b.begin(), b.end(), a[begin]->id, byId) - b.begin();
+			for (size_t i = begin; i < end; ++i) {
+				const Point3D& p = *a[i];
+				while (j < b.size() && b[j]->id < p.id) ++j;
+				if (j == b.size() || b[j]->id != p.id) {
+					diff.before_points[i] = DiffStatus::Removed;
+					++t.removed;
+					continue;
+				}
+				const Point3D& q = *b[j];
+				const double pa[3] = { p.x, p.y, p.z }, pb[3] = { q.x, q.y, q.z };
+				double shift = Distance(pa, pb);
+				bool changed = shift > options.position_tolerance || p.track.size() != q.track.size();
+				DiffStatus status = changed ? DiffStatus::Changed : DiffStatus::Unchanged;
+				diff.before_points[i] = diff.after_points[j] = status;
+				++(changed ? t.changed : t.unchanged);
+				t.shift_sum += shift;
+				t.max_shift = std::max(t.max_shift, shift);
+			}
+			return t;
+		},
+		[](PointTally x, const PointTally& y) {
+			x.unchanged += y.unchanged;
+			x.changed += y.changed;
+			x.removed += y.removed;
+			x.shift_sum += y.shift_sum;
+			x.max_shift = std::max(x.max_shift, y.max_shift);
+			return x;
+		}, 65536);
+	diff.points.unchanged = tally.unchanged;
+	diff.points.changed = tally.changed;
+	diff.points.removed = tally.removed;
+	diff.points.added = b.size() - tally.unchanged - tally.changed;
+	size_t matchedPoints = tally.unchanged + tally.changed;
+	if (matchedPoints > 0) diff.mean_point_shift = tally.shift_sum / matchedPoints;
+	diff.max_point_shift = tally.max_shift;
+
+	// Images: ids need not agree between runs, names do. The before names go into a
+	// hash table that the after images probe in parallel; pose deltas are computed
+	// on the way.
+	const std::vector<const Image*>& beforeImages = before.ImagesByIndex();
+	const std::vector<const Image*>& afterImages = after.ImagesByIndex();
+	const std::vector<CameraPose>& beforePoses = before.GetCameraPoses();
+	const std::vector<CameraPose>& afterPoses = after.GetCameraPoses();
+	std::unordered_map<std::string_view, int> byName;
+	byName.reserve(beforeImages.size());
+	for (size_t i = 0; i < beforeImages.size(); ++i) byName.emplace(beforeImages[i]->name, static_cast<int>(i));
+	std::vector<ImageDelta> deltas(afterImages.size());
+	ParallelFor(afterImages.size(), [&](size_t begin, size_t end) {
+		for (size_t j = begin; j < end; ++j) {
+			ImageDelta& delta = deltas[j];
+			delta = { -1, static_cast<int>(j), 0, 0 };
+			auto found = byName.find(afterImages[j]->name);
+			if (found == byName.end()) continue;
+			delta.before = found->second;
+			delta.rotation = RotationAngle(beforePoses[delta.before], afterPoses[j]);
+			delta.translation = Distance(beforePoses[delta.before].C, afterPoses[j].C);
+		}
+	}, 256);
+
+	diff.before_images.assign(beforeImages.size(), DiffStatus::Removed);
+	diff.after_images.resize(afterImages.size());
+	for (const ImageDelta& delta : deltas) {
+		if (delta.before < 0 || diff.before_images[delta.before] != DiffStatus::Removed) {
+			// Unknown name, or one already matched by an earlier image of the same name
+			diff.after_images[delta.after] = DiffStatus::Added;
+			++diff.images.added;
+			continue;
+		}
+		bool changed = delta.rotation > options.rotation_tolerance || delta.translation > options.position_tolerance;
+		DiffStatus status = changed ? DiffStatus::Changed : DiffStatus::Unchanged;
+		diff.before_images[delta.before] = diff.after_images[delta.after] = status;
+		++(changed ? diff.images.changed : diff.images.unchanged);
+		diff.mean_rotation += delta.rotation;
+		diff.max_rotation = std::max(diff.max_rotation, delta.rotation);
+		diff.mean_translation += delta.translation;
+		diff.max_translation = std::max(diff.max_translation, delta.translation);
+		diff.matched_images.push_back(delta);
+	}
+	diff.images.removed = beforeImages.size() - diff.matched_images.size();
+	if (!diff.matched_images.empty()) {
+		diff.mean_rotation /= diff.matched_images.size();
+		diff.mean_translation /= diff.matched_images.size();
+	}
+	return diff;
+}
+
+// Names of the images with the given status, at most maxListed, then how many more
+static void ListImages(std::ostringstream& out, const char* title, const std::vector<DiffStatus>& statuses,
+	DiffStatus status, const std::vector<const Image*>& images, size_t maxListed)
+{
+	size_t count = std::count(statuses.begin(), statuses.end(), status);
+	if (count == 0) return;
+	out << "\n" << title << ":\n";
+	size_t listed = 0;
+	for (size_t i = 0; i < statuses.size() && listed < maxListed; ++i) {
+		if (statuses[i] != status) continue;
+		out << "  " << images[i]->name << "\n";
+		++listed;
+	}
+	if (count > listed) out << "  ... and " << count - listed << " more\n";
+}
+
+std::string DiffReport(const SceneDiff& diff, const Scene& before, const Scene& after, size_t maxListed)
+{
+	std::ostringstream out;
+	out << "Points: " << diff.points.unchanged << " unchanged, " << diff.points.changed << " changed, "
+		<< diff.points.added << " added, " << diff.points.removed << " removed\n";
+	out << "Point shift: mean " << diff.mean_point_shift << ", max " << diff.max_point_shift << "\n";
+	out << "Images: " << diff.images.unchanged << " unchanged, " << diff.images.changed << " changed, "
+		<< diff.images.added << " added, " << diff.images.removed << " removed\n";
+	out << "Rotation: mean " << diff.mean_rotation << " deg, max " << diff.max_rotation << " deg\n";
+	out << "Camera center shift: mean " << diff.mean_translation << ", max " << diff.max_translation << "\n";
+
+	// The images that moved furthest, by center distance
+	std::vector<const ImageDelta*> moved;
+	for (const ImageDelta& delta : diff.matched_images)
+		if (diff.after_images[delta.after] == DiffStatus::Changed) moved.push_back(&delta);
+	size_t listed = std::min(maxListed, moved.size());
+	std::partial_sort(moved.begin(), moved.begin() + listed, moved.end(),
+		[](const ImageDelta* x, const ImageDelta* y) { return x->translation > y->translation; });
+	const std::vector<const Image*>& afterImages = after.ImagesByIndex();
+	if (listed > 0) out << "\nMost moved images:\n";
+	for (size_t i = 0; i < listed; ++i)
+		out << "  " << afterImages[moved[i]->after]->name << ": " << moved[i]->translation << ", "
+			<< moved[i]->rotation << " deg\n";
+	ListImages(out, "Added images", diff.after_images, DiffStatus::Added, afterImages, maxListed);
+	ListImages(out, "Removed images", diff.before_images, DiffStatus::Removed, before.ImagesByIndex(), maxListed);
+	return out.str();
+}
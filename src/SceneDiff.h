@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class Scene;
+
+// How a point or image of one of two compared models relates to the other model
+enum class DiffStatus : unsigned char { Unchanged = 0, Changed, Added, Removed };
+
+struct SceneDiffOptions {
+    double position_tolerance = 1e-6; // distance a point or camera center may move and still be unchanged
+    double rotation_tolerance = 1e-3; // degrees a camera may turn and still be unchanged
+};
+
+// Pose change of an image found in both models by its name
+struct ImageDelta {
+    int before; // positions in GetImages() of the two models
+    int after;
+    double rotation; // degrees between the two orientations
+    double translation; // distance between the two camera centers
+};
+
+struct DiffCounts {
+    size_t unchanged = 0;
+    size_t changed = 0;
+    size_t added = 0;
+    size_t removed = 0;
+};
+
+// Points are matched by id, images by name. A matched point changed if it moved or
+// its track length differs, a matched image if its pose moved. Statuses are by
+// position: before_* hold Unchanged, Changed or Removed, after_* Unchanged, Changed
+// or Added. Distances are in the models' own frames, which have to agree.
+struct SceneDiff {
+    std::vector<DiffStatus> before_points, after_points;
+    std::vector<DiffStatus> before_images, after_images;
+    std::vector<ImageDelta> matched_images; // in after order
+    DiffCounts points, images;
+    double mean_point_shift = 0, max_point_shift = 0; // over matched points
+    double mean_rotation = 0, max_rotation = 0; // over matched images
+    double mean_translation = 0, max_translation = 0;
+};
+
+// Compare two models, e.g. from two runs of the mapper. Points are joined in
+// parallel blocks over both id-ordered point lists, images through a hash table of
+// the before names probed in parallel, so the cost is linear in the model sizes.
+SceneDiff DiffScenes(const Scene& before, const Scene& after, const SceneDiffOptions& options = SceneDiffOptions());
+// Readable summary of a diff: counts, pose and point shifts, the images that moved
+// most and the names of added and removed images, at most maxListed of each
+std::string DiffReport(const SceneDiff& diff, const Scene& before, const Scene& after, size_t maxListed = 10);
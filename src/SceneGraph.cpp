@@ -0,0 +1,426 @@
+#include "SceneGraph.h"
+#include <osg/BlendFunc>
+#include <osg/Geometry>
+#include <osg/LineWidth>
+#include <osg/Point>
+#include <osg/TexEnv>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <map>
+#include "Parallel.h"
+
+osg::Matrix PoseRotation(const CameraPose& pose)
+{
+    const double* R = pose.R;
+    return osg::Matrix(R[0], R[1], R[2], 0,
+                       R[3], R[4], R[5], 0,
+                       R[6], R[7], R[8], 0,
+                       0, 0, 0, 1);
+}
+
+osg::Vec3d PoseCenter(const CameraPose& pose)
+{
+    return osg::Vec3d(pose.C[0], pose.C[1], pose.C[2]);
+}
+
+osg::Vec4 TintedColor(const Point3D& pt, const osg::Vec4& tint)
+{
+    float a = tint.a();
+    return osg::Vec4((pt.color[0] / 255.0f) * (1 - a) + tint.r() * a,
+                     (pt.color[1] / 255.0f) * (1 - a) + tint.g() * a,
+                     (pt.color[2] / 255.0f) * (1 - a) + tint.b() * a, 1.0f);
+}
+
+osg::Vec4 ModelTint(size_t index)
+{
+    static const osg::Vec4 tints[] = {
+        osg::Vec4(1.0f, 0.0f, 0.0f, 0.0f),
+        osg::Vec4(0.0f, 0.7f, 0.0f, 0.35f),
+        osg::Vec4(1.0f, 0.5f, 0.0f, 0.35f),
+        osg::Vec4(0.6f, 0.0f, 0.8f, 0.35f),
+        osg::Vec4(0.0f, 0.6f, 0.7f, 0.35f),
+        osg::Vec4(0.7f, 0.7f, 0.0f, 0.35f)
+    };
+    return tints[index % (sizeof(tints) / sizeof(tints[0]))];
+}
+
+osg::Vec4 ChangeColor(DiffStatus status)
+{
+    switch (status) {
+    case DiffStatus::Changed: return osg::Vec4(1.0f, 0.55f, 0.0f, 1.0f);
+    case DiffStatus::Added: return osg::Vec4(0.0f, 0.7f, 0.0f, 1.0f);
+    case DiffStatus::Removed: return osg::Vec4(0.9f, 0.0f, 0.0f, 1.0f);
+    default: return osg::Vec4(0.75f, 0.75f, 0.75f, 1.0f);
+    }
+}
+
+// Selected points are blue. Otherwise the color comes from the base color or from
+// a colormap over a value; in membership mode points the selected images do not
+// observe are greyed out, in changes mode the flags pick a ChangeColor.
+static const char* kPointVertexShader = R"(
+#version 120
+attribute vec2 pointValues;
+attribute vec2 pointFlags;
+uniform int colorMode;
+uniform int colormap;
+uniform vec2 valueRange;
+uniform vec3 heightAxis;
+varying vec4 pointColor;
+
+vec3 Viridis(float t)
+{
+    const vec3 c0 = vec3(0.2777273272, 0.0054073445, 0.3340998053);
+    const vec3 c1 = vec3(0.1050930431, 1.4046135299, 1.3845901626);
+    const vec3 c2 = vec3(-0.3308618287, 0.2148475595, 0.0950951630);
+    const vec3 c3 = vec3(-4.6342304990, -5.7991009734, -19.3324409563);
+    const vec3 c4 = vec3(6.2282699363, 14.1799333668, 56.6905526007);
+    const vec3 c5 = vec3(4.7763849977, -13.7451453777, -65.3530326334);
+    const vec3 c6 = vec3(-5.4354558559, 4.6458526122, 26.3124352496);
+    return c0 + t * (c1 + t * (c2 + t * (c3 + t * (c4 + t * (c5 + t * c6)))));
+}
+
+vec3 Turbo(float t)
+{
+    const vec4 r4 = vec4(0.13572138, 4.61539260, -42.66032258, 132.13108234);
+    const vec4 g4 = vec4(0.09140261, 2.19418839, 4.84296658, -14.18503333);
+    const vec4 b4 = vec4(0.10667330, 12.64194608, -60.58204836, 110.36276771);
+    const vec2 r2 = vec2(-152.94239396, 59.28637943);
+    const vec2 g2 = vec2(4.27729857, 2.82956604);
+    const vec2 b2 = vec2(-89.90310912, 27.34824973);
+    vec4 v4 = vec4(1.0, t, t * t, t * t * t);
+    vec2 v2 = v4.zw * v4.z;
+    return vec3(dot(v4, r4) + dot(v2, r2), dot(v4, g4) + dot(v2, g2), dot(v4, b4) + dot(v2, b2));
+}
+
+void main()
+{
+    gl_Position = ftransform();
+    if (pointFlags.x > 0.5) {
+        pointColor = vec4(0.0, 0.0, 1.0, 1.0);
+        return;
+    }
+    if (colorMode == 0) {
+        pointColor = gl_Color;
+        return;
+    }
+    if (colorMode == 4) {
+        pointColor = pointFlags.y > 0.5 ? gl_Color : vec4(0.8, 0.8, 0.8, 1.0);
+        return;
+    }
+    if (colorMode == 5) {
+        int status = int(pointFlags.y * 3.0 + 0.5);
+        pointColor = status == 1 ? vec4(1.0, 0.55, 0.0, 1.0) : status == 2 ? vec4(0.0, 0.7, 0.0, 1.0) :
+                     status == 3 ? vec4(0.9, 0.0, 0.0, 1.0) : vec4(0.75, 0.75, 0.75, 1.0);
+        return;
+    }
+    float value = colorMode == 1 ? dot(gl_Vertex.xyz, heightAxis) : colorMode == 2 ? pointValues.x : pointValues.y;
+    float t = clamp((value - valueRange.x) / max(valueRange.y - valueRange.x, 1e-6), 0.0, 1.0);
+    vec3 rgb = colormap == 0 ? Viridis(t) : colormap == 1 ? Turbo(t) : vec3(t);
+    pointColor = vec4(clamp(rgb, 0.0, 1.0), 1.0);
+}
+)";
+
+static const char* kPointFragmentShader = R"(
+#version 120
+varying vec4 pointColor;
+
+void main()
+{
+    gl_FragColor = pointColor;
+}
+)";
+
+PointShading CreatePointShading()
+{
+    PointShading shading;
+    shading.program = new osg::Program;
+    shading.program->addShader(new osg::Shader(osg::Shader::VERTEX, kPointVertexShader));
+    shading.program->addShader(new osg::Shader(osg::Shader::FRAGMENT, kPointFragmentShader));
+    shading.program->addBindAttribLocation("pointValues", kPointValuesAttribute);
+    shading.program->addBindAttribLocation("pointFlags", kPointFlagsAttribute);
+    shading.colorMode = new osg::Uniform("colorMode", static_cast<int>(PointColorMode::Rgb));
+    shading.colormap = new osg::Uniform("colormap", static_cast<int>(Colormap::Viridis));
+    shading.valueRange = new osg::Uniform("valueRange", osg::Vec2(0.0f, 1.0f));
+    shading.heightAxis = new osg::Uniform("heightAxis", osg::Vec3(0.0f, 0.0f, 1.0f));
+    return shading;
+}
+
+osg::Vec3 SceneUpAxis(const Scene& scene)
+{
+    // Image y points down, so the mean of the cameras' -y axes in world space is up
+    osg::Vec3d up;
+    for (const CameraPose& pose : scene.GetCameraPoses())
+        up -= PoseRotation(pose) * osg::Vec3d(0, 1, 0);
+    if (up.length() < 1e-9) return osg::Vec3(0.0f, 0.0f, 1.0f);
+    up.normalize();
+    return osg::Vec3(up);
+}
+
+osg::Vec2 PointValueRange(const Scene& scene, PointColorMode mode, const osg::Vec3& heightAxis)
+{
+    const std::vector<const Point3D*>& points = scene.PointsByIndex();
+    auto value = [&](const Point3D& pt) {
+        switch (mode) {
+        case PointColorMode::Height: return pt.x * heightAxis.x() + pt.y * heightAxis.y() + pt.z * heightAxis.z();
+        case PointColorMode::Error: return pt.error;
+        case PointColorMode::TrackLength: return static_cast<double>(pt.track.size() / 2);
+        default: return 0.0;
+        }
+    };
+    std::pair<double, double> range = ParallelReduce(points.size(),
+        std::make_pair(DBL_MAX, -DBL_MAX),
+        [&](size_t begin, size_t end) {
+            std::pair<double, double> r(DBL_MAX, -DBL_MAX);
+            for (size_t i = begin; i < end; ++i) {
+                double v = value(*points[i]);
+                r.first = std::min(r.first, v);
+                r.second = std::max(r.second, v);
+            }
+            return r;
+        },
+        [](std::pair<double, double> a, std::pair<double, double> b) {
+            return std::make_pair(std::min(a.first, b.first), std::max(a.second, b.second));
+        }, 65536);
+    if (range.first > range.second) return osg::Vec2(0.0f, 1.0f);
+    return osg::Vec2(static_cast<float>(range.first), static_cast<float>(range.second));
+}
+
+osg::ref_ptr<osg::Geode> BuildPointsGeode(const Scene& scene, const osg::Vec4& tint, float pointSize,
+                                          const PointShading* shading)
+{
+    osg::ref_ptr<osg::Geode> geode = new osg::Geode;
+    osg::ref_ptr<osg::Geometry> pointsGeom = new osg::Geometry;
+    osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array;
+    osg::ref_ptr<osg::Vec4Array> colors = new osg::Vec4Array;
+    const std::vector<const Point3D*>& points = scene.PointsByIndex();
+    vertices->resize(points.size());
+    colors->resize(points.size());
+    ParallelFor(points.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const Point3D& pt = *points[i];
+            (*vertices)[i].set(pt.x, pt.y, pt.z);
+            (*colors)[i] = TintedColor(pt, tint);
+        }
+    }, 16384);
+    pointsGeom->setVertexArray(vertices.get());
+    pointsGeom->setColorArray(colors.get(), osg::Array::BIND_PER_VERTEX);
+    pointsGeom->addPrimitiveSet(new osg::DrawArrays(osg::PrimitiveSet::POINTS, 0, vertices->size()));
+    osg::ref_ptr<osg::Point> pointSizer = new osg::Point(pointSize); // 3 pixels
+    osg::StateSet* stateSet = pointsGeom->getOrCreateStateSet();
+    stateSet->setAttribute(pointSizer.get());
+    stateSet->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
+    if (shading) {
+        osg::ref_ptr<osg::Vec2Array> values = new osg::Vec2Array(points.size());
+        osg::ref_ptr<osg::Vec2ubArray> flags = new osg::Vec2ubArray(points.size());
+        ParallelFor(points.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                const Point3D& pt = *points[i];
+                (*values)[i].set(static_cast<float>(pt.error), static_cast<float>(pt.track.size() / 2));
+                (*flags)[i].set(0, 0);
+            }
+        }, 16384);
+        pointsGeom->setVertexAttribArray(kPointValuesAttribute, values.get(), osg::Array::BIND_PER_VERTEX);
+        pointsGeom->setVertexAttribArray(kPointFlagsAttribute, flags.get(), osg::Array::BIND_PER_VERTEX);
+        flags->setNormalize(true);
+        // Buffer objects let a flag change re-upload just the flags, not the whole geometry
+        pointsGeom->setUseDisplayList(false);
+        pointsGeom->setUseVertexBufferObjects(true);
+        stateSet->setAttributeAndModes(shading->program.get());
+        stateSet->addUniform(shading->colorMode.get());
+        stateSet->addUniform(shading->colormap.get());
+        stateSet->addUniform(shading->valueRange.get());
+        stateSet->addUniform(shading->heightAxis.get());
+    }
+    geode->addDrawable(pointsGeom.get());
+    return geode;
+}
+
+osg::Vec2ubArray* PointFlags(osg::Geode* geode)
+{
+    if (!geode || geode->getNumDrawables() == 0) return nullptr;
+    osg::Geometry* geom = dynamic_cast<osg::Geometry*>(geode->getDrawable(0));
+    return geom ? dynamic_cast<osg::Vec2ubArray*>(geom->getVertexAttribArray(kPointFlagsAttribute)) : nullptr;
+}
+
+osg::ref_ptr<osg::Geode> BuildCamerasGeode(const Scene& scene, const std::vector<int>& selectedCameras,
+                                           const osg::Vec4& tint, float cameraSize,
+                                           const std::vector<DiffStatus>* changes)
+{
+    if (scene.GetImages().size() == 0) return nullptr;
+    std::vector<char> flags(scene.GetImages().size(),0);
+    for (int index : selectedCameras)
+    {
+        flags[index] = 1;
+    }
+    double scale = 0.2;
+    double minx=FLT_MAX, maxx=-FLT_MAX, miny=FLT_MAX, maxy=-FLT_MAX;
+    const std::vector<CameraPose>& poses = scene.GetCameraPoses();
+    for (const CameraPose& pose : poses) {
+        if (pose.C[0] < minx) minx = pose.C[0];
+        if (pose.C[0] > maxx) maxx = pose.C[0];
+        if (pose.C[1] < miny) miny = pose.C[1];
+        if (pose.C[1] > maxy) maxy = pose.C[1];
+    }
+    double dx = maxx - minx;
+    double dy = maxy - miny;
+    scale = 0.5*std::sqrt(dx*dx+dy*dy) * cameraSize; // Size of pyramid
+
+    // State shared by all frustums and by all image planes
+    osg::ref_ptr<osg::StateSet> ssCam = new osg::StateSet;
+    // Enable blending
+    ssCam->setMode(GL_BLEND, osg::StateAttribute::ON);
+    // Set blending function (optional, commonly used for standard alpha blending)
+    ssCam->setAttributeAndModes(new osg::BlendFunc(
+        osg::BlendFunc::SRC_ALPHA, osg::BlendFunc::ONE_MINUS_SRC_ALPHA));
+    osg::ref_ptr<osg::LineWidth> lineWidth = new osg::LineWidth(2.0); // 3 pixels
+    ssCam->setAttribute(lineWidth.get());
+    ssCam->setRenderingHint(osg::StateSet::TRANSPARENT_BIN);
+    ssCam->setMode(GL_DEPTH_WRITEMASK, osg::StateAttribute::OFF);
+    ssCam->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
+
+    // State for transparency
+    osg::ref_ptr<osg::StateSet> ssPlane = new osg::StateSet;
+    ssPlane->setMode(GL_BLEND, osg::StateAttribute::ON);
+    ssPlane->setAttributeAndModes(new osg::BlendFunc(
+        osg::BlendFunc::SRC_ALPHA, osg::BlendFunc::ONE_MINUS_SRC_ALPHA));
+    ssPlane->setRenderingHint(osg::StateSet::TRANSPARENT_BIN);
+    ssPlane->setMode(GL_DEPTH_WRITEMASK, osg::StateAttribute::OFF);
+    ssPlane->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
+
+    // Geometry of each camera is built in parallel; attaching it to the scene graph
+    // and the shared state sets is not thread safe and happens afterwards
+    std::vector<osg::ref_ptr<osg::Geometry>> camGeoms(poses.size());
+    std::vector<osg::ref_ptr<osg::Geometry>> planeGeoms(poses.size());
+    const std::vector<const Image*>& images = scene.ImagesByIndex();
+    const std::map<int, Camera>& cameras = scene.GetCameras();
+    ParallelFor(poses.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            osg::ref_ptr<osg::Geometry> camGeom = new osg::Geometry;
+            osg::ref_ptr<osg::Vec3Array> camVerts = new osg::Vec3Array;
+            osg::ref_ptr<osg::Vec4Array> camColors = new osg::Vec4Array;
+
+            // Define pyramid base in camera local coordinates, as wide as the image
+            // is so a photo shown on the plane is not stretched
+            double aspect = 1.0;
+            auto camera = cameras.find(images[i]->camera_id);
+            if (camera != cameras.end() && camera->second.width > 0 && camera->second.height > 0)
+                aspect = static_cast<double>(camera->second.width) / camera->second.height;
+            osg::Vec3d base[4] = {
+                osg::Vec3d(-scale * aspect, -scale, scale),
+                osg::Vec3d(scale * aspect, -scale, scale),
+                osg::Vec3d(scale * aspect,  scale, scale),
+                osg::Vec3d(-scale * aspect,  scale, scale)
+            };
+            // Transform base to world coordinates
+            osg::Matrix R = PoseRotation(poses[i]);  // world-from-camera rotation
+            osg::Vec3d C = PoseCenter(poses[i]);   // C = -R^T * t
+
+            for (auto& v : base) v = R * v + C;
+            // Apex
+            osg::Vec3d apex = C;
+            // Add vertices
+            camVerts->push_back(apex); // 0
+            for (int j = 0; j < 4; ++j) camVerts->push_back(base[j]); // 1-4
+            // Frustum in the model tint or change color, image plane a lighter shade of it
+            osg::Vec4 camColor = changes ? ChangeColor((*changes)[i]) : osg::Vec4(tint.r(), tint.g(), tint.b(), 1);
+            osg::Vec4 planeColor(camColor.r() * 0.8f + 0.2f, camColor.g() * 0.8f + 0.2f,
+                                 camColor.b() * 0.8f + 0.2f, 0.3f);
+            if (flags[i])
+            {
+                camColor = { 0, 0, 1, 1 };
+                planeColor = { 0.2, 0.2, 1.0, 0.3f };
+            }
+            for (int j = 0; j < 5; ++j) camColors->push_back(camColor);
+            camGeom->setVertexArray(camVerts.get());
+            camGeom->setColorArray(camColors.get(), osg::Array::BIND_PER_VERTEX);
+
+            // Draw base square
+            osg::ref_ptr<osg::DrawElementsUInt> baseLines = new osg::DrawElementsUInt(osg::PrimitiveSet::LINE_LOOP, 0);
+            baseLines->push_back(1); baseLines->push_back(2); baseLines->push_back(3); baseLines->push_back(4);
+            camGeom->addPrimitiveSet(baseLines.get());
+            // Draw sides
+            for (int j = 1; j <= 4; ++j) {
+                osg::ref_ptr<osg::DrawElementsUInt> side = new osg::DrawElementsUInt(osg::PrimitiveSet::LINES, 0);
+                side->push_back(0); side->push_back(j);
+                camGeom->addPrimitiveSet(side.get());
+            }
+
+            // --- Image plane rectangle (filled) ---
+            osg::ref_ptr<osg::Geometry> planeGeom = new osg::Geometry;
+            osg::ref_ptr<osg::Vec3Array> planeVerts = new osg::Vec3Array;
+            for (int j = 0; j < 4; ++j)
+                planeVerts->push_back(base[j]);
+
+            osg::ref_ptr<osg::Vec4Array> planeColors = new osg::Vec4Array;
+            for (int j = 0; j < 4; ++j)
+                planeColors->push_back(planeColor); // semi-transparent green
+
+            planeGeom->setVertexArray(planeVerts.get());
+            planeGeom->setColorArray(planeColors.get(), osg::Array::BIND_PER_VERTEX);
+            planeGeom->addPrimitiveSet(new osg::DrawArrays(osg::PrimitiveSet::QUADS, 0, 4));
+
+            camGeoms[i] = camGeom;
+            planeGeoms[i] = planeGeom;
+        }
+    }, 256);
+
+    osg::ref_ptr<osg::Geode> geode = new osg::Geode;
+    for (size_t i = 0; i < poses.size(); i++) {
+        camGeoms[i]->setStateSet(ssCam.get());
+        planeGeoms[i]->setStateSet(ssPlane.get());
+        geode->addDrawable(camGeoms[i].get());
+        geode->addDrawable(planeGeoms[i].get());
+    }
+    return geode;
+}
+
+std::vector<int> CamerasNearView(const Scene& scene, const osg::Matrixd& view, const osg::Matrixd& projection,
+                                 size_t maxCount)
+{
+    const std::vector<CameraPose>& poses = scene.GetCameraPoses();
+    osg::Matrixd viewProjection = view * projection;
+    osg::Vec3d eye = osg::Matrixd::inverse(view).getTrans();
+    std::vector<std::pair<double, int>> inView;
+    for (size_t i = 0; i < poses.size(); ++i) {
+        osg::Vec3d center = PoseCenter(poses[i]);
+        osg::Vec4d clip = osg::Vec4d(center, 1.0) * viewProjection;
+        if (clip.w() <= 0 || std::abs(clip.x()) > clip.w() || std::abs(clip.y()) > clip.w()) continue;
+        inView.emplace_back((center - eye).length2(), static_cast<int>(i));
+    }
+    size_t count = std::min(maxCount, inView.size());
+    std::partial_sort(inView.begin(), inView.begin() + count, inView.end());
+    std::vector<int> nearest(count);
+    for (size_t i = 0; i < count; ++i) nearest[i] = inView[i].second;
+    return nearest;
+}
+
+osg::ref_ptr<osg::Geode> BuildPhotoPlanesGeode(osg::Geode* camerasGeode, const std::vector<int>& cameras,
+                                               const std::vector<osg::Texture2D*>& textures)
+{
+    osg::ref_ptr<osg::Geode> geode = new osg::Geode;
+    osg::StateSet* stateSet = geode->getOrCreateStateSet();
+    stateSet->setMode(GL_LIGHTING, osg::StateAttribute::OFF);
+    stateSet->setTextureAttribute(0, new osg::TexEnv(osg::TexEnv::REPLACE));
+    // Textures are rows bottom-up, image y points down
+    osg::ref_ptr<osg::Vec2Array> texCoords = new osg::Vec2Array;
+    texCoords->push_back(osg::Vec2(0, 1));
+    texCoords->push_back(osg::Vec2(1, 1));
+    texCoords->push_back(osg::Vec2(1, 0));
+    texCoords->push_back(osg::Vec2(0, 0));
+    for (size_t i = 0; i < cameras.size(); ++i) {
+        // Drawables alternate between frustum and image plane
+        unsigned drawable = 2 * static_cast<unsigned>(cameras[i]) + 1;
+        if (drawable >= camerasGeode->getNumDrawables()) continue;
+        osg::Geometry* plane = dynamic_cast<osg::Geometry*>(camerasGeode->getDrawable(drawable));
+        const osg::Vec3Array* corners = plane ? dynamic_cast<const osg::Vec3Array*>(plane->getVertexArray()) : nullptr;
+        if (!corners || corners->size() != 4) continue;
+        osg::ref_ptr<osg::Geometry> photo = new osg::Geometry;
+        photo->setVertexArray(new osg::Vec3Array(*corners));
+        photo->setTexCoordArray(0, texCoords.get());
+        photo->addPrimitiveSet(new osg::DrawArrays(osg::PrimitiveSet::QUADS, 0, 4));
+        photo->getOrCreateStateSet()->setTextureAttributeAndModes(0, textures[i]);
+        geode->addDrawable(photo.get());
+    }
+    return geode;
+}
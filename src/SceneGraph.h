@@ -0,0 +1,70 @@
+#pragma once
+#include <osg/Geode>
+#include <osg/Array>
+#include <osg/Matrix>
+#include <osg/Program>
+#include <osg/Texture2D>
+#include <osg/Uniform>
+#include <osg/Vec4>
+#include <vector>
+#include "Scene.h"
+#include "SceneDiff.h"
+
+// Scene graph of a model as shown by the editor. Building it needs no GL context,
+// so the canvas and the headless render benchmark share it.
+
+// World-from-camera rotation of a cached pose, for use as R * v
+osg::Matrix PoseRotation(const CameraPose& pose);
+osg::Vec3d PoseCenter(const CameraPose& pose);
+// Point color blended towards the model tint by the tint's alpha
+osg::Vec4 TintedColor(const Point3D& pt, const osg::Vec4& tint);
+// Tint of the index-th loaded model. The first one keeps its original point colors.
+osg::Vec4 ModelTint(size_t index);
+
+// What the point shader colors points by. Switching mode, colormap or range only
+// changes uniforms, the per-point data is uploaded once with the geometry.
+enum class PointColorMode { Rgb = 0, Height, Error, TrackLength, ImageMembership, Changes };
+enum class Colormap { Viridis = 0, Turbo, Gray };
+
+// Vertex attribute locations of the per-point data read by the point shader
+const unsigned kPointValuesAttribute = 6; // vec2: reprojection error, track length
+const unsigned kPointFlagsAttribute = 7;  // normalized ubyte2: selected, observed by the selected images
+                                          // or, in Changes mode, DiffStatus * kChangeFlagStep
+const unsigned char kChangeFlagStep = 85;
+// Color of points and cameras in Changes mode, matching the point shader's
+osg::Vec4 ChangeColor(DiffStatus status);
+
+// Program and uniforms coloring point geometries, shared by every model of a view
+struct PointShading {
+    osg::ref_ptr<osg::Program> program;
+    osg::ref_ptr<osg::Uniform> colorMode;
+    osg::ref_ptr<osg::Uniform> colormap;
+    osg::ref_ptr<osg::Uniform> valueRange; // values mapped to the two ends of the colormap
+    osg::ref_ptr<osg::Uniform> heightAxis;
+};
+PointShading CreatePointShading();
+// Unit vector the scene's cameras agree is up, +z without cameras
+osg::Vec3 SceneUpAxis(const Scene& scene);
+// Smallest and largest value a mode colors the scene's points by
+osg::Vec2 PointValueRange(const Scene& scene, PointColorMode mode, const osg::Vec3& heightAxis);
+
+// All points as one point list geometry. With shading, points are colored by the
+// point shader and highlighted through their flags instead of their colors.
+osg::ref_ptr<osg::Geode> BuildPointsGeode(const Scene& scene, const osg::Vec4& tint, float pointSize,
+                                          const PointShading* shading = nullptr);
+// Flags array of a geode built with shading, null otherwise
+osg::Vec2ubArray* PointFlags(osg::Geode* geode);
+// Frustum wireframe and image plane per image, selectedCameras (positions) in blue.
+// With changes, one per image, the rest are in their ChangeColor instead of the tint.
+// Null when the scene has no images.
+osg::ref_ptr<osg::Geode> BuildCamerasGeode(const Scene& scene, const std::vector<int>& selectedCameras,
+                                           const osg::Vec4& tint, float cameraSize,
+                                           const std::vector<DiffStatus>* changes = nullptr);
+
+// Positions of the cameras whose centers are in view, nearest to the eye first
+std::vector<int> CamerasNearView(const Scene& scene, const osg::Matrixd& view, const osg::Matrixd& projection,
+                                 size_t maxCount);
+// Image planes of a cameras geode showing photos: one opaque quad per camera
+// position over its plane, drawn with the texture of the same index
+osg::ref_ptr<osg::Geode> BuildPhotoPlanesGeode(osg::Geode* camerasGeode, const std::vector<int>& cameras,
+                                               const std::vector<osg::Texture2D*>& textures);
@@ -0,0 +1,401 @@
+#include "Session.h"
+#include "MappedFile.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace {
+
+const char kMagic[8] = { 'C', 'E', 'S', 'E', 'S', 'S', 'N', '\0' };
+
+enum SectionTag : uint32_t {
+	kSectionCameras = 1,
+	kSectionImages,
+	kSectionNames,
+	kSectionObsIds,
+	kSectionObsXY,
+	kSectionObsXYFloat,
+	kSectionPoints,
+	kSectionTracks,
+	kSectionPoses,
+	kSectionSelPoints,
+	kSectionSelCameras,
+	kSectionView,
+	kSectionModelDir
+};
+
+// On-disk records. Field order and widths are part of the format, bump
+// SessionFile::kVersion when changing any of them.
+struct FileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t sectionCount;
+	uint64_t fileSize;
+};
+
+struct SectionEntry {
+	uint32_t tag;
+	uint32_t reserved;
+	uint64_t offset;
+	uint64_t size;
+};
+
+struct CameraRecord {
+	int32_t id, width, height, num_params;
+	char model[32];
+	double params[kMaxCameraParams];
+};
+
+struct ImageRecord {
+	int32_t id, camera_id;
+	uint32_t name_offset, name_length;
+	double qvec[4];
+	double tvec[3];
+	uint32_t obs_begin, num_obs;
+};
+
+struct PointRecord {
+	int32_t id;
+	uint8_t color[3];
+	uint8_t pad;
+	double x, y, z, error;
+	uint64_t track_begin;
+	uint32_t track_length;
+	uint32_t pad2;
+};
+
+struct ViewRecord {
+	double viewMatrix[16];
+	int32_t cursorMode, lastSelectMode;
+	float pointSize, cameraSize;
+};
+
+static_assert(sizeof(FileHeader) == 24, "session layout");
+static_assert(sizeof(SectionEntry) == 24, "session layout");
+static_assert(sizeof(CameraRecord) == 144, "session layout");
+static_assert(sizeof(ImageRecord) == 80, "session layout");
+static_assert(sizeof(PointRecord) == 56, "session layout");
+static_assert(sizeof(ViewRecord) == 144, "session layout");
+static_assert(sizeof(CameraPose) == 96, "session layout");
+
+struct Section {
+	uint32_t tag;
+	const void* data;
+	size_t size;
+};
+
+size_t Align8(size_t n) { return (n + 7) & ~size_t(7); }
+
+bool IsLittleEndian()
+{
+	uint16_t probe = 1;
+	return *reinterpret_cast<const uint8_t*>(&probe) == 1;
+}
+
+// Section lookup over a mapped file, with bounds already validated
+class SectionReader {
+public:
+	SectionReader(const char* base, const SectionEntry* entries, uint32_t count)
+		: base_(base), entries_(entries), count_(count) {}
+
+	template <typename T>
+	const T* Get(uint32_t tag, size_t& count) const
+	{
+		for (uint32_t i = 0; i < count_; ++i) {
+			if (entries_[i].tag != tag) continue;
+			if (entries_[i].size % sizeof(T) != 0) break;
+			count = static_cast<size_t>(entries_[i].size / sizeof(T));
+			return reinterpret_cast<const T*>(base_ + entries_[i].offset);
+		}
+		count = 0;
+		return nullptr;
+	}
+
+private:
+	const char* base_;
+	const SectionEntry* entries_;
+	uint32_t count_;
+};
+
+}
+
+std::vector<char> SessionFile::Serialize(const Scene& scene, const SessionState& state)
+{
+	std::vector<CameraRecord> cameras;
+	cameras.reserve(scene.cameras_->size());
+	for (const auto& it : *scene.cameras_) {
+		const Camera& cam = it.second;
+		CameraRecord rec = {};
+		rec.id = cam.id;
+		rec.width = cam.width;
+		rec.height = cam.height;
+		rec.num_params = cam.num_params;
+		std::strncpy(rec.model, cam.model.c_str(), sizeof(rec.model) - 1);
+		for (int i = 0; i < cam.num_params; ++i) rec.params[i] = cam.params[i];
+		cameras.push_back(rec);
+	}
+
+	// Observations still pending from a lazy import are decoded into copies of the
+	// packed arrays, after the ones decoded already
+	const bool pending = scene.HasPendingObservations();
+	std::vector<int> obsIds;
+	std::vector<double> obsXY;
+	std::vector<float> obsXYf;
+	if (pending) {
+		obsIds = scene.obs_->point3D_ids;
+		obsXY = scene.obs_->xy;
+		obsXYf = scene.obs_->xy_f;
+	}
+	const std::vector<int>& ids = pending ? obsIds : scene.obs_->point3D_ids;
+	const std::vector<double>& xy = pending ? obsXY : scene.obs_->xy;
+	const std::vector<float>& xyf = pending ? obsXYf : scene.obs_->xy_f;
+
+	std::vector<ImageRecord> images;
+	std::string names;
+	images.reserve(scene.images_.size());
+	for (const Image& img : scene.images_) {
+		ImageRecord rec = {};
+		rec.id = img.id;
+		rec.camera_id = img.camera_id;
+		rec.name_offset = static_cast<uint32_t>(names.size());
+		rec.name_length = static_cast<uint32_t>(img.name.size());
+		names.append(img.name.data(), img.name.size());
+		for (int i = 0; i < 4; ++i) rec.qvec[i] = img.qvec[i];
+		for (int i = 0; i < 3; ++i) rec.tvec[i] = img.tvec[i];
+		rec.obs_begin = img.obs_begin;
+		rec.num_obs = img.num_obs;
+		if (img.obs_pending) {
+			rec.obs_begin = static_cast<uint32_t>(obsIds.size());
+			scene.DecodeObservations(img, obsIds, obsXY, obsXYf);
+			rec.num_obs = static_cast<uint32_t>(obsIds.size() - rec.obs_begin);
+		}
+		images.push_back(rec);
+	}
+
+	std::vector<PointRecord> points;
+	std::vector<int32_t> tracks;
+	points.reserve(scene.points_.size());
+	for (const Point3D& pt : scene.points_) {
+		PointRecord rec = {};
+		rec.id = pt.id;
+		for (int i = 0; i < 3; ++i) rec.color[i] = pt.color[i];
+		rec.x = pt.x;
+		rec.y = pt.y;
+		rec.z = pt.z;
+		rec.error = pt.error;
+		rec.track_begin = tracks.size();
+		rec.track_length = static_cast<uint32_t>(pt.track.size());
+		tracks.insert(tracks.end(), pt.track.begin(), pt.track.end());
+		points.push_back(rec);
+	}
+
+	ViewRecord view = {};
+	std::memcpy(view.viewMatrix, state.viewMatrix, sizeof(view.viewMatrix));
+	view.cursorMode = state.cursorMode;
+	view.lastSelectMode = state.lastSelectMode;
+	view.pointSize = state.pointSize;
+	view.cameraSize = state.cameraSize;
+
+	std::vector<Section> sections = {
+		{ kSectionCameras, cameras.data(), cameras.size() * sizeof(CameraRecord) },
+		{ kSectionImages, images.data(), images.size() * sizeof(ImageRecord) },
+		{ kSectionNames, names.data(), names.size() },
+		{ kSectionObsIds, ids.data(), ids.size() * sizeof(int32_t) },
+		{ kSectionPoints, points.data(), points.size() * sizeof(PointRecord) },
+		{ kSectionTracks, tracks.data(), tracks.size() * sizeof(int32_t) },
+		{ kSectionPoses, scene.poses_->data(), scene.poses_->size() * sizeof(CameraPose) },
+		{ kSectionSelPoints, state.selectedPoints.data(), state.selectedPoints.size() * sizeof(int32_t) },
+		{ kSectionSelCameras, state.selectedCameras.data(), state.selectedCameras.size() * sizeof(int32_t) },
+		{ kSectionView, &view, sizeof(view) },
+		{ kSectionModelDir, state.modelDir.data(), state.modelDir.size() }
+	};
+	if (scene.float_observations_)
+		sections.push_back({ kSectionObsXYFloat, xyf.data(), xyf.size() * sizeof(float) });
+	else
+		sections.push_back({ kSectionObsXY, xy.data(), xy.size() * sizeof(double) });
+
+	size_t offset = Align8(sizeof(FileHeader) + sections.size() * sizeof(SectionEntry));
+	std::vector<SectionEntry> entries;
+	for (const Section& sec : sections) {
+		entries.push_back({ sec.tag, 0, offset, sec.size });
+		offset = Align8(offset + sec.size);
+	}
+
+	std::vector<char> out(offset, 0);
+	FileHeader header = {};
+	std::memcpy(header.magic, kMagic, sizeof(kMagic));
+	header.version = kVersion;
+	header.sectionCount = static_cast<uint32_t>(sections.size());
+	header.fileSize = offset;
+	std::memcpy(out.data(), &header, sizeof(header));
+	std::memcpy(out.data() + sizeof(header), entries.data(), entries.size() * sizeof(SectionEntry));
+	for (size_t i = 0; i < sections.size(); ++i) {
+		if (sections[i].size) std::memcpy(out.data() + entries[i].offset, sections[i].data, sections[i].size);
+	}
+	return out;
+}
+
+bool SessionFile::Write(const std::string& path, const std::vector<char>& data)
+{
+	std::string tmpPath = path + ".tmp";
+	{
+		std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) return false;
+		file.write(data.data(), static_cast<std::streamsize>(data.size()));
+		if (!file) return false;
+	}
+	std::error_code ec;
+	std::filesystem::rename(tmpPath, path, ec);
+	return !ec;
+}
+
+bool SessionFile::Load(const std::string& path, Scene& scene, SessionState& state)
+{
+	if (!IsLittleEndian()) return false;
+	MappedFile file;
+	if (!file.Open(path) || file.Size() < sizeof(FileHeader)) return false;
+	const char* base = file.Data();
+	const FileHeader* header = reinterpret_cast<const FileHeader*>(base);
+	if (std::memcmp(header->magic, kMagic, sizeof(kMagic)) != 0) return false;
+	if (header->version != kVersion || header->fileSize != file.Size()) return false;
+	if (sizeof(FileHeader) + uint64_t(header->sectionCount) * sizeof(SectionEntry) > file.Size()) return false;
+	const SectionEntry* entries = reinterpret_cast<const SectionEntry*>(base + sizeof(FileHeader));
+	for (uint32_t i = 0; i < header->sectionCount; ++i) {
+		if (entries[i].offset % 8 != 0 || entries[i].offset > file.Size() ||
+			entries[i].size > file.Size() - entries[i].offset) return false;
+	}
+	SectionReader reader(base, entries, header->sectionCount);
+
+	size_t numCameras, numImages, numNames, numObs, numXY, numPoints, numTracks, numPoses;
+	const CameraRecord* cameras = reader.Get<CameraRecord>(kSectionCameras, numCameras);
+	const ImageRecord* images = reader.Get<ImageRecord>(kSectionImages, numImages);
+	const char* names = reader.Get<char>(kSectionNames, numNames);
+	const int32_t* obsIds = reader.Get<int32_t>(kSectionObsIds, numObs);
+	const PointRecord* points = reader.Get<PointRecord>(kSectionPoints, numPoints);
+	const int32_t* tracks = reader.Get<int32_t>(kSectionTracks, numTracks);
+	const CameraPose* poses = reader.Get<CameraPose>(kSectionPoses, numPoses);
+	const double* obsXY = reader.Get<double>(kSectionObsXY, numXY);
+	const float* obsXYf = nullptr;
+	if (!obsXY) obsXYf = reader.Get<float>(kSectionObsXYFloat, numXY);
+	if (numXY != 2 * numObs || numPoses != numImages) return false;
+
+	scene.MarkEdited();
+	std::map<int, Camera>& sceneCameras = scene.cameras_.Mutable();
+	for (size_t i = 0; i < numCameras; ++i) {
+		const CameraRecord& rec = cameras[i];
+		if (rec.num_params < 0 || rec.num_params > kMaxCameraParams) return false;
+		Camera cam;
+		cam.id = rec.id;
+		cam.model.assign(rec.model, strnlen(rec.model, sizeof(rec.model)));
+		cam.width = rec.width;
+		cam.height = rec.height;
+		cam.num_params = rec.num_params;
+		for (int k = 0; k < rec.num_params; ++k) cam.params[k] = rec.params[k];
+		sceneCameras.emplace_hint(sceneCameras.end(), cam.id, cam);
+	}
+
+	std::vector<Image> sceneImages;
+	sceneImages.reserve(numImages);
+	for (size_t i = 0; i < numImages; ++i) {
+		const ImageRecord& rec = images[i];
+		if (uint64_t(rec.name_offset) + rec.name_length > numNames) return false;
+		if (uint64_t(rec.obs_begin) + rec.num_obs > numObs) return false;
+		Image img;
+		img.id = rec.id;
+		img.camera_id = rec.camera_id;
+		img.name = scene.names_->Intern(std::string_view(names + rec.name_offset, rec.name_length));
+		for (int k = 0; k < 4; ++k) img.qvec[k] = rec.qvec[k];
+		for (int k = 0; k < 3; ++k) img.tvec[k] = rec.tvec[k];
+		img.obs_begin = rec.obs_begin;
+		img.num_obs = rec.num_obs;
+		sceneImages.push_back(img);
+	}
+	scene.images_.Insert(std::move(sceneImages));
+
+	Scene::Observations& obs = scene.obs_.Mutable();
+	obs.point3D_ids.assign(obsIds, obsIds + numObs);
+	scene.float_observations_ = obsXYf != nullptr;
+	if (obsXYf) obs.xy_f.assign(obsXYf, obsXYf + numXY);
+	else obs.xy.assign(obsXY, obsXY + numXY);
+	scene.poses_.Mutable().assign(poses, poses + numPoses);
+
+	std::pmr::memory_resource* trackArena = scene.NewTrackArena(numTracks * sizeof(int32_t));
+	std::vector<Point3D> scenePoints;
+	scenePoints.reserve(numPoints);
+	for (size_t i = 0; i < numPoints; ++i) {
+		const PointRecord& rec = points[i];
+		if (rec.track_begin + rec.track_length > numTracks) return false;
+		Point3D pt = { rec.id, rec.x, rec.y, rec.z, { rec.color[0], rec.color[1], rec.color[2] }, rec.error,
+			std::pmr::vector<int>(tracks + rec.track_begin, tracks + rec.track_begin + rec.track_length, trackArena) };
+		scenePoints.push_back(std::move(pt));
+	}
+	scene.points_.Insert(std::move(scenePoints));
+
+	size_t numSel, numView, numDir;
+	const int32_t* sel = reader.Get<int32_t>(kSectionSelPoints, numSel);
+	state.selectedPoints.assign(sel, sel + numSel);
+	sel = reader.Get<int32_t>(kSectionSelCameras, numSel);
+	state.selectedCameras.assign(sel, sel + numSel);
+	const ViewRecord* view = reader.Get<ViewRecord>(kSectionView, numView);
+	if (view && numView == 1) {
+		std::memcpy(state.viewMatrix, view->viewMatrix, sizeof(state.viewMatrix));
+		state.cursorMode = view->cursorMode;
+		state.lastSelectMode = view->lastSelectMode;
+		state.pointSize = view->pointSize;
+		state.cameraSize = view->cameraSize;
+	}
+	const char* dir = reader.Get<char>(kSectionModelDir, numDir);
+	state.modelDir.assign(dir ? dir : "", numDir);
+	scene.UpdateIndex();
+	return true;
+}
+
+SessionSaver::SessionSaver()
+{
+	thread_ = std::thread(&SessionSaver::Run, this);
+}
+
+SessionSaver::~SessionSaver()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stop_ = true;
+	}
+	cv_.notify_one();
+	thread_.join();
+}
+
+void SessionSaver::Save(const std::string& path, std::shared_ptr<const Scene> snapshot, SessionState state,
+	Callback done)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		path_ = path;
+		snapshot_ = std::move(snapshot);
+		state_ = std::move(state);
+		done_ = std::move(done);
+		pending_ = true;
+	}
+	cv_.notify_one();
+}
+
+void SessionSaver::Run()
+{
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (true) {
+		cv_.wait(lock, [this]() { return pending_ || stop_; });
+		// A pending save is still written on shutdown
+		if (!pending_) break;
+		std::string path = std::move(path_);
+		std::shared_ptr<const Scene> snapshot = std::move(snapshot_);
+		SessionState state = std::move(state_);
+		Callback done = std::move(done_);
+		pending_ = false;
+		lock.unlock();
+		bool ok = SessionFile::Write(path, SessionFile::Serialize(*snapshot, state));
+		// Released outside the lock, freeing storage the scene has since cloned can take a while
+		snapshot.reset();
+		if (done) done(ok, path);
+		lock.lock();
+	}
+}
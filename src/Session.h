@@ -0,0 +1,63 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Scene.h"
+
+// Editor state saved next to the scene contents
+struct SessionState {
+    std::vector<int> selectedPoints;
+    std::vector<int> selectedCameras;
+    int lastSelectMode = 0;
+    int cursorMode = 0;
+    float pointSize = 2.0f;
+    float cameraSize = 0.05f;
+    double viewMatrix[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 }; // camera manipulator matrix
+    std::string modelDir; // directory the model was imported from
+};
+
+// Versioned binary session file. A fixed header is followed by a section table and
+// 8-byte aligned sections of fixed-width little-endian records, so a mapped file
+// is read back with bulk copies instead of parsing.
+class SessionFile {
+public:
+    static constexpr uint32_t kVersion = 1;
+
+    // Build the complete file image in memory
+    static std::vector<char> Serialize(const Scene& scene, const SessionState& state);
+    // Write a file image through a temporary file so a crash never leaves a torn session
+    static bool Write(const std::string& path, const std::vector<char>& data);
+    static bool Load(const std::string& path, Scene& scene, SessionState& state);
+};
+
+// Serializes and writes session files on a background thread, from a snapshot so
+// the scene can be edited meanwhile. Only the newest pending request is kept, so
+// saves issued while a write is in flight collapse into one.
+class SessionSaver {
+public:
+    // Called on the writer thread
+    using Callback = std::function<void(bool ok, const std::string& path)>;
+
+    SessionSaver();
+    ~SessionSaver();
+
+    void Save(const std::string& path, std::shared_ptr<const Scene> snapshot, SessionState state, Callback done);
+
+private:
+    void Run();
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool pending_ = false;
+    bool stop_ = false;
+    std::string path_;
+    std::shared_ptr<const Scene> snapshot_;
+    SessionState state_;
+    Callback done_;
+};
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstring>
+#include <memory_resource>
+#include <string_view>
+#include <unordered_set>
+
+// Interns strings into a monotonic arena so that each distinct string is stored
+// once and costs no separate heap allocation; the lookup table lives in the same
+// arena. Views returned by Intern stay valid for the lifetime of the pool.
+class StringPool {
+public:
+    StringPool() = default;
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+
+    std::string_view Intern(std::string_view str)
+    {
+        auto found = lookup_.find(str);
+        if (found != lookup_.end()) return *found;
+        char* dst = static_cast<char*>(arena_.allocate(str.size() ? str.size() : 1, 1));
+        std::memcpy(dst, str.data(), str.size());
+        std::string_view interned(dst, str.size());
+        lookup_.insert(interned);
+        return interned;
+    }
+
+    size_t Size() const { return lookup_.size(); }
+
+    void Clear()
+    {
+        // The table has to let go of its nodes before the arena does
+        std::pmr::unordered_set<std::string_view>(&arena_).swap(lookup_);
+        arena_.release();
+    }
+
+private:
+    static constexpr size_t kBlockSize = 64 * 1024;
+    std::pmr::monotonic_buffer_resource arena_{ kBlockSize };
+    std::pmr::unordered_set<std::string_view> lookup_{ &arena_ };
+};
@@ -0,0 +1,90 @@
+#pragma once
+#include <array>
+#include <charconv>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+// Parsing helpers for the lines of COLMAP text files, shared by Scene::Import and
+// the streaming model filter
+
+inline bool IsFieldSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Whitespace separated fields of one line of a COLMAP text file
+class FieldReader {
+public:
+    FieldReader(const char* begin, const char* end) : p_(begin), end_(end) {}
+
+    template <typename T>
+    bool Next(T& value)
+    {
+        SkipSpace();
+        auto result = std::from_chars(p_, end_, value);
+        if (result.ec != std::errc()) return false;
+        p_ = result.ptr;
+        return true;
+    }
+    bool Next(std::string_view& value)
+    {
+        SkipSpace();
+        const char* begin = p_;
+        while (p_ < end_ && !IsFieldSpace(*p_)) ++p_;
+        value = std::string_view(begin, p_ - begin);
+        return p_ > begin;
+    }
+
+private:
+    void SkipSpace()
+    {
+        while (p_ < end_ && IsFieldSpace(*p_)) ++p_;
+    }
+
+    const char* p_;
+    const char* end_;
+};
+
+// End of the line starting at p, excluding the newline
+inline const char* LineEnd(const char* p, const char* end)
+{
+    const char* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    return nl ? nl : end;
+}
+
+inline bool IsDataLine(const char* begin, const char* end)
+{
+    while (begin < end && IsFieldSpace(*begin)) ++begin;
+    return begin < end && *begin != '#';
+}
+
+// Fields of a points3D.txt line
+struct PointLine {
+    int id;
+    double x, y, z;
+    std::array<unsigned char, 3> color;
+    double error;
+    std::vector<int> track; // (image id, point2D index) pairs
+};
+
+// False for a line without an id; missing fields after it read as zero
+inline bool ParsePointLine(const char* begin, const char* end, PointLine& point)
+{
+    FieldReader fields(begin, end);
+    if (!fields.Next(point.id)) return false;
+    point.x = point.y = point.z = point.error = 0;
+    fields.Next(point.x);
+    fields.Next(point.y);
+    fields.Next(point.z);
+    for (int c = 0; c < 3; ++c) {
+        int value = 0;
+        fields.Next(value);
+        point.color[c] = static_cast<unsigned char>(value);
+    }
+    fields.Next(point.error);
+    int track_id;
+    point.track.clear();
+    while (fields.Next(track_id)) point.track.push_back(track_id);
+    return true;
+}
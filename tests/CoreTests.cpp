@@ -0,0 +1,369 @@
+// Checks of the model core that need neither a display nor wxWidgets: the chunked
+// id map against std::map, snapshots keeping their contents while the scene is
+// edited, a similarity transform followed by its inverse, the heap allocations of
+// an import and the errors recomputed when images are deleted.
+//
+//   CoreTests [--points N]
+//
+// Exits with 1 if any check fails.
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "AllocationCounter.h"
+#include "CowStorage.h"
+#include "Scene.h"
+
+static int g_failures = 0;
+
+#define CHECK(cond)                                                                \
+    do {                                                                           \
+        if (!(cond)) {                                                             \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            ++g_failures;                                                          \
+        }                                                                          \
+    } while (0)
+
+struct Item {
+    int id;
+    int value;
+};
+
+static bool SameContents(const ChunkedIdMap<Item>& map, const std::map<int, int>& reference)
+{
+    if (map.size() != reference.size()) return false;
+    auto ref = reference.begin();
+    for (const Item& item : map) {
+        if (item.id != ref->first || item.value != ref->second) return false;
+        ++ref;
+    }
+    for (size_t c = 0; c < map.NumChunks(); ++c)
+        if (map.GetChunk(c).empty() || map.GetChunk(c).size() > ChunkedIdMap<Item>::kChunkSize) return false;
+    return true;
+}
+
+// Random inserts, erasures and edits, each checked against std::map, with copies
+// taken along the way that must keep what they held
+static void TestChunkedIdMap()
+{
+    std::mt19937 rng(7);
+    ChunkedIdMap<Item> map;
+    std::map<int, int> reference;
+    std::vector<std::pair<ChunkedIdMap<Item>, std::map<int, int>>> snapshots;
+    int nextValue = 0;
+
+    for (int step = 0; step < 400; ++step) {
+        int op = std::uniform_int_distribution<int>(0, 4)(rng);
+        int maxId = static_cast<int>(reference.size()) * 2 + 1000;
+        if (op == 0 || reference.size() < 2000) {
+            // Mostly appended ids, sometimes ids merged in between, with duplicates
+            std::vector<Item> values(std::uniform_int_distribution<size_t>(1, 6000)(rng));
+            bool append = rng() % 2 == 0;
+            int base = reference.empty() ? 0 : reference.rbegin()->first + 1;
+            for (Item& item : values) {
+                item.id = append ? base + std::uniform_int_distribution<int>(0, 8000)(rng)
+                                 : std::uniform_int_distribution<int>(0, maxId)(rng);
+                item.value = nextValue++;
+            }
+            // Of equal ids the last one counts
+            for (const Item& item : values) reference[item.id] = item.value;
+            map.Insert(std::move(values));
+        }
+        else if (op == 1) {
+            std::vector<int> ids(std::uniform_int_distribution<size_t>(0, 3000)(rng));
+            for (int& id : ids) id = std::uniform_int_distribution<int>(0, maxId)(rng);
+            std::sort(ids.begin(), ids.end());
+            ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+            for (int id : ids) reference.erase(id);
+            map.Erase(ids);
+        }
+        else if (op == 2) {
+            // Sometimes whole runs, so chunks empty out
+            int mod = std::uniform_int_distribution<int>(2, 50)(rng);
+            int lo = std::uniform_int_distribution<int>(0, maxId)(rng), hi = lo + mod * 500;
+            auto pred = [&](const Item& item) { return item.value % mod == 0 || (item.id >= lo && item.id < hi); };
+            size_t expected = 0;
+            for (auto it = reference.begin(); it != reference.end();) {
+                if (pred(Item{ it->first, it->second })) {
+                    it = reference.erase(it);
+                    ++expected;
+                }
+                else ++it;
+            }
+            CHECK(map.EraseIf(pred) == expected);
+        }
+        else if (op == 3) {
+            int mod = std::uniform_int_distribution<int>(1, 200)(rng);
+            auto match = [&](const Item& item) { return item.id % mod == 0; };
+            for (auto& it : reference)
+                if (it.first % mod == 0) it.second += 3;
+            map.EditIf(match, [](Item& item) { item.value += 3; });
+        }
+        else {
+            if (snapshots.size() == 8) snapshots.erase(snapshots.begin());
+            snapshots.emplace_back(map, reference);
+            if (rng() % 4 == 0) {
+                map.MakeUnique();
+                for (size_t c = 0; c < map.NumChunks(); ++c)
+                    for (Item& item : map.MutableChunk(c)) item.value = -item.value;
+                for (auto& it : reference) it.second = -it.second;
+            }
+        }
+        CHECK(SameContents(map, reference));
+        for (const auto& snapshot : snapshots) CHECK(SameContents(snapshot.first, snapshot.second));
+        if (g_failures) {
+            std::fprintf(stderr, "ChunkedIdMap diverged at step %d, operation %d\n", step, op);
+            return;
+        }
+    }
+}
+
+// Camera-from-world rotation, row-major, for a unit quaternion (w, x, y, z)
+static void QuaternionToRotation(const std::array<double, 4>& q, double R[9])
+{
+    const double w = q[0], x = q[1], y = q[2], z = q[3];
+    R[0] = 1 - 2 * (y * y + z * z); R[1] = 2 * (x * y - w * z); R[2] = 2 * (x * z + w * y);
+    R[3] = 2 * (x * y + w * z); R[4] = 1 - 2 * (x * x + z * z); R[5] = 2 * (y * z - w * x);
+    R[6] = 2 * (x * z - w * y); R[7] = 2 * (y * z + w * x); R[8] = 1 - 2 * (x * x + y * y);
+}
+
+// Synthetic model: points scattered around the origin, seen by a ring of cameras
+// looking at it, every point observed by two of them
+static bool WriteSyntheticModel(const std::string& dir, size_t numPoints, size_t numCameras)
+{
+    std::mt19937 rng(11);
+    std::normal_distribution<double> gauss(0.0, 1.0);
+    std::ofstream cameras(dir + "/cameras.txt");
+    cameras << "1 PINHOLE 1920 1080 1500 1500 960 540\n";
+
+    std::ofstream images(dir + "/images.txt");
+    images.precision(17);
+    std::vector<std::vector<int>> observers(numCameras);
+    for (size_t p = 0; p < numPoints; ++p) {
+        observers[p % numCameras].push_back(static_cast<int>(p));
+        observers[(p * 7 + 1) % numCameras].push_back(static_cast<int>(p));
+    }
+    for (size_t c = 0; c < numCameras; ++c) {
+        // Turned about the vertical by the camera's angle, the origin 6 ahead
+        double angle = 2 * 3.14159265358979323846 * c / numCameras;
+        std::array<double, 4> q = { std::cos(angle / 2), 0, std::sin(angle / 2), 0 };
+        double t[3] = { 0.1 * gauss(rng), 0.1 * gauss(rng), 6 };
+        images << c + 1 << " " << q[0] << " " << q[1] << " " << q[2] << " " << q[3] << " "
+               << t[0] << " " << t[1] << " " << t[2] << " 1 image" << c + 1 << ".jpg\n";
+        for (int p : observers[c])
+            images << 960 + 200 * gauss(rng) << " " << 540 + 200 * gauss(rng) << " " << p + 1 << " ";
+        images << "\n";
+    }
+
+    std::vector<std::vector<int>> tracks(numPoints);
+    for (size_t c = 0; c < numCameras; ++c)
+        for (size_t k = 0; k < observers[c].size(); ++k) {
+            tracks[observers[c][k]].push_back(static_cast<int>(c) + 1);
+            tracks[observers[c][k]].push_back(static_cast<int>(k));
+        }
+    std::ofstream points(dir + "/points3D.txt");
+    points.precision(17);
+    for (size_t p = 0; p < numPoints; ++p) {
+        points << p + 1 << " " << gauss(rng) << " " << gauss(rng) << " " << gauss(rng) << " 128 128 128 0.5";
+        for (int v : tracks[p]) points << " " << v;
+        points << "\n";
+    }
+    return cameras.good() && images.good() && points.good();
+}
+
+struct ModelCopy {
+    std::vector<std::array<double, 3>> points;
+    std::vector<std::array<double, 4>> qvecs;
+    std::vector<std::array<double, 3>> tvecs;
+};
+
+static ModelCopy CopyModel(const Scene& scene)
+{
+    ModelCopy copy;
+    for (const Point3D& pt : scene.GetPoints()) copy.points.push_back({ pt.x, pt.y, pt.z });
+    for (const Image& img : scene.GetImages()) {
+        // Unit quaternions q and -q are the same rotation
+        std::array<double, 4> q = img.qvec;
+        if (q[0] < 0)
+            for (double& v : q) v = -v;
+        copy.qvecs.push_back(q);
+        copy.tvecs.push_back(img.tvec);
+    }
+    return copy;
+}
+
+// Largest difference relative to the largest magnitude, over all components
+template <size_t N>
+static double RelativeError(const std::vector<std::array<double, N>>& a, const std::vector<std::array<double, N>>& b)
+{
+    double maxDiff = 0, maxValue = 0;
+    for (size_t i = 0; i < a.size(); ++i)
+        for (size_t k = 0; k < N; ++k) {
+            maxDiff = std::max(maxDiff, std::abs(a[i][k] - b[i][k]));
+            maxValue = std::max(maxValue, std::abs(a[i][k]));
+        }
+    return maxValue > 0 ? maxDiff / maxValue : maxDiff;
+}
+
+static void TestTransformAndImport(const std::string& dir, size_t numPoints)
+{
+    if (!WriteSyntheticModel(dir, numPoints, 200)) {
+        std::fprintf(stderr, "cannot write the synthetic model to %s\n", dir.c_str());
+        ++g_failures;
+        return;
+    }
+
+    // Tracks, names and map nodes come from arenas, so an import allocates about
+    // as often for a large model as for a small one
+    Scene scene;
+    size_t allocationsBefore = AllocationCount();
+    bool imported = scene.Import(dir + "/points3D.txt", dir + "/cameras.txt", dir + "/images.txt");
+    size_t allocations = AllocationCount() - allocationsBefore;
+    CHECK(imported);
+    CHECK(scene.GetPoints().size() == numPoints);
+    CHECK(allocations < numPoints / 50 + 2000);
+    std::printf("import of %zu points: %zu allocations\n", numPoints, allocations);
+    if (!imported) return;
+
+    ReprojectionStats before = scene.UpdateReprojectionErrors();
+    std::shared_ptr<const Scene> snapshot = scene.Snapshot();
+    ModelCopy original = CopyModel(scene);
+
+    SimilarityTransform transform;
+    transform.scale = 3.7;
+    double half = 0.6;
+    std::array<double, 3> axis = { 0.48, -0.6, 0.64 };
+    transform.qvec = { std::cos(half), std::sin(half) * axis[0], std::sin(half) * axis[1], std::sin(half) * axis[2] };
+    transform.translation = { 120.5, -42.25, 7.125 };
+    CHECK(scene.Transform(transform));
+
+    // Reprojection errors do not depend on the frame
+    ReprojectionStats moved = scene.UpdateReprojectionErrors();
+    CHECK(moved.observations == before.observations);
+    CHECK(std::abs(moved.mean_error - before.mean_error) <= 1e-9 * std::max(1.0, before.mean_error));
+
+    // X = (1 / s) R^T (X' - t)
+    double R[9];
+    QuaternionToRotation(transform.qvec, R);
+    SimilarityTransform inverse;
+    inverse.scale = 1 / transform.scale;
+    inverse.qvec = { transform.qvec[0], -transform.qvec[1], -transform.qvec[2], -transform.qvec[3] };
+    for (int r = 0; r < 3; ++r)
+        inverse.translation[r] = -(R[r] * transform.translation[0] + R[3 + r] * transform.translation[1] +
+                                   R[6 + r] * transform.translation[2]) / transform.scale;
+    CHECK(scene.Transform(inverse));
+
+    ModelCopy roundTrip = CopyModel(scene);
+    double pointError = RelativeError(original.points, roundTrip.points);
+    double qvecError = RelativeError(original.qvecs, roundTrip.qvecs);
+    double tvecError = RelativeError(original.tvecs, roundTrip.tvecs);
+    std::printf("transform round trip: points %.1e, qvec %.1e, tvec %.1e relative\n", pointError, qvecError, tvecError);
+    CHECK(pointError < 1e-13);
+    CHECK(qvecError < 1e-13);
+    CHECK(tvecError < 1e-13);
+
+    // The snapshot still holds the model as imported
+    ModelCopy held = CopyModel(*snapshot);
+    CHECK(RelativeError(original.points, held.points) == 0);
+    CHECK(RelativeError(original.qvecs, held.qvecs) == 0);
+    CHECK(RelativeError(original.tvecs, held.tvecs) == 0);
+    CHECK(snapshot->Version() != scene.Version());
+
+    // Deleting from the scene leaves the snapshot whole
+    std::vector<int> selected;
+    for (int i = 0; i < static_cast<int>(numPoints); i += 3) selected.push_back(i);
+    scene.DeletePoints(selected);
+    CHECK(scene.GetPoints().size() == numPoints - selected.size());
+    CHECK(snapshot->GetPoints().size() == numPoints);
+    CHECK(RelativeError(original.points, CopyModel(*snapshot).points) == 0);
+}
+
+static std::map<int, std::pair<size_t, double>> TracksAndErrors(const Scene& scene)
+{
+    std::map<int, std::pair<size_t, double>> points;
+    for (const Point3D& pt : scene.GetPoints()) points[pt.id] = { pt.track.size(), pt.error };
+    return points;
+}
+
+// Deleting images recomputes the errors of just the points that lost observations,
+// matching a full recompute, and leaves a lazy import's observations pending
+static void TestDeleteImagesErrors(const std::string& dir)
+{
+    const std::string points = dir + "/points3D.txt", cameras = dir + "/cameras.txt", images = dir + "/images.txt";
+    Scene eager, full, lazy;
+    ImportOptions lazyOptions;
+    lazyOptions.lazy_observations = true;
+    if (!eager.Import(points, cameras, images) || !full.Import(points, cameras, images) ||
+        !lazy.Import(points, cameras, images, lazyOptions)) {
+        std::fprintf(stderr, "cannot import the synthetic model from %s\n", dir.c_str());
+        ++g_failures;
+        return;
+    }
+    std::map<int, std::pair<size_t, double>> imported = TracksAndErrors(lazy);
+    eager.UpdateReprojectionErrors();
+
+    std::vector<int> selected;
+    for (int i = 0; i < static_cast<int>(eager.GetImages().size()); i += 7) selected.push_back(i);
+    std::vector<int> copy = selected;
+    eager.DeleteImages(copy);
+    copy = selected;
+    full.DeleteImages(copy);
+    full.UpdateReprojectionErrors();
+    copy = selected;
+    lazy.DeleteImages(copy);
+    CHECK(lazy.HasPendingObservations());
+
+    std::map<int, std::pair<size_t, double>> byEager = TracksAndErrors(eager), byFull = TracksAndErrors(full),
+        byLazy = TracksAndErrors(lazy);
+    CHECK(byEager.size() == byFull.size() && byLazy.size() == byFull.size());
+    size_t shortened = 0, mismatched = 0;
+    for (const auto& it : byFull) {
+        double expected = it.second.second;
+        auto near = [&](double e) { return std::abs(e - expected) <= 1e-12 * std::max(1.0, expected); };
+        if (!near(byEager[it.first].second)) ++mismatched;
+        // Lazy points keep the error from the file unless their track changed
+        bool changed = imported[it.first].first != it.second.first;
+        shortened += changed;
+        if (!(changed ? near(byLazy[it.first].second) : byLazy[it.first].second == imported[it.first].second))
+            ++mismatched;
+    }
+    CHECK(shortened > 0);
+    CHECK(mismatched == 0);
+}
+
+int main(int argc, char** argv)
+{
+    size_t numPoints = 200000;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--points" && i + 1 < argc) numPoints = std::strtoull(argv[++i], nullptr, 10);
+        else {
+            std::fprintf(stderr, "usage: %s [--points N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    TestChunkedIdMap();
+
+    std::error_code ec;
+    std::filesystem::path dir = std::filesystem::temp_directory_path(ec) / "ColmapEditorCoreTests";
+    std::filesystem::create_directories(dir, ec);
+    TestTransformAndImport(dir.string(), std::max<size_t>(numPoints, 1000));
+    TestDeleteImagesErrors(dir.string());
+    std::filesystem::remove_all(dir, ec);
+
+    if (g_failures) {
+        std::fprintf(stderr, "%d checks failed\n", g_failures);
+        return 1;
+    }
+    std::printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,119 @@
+// Crops and filters a COLMAP text model too large to load, streaming it from disk
+// to disk in constant memory. Points outside the box, with a larger reprojection
+// error, seen by fewer images or excluded by an id list are dropped, and their
+// observations in images.txt set to -1.
+//
+//   FilterModel --input DIR --output DIR [--box MINX MINY MINZ MAXX MAXY MAXZ]
+//               [--max-error E] [--min-track N] [--keep-ids FILE | --remove-ids FILE]
+//               [--compress gz|zst]
+//
+// Inputs may be .txt, .txt.gz or .txt.zst; --compress picks the output format.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "CompressedFile.h"
+#include "ModelFilter.h"
+#include "TextParsing.h"
+
+struct Options {
+    std::string input, output;
+    PointFilter filter;
+    std::string idsPath;
+    Compression compression = Compression::None;
+};
+
+static bool ParseOptions(int argc, char** argv, Options& opt)
+{
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--box") {
+            if (i + 6 >= argc) return false;
+            opt.filter.use_box = true;
+            for (int k = 0; k < 3; ++k) opt.filter.box_min[k] = std::strtod(argv[++i], nullptr);
+            for (int k = 0; k < 3; ++k) opt.filter.box_max[k] = std::strtod(argv[++i], nullptr);
+            continue;
+        }
+        if (i + 1 >= argc) return false;
+        const char* value = argv[++i];
+        if (arg == "--input") opt.input = value;
+        else if (arg == "--output") opt.output = value;
+        else if (arg == "--max-error") opt.filter.max_error = std::strtod(value, nullptr);
+        else if (arg == "--min-track") opt.filter.min_track_length = std::strtoull(value, nullptr, 10);
+        else if (arg == "--keep-ids" || arg == "--remove-ids") {
+            if (opt.filter.id_list != PointFilter::IdList::None) return false;
+            opt.filter.id_list = arg == "--keep-ids" ? PointFilter::IdList::Keep : PointFilter::IdList::Remove;
+            opt.idsPath = value;
+        }
+        else if (arg == "--compress") {
+            opt.compression = CompressionFromPath(std::string(".") + value);
+            if (opt.compression == Compression::None) return false;
+        }
+        else return false;
+    }
+    return !opt.input.empty() && !opt.output.empty();
+}
+
+// Point ids separated by white space or one per line, sorted for PointFilter
+static bool ReadIds(const std::string& path, std::vector<int>& ids)
+{
+    TextFileReader file;
+    if (!file.Open(path)) return false;
+    const char* p = file.Data();
+    const char* end = p + file.Size();
+    while (p < end) {
+        const char* line_end = LineEnd(p, end);
+        if (IsDataLine(p, line_end)) {
+            FieldReader fields(p, line_end);
+            int id;
+            while (fields.Next(id)) ids.push_back(id);
+        }
+        p = line_end < end ? line_end + 1 : end;
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    Options opt;
+    if (!ParseOptions(argc, argv, opt)) {
+        std::fprintf(stderr, "usage: %s --input DIR --output DIR [--box MINX MINY MINZ MAXX MAXY MAXZ] [--max-error E] "
+                             "[--min-track N] [--keep-ids FILE | --remove-ids FILE] [--compress gz|zst]\n", argv[0]);
+        return 1;
+    }
+    if (!CompressionSupported(opt.compression)) {
+        std::fprintf(stderr, "this build cannot write %s files\n", CompressionExtension(opt.compression));
+        return 1;
+    }
+    std::error_code ec;
+    if (std::filesystem::equivalent(opt.input, opt.output, ec)) {
+        std::fprintf(stderr, "the output directory has to differ from the input\n");
+        return 1;
+    }
+    std::filesystem::create_directories(opt.output, ec);
+    if (!opt.idsPath.empty() && !ReadIds(opt.idsPath, opt.filter.ids)) {
+        std::fprintf(stderr, "cannot read %s\n", opt.idsPath.c_str());
+        return 1;
+    }
+
+    ModelFiles input = { opt.input + "/points3D.txt", opt.input + "/cameras.txt", opt.input + "/images.txt" };
+    std::string extension = CompressionExtension(opt.compression);
+    ModelFiles output = { opt.output + "/points3D.txt" + extension, opt.output + "/cameras.txt" + extension,
+                          opt.output + "/images.txt" + extension };
+    FilterStats stats;
+    auto start = std::chrono::steady_clock::now();
+    if (!FilterModel(input, output, opt.filter, &stats)) {
+        std::fprintf(stderr, "filtering %s into %s failed\n", opt.input.c_str(), opt.output.c_str());
+        return 1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("kept %zu of %zu points, removed %zu observations from %zu images in %.2f s\n", stats.points_kept,
+                stats.points_read, stats.observations_removed, stats.images, seconds);
+    return 0;
+}